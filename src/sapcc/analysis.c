@@ -0,0 +1,388 @@
+
+#include "analysis.h"
+#include "errors.h"
+#include "logger.h"
+
+#define ALEVEL 20
+
+static Parser* parser_state;
+static int end_bit;
+
+/*
+ * Add FIRST of the symbol string to the set. Returns true if the whole string
+ * can derive nothing.
+ */
+bool first_of_string(BitSet* set, int* list, int len) {
+
+    for(int i = 0; i < len; i++) {
+        Symbol* sym = get_symbol_by_id(parser_state->symbols, list[i]);
+        if(sym->term != NULL) {
+            set_bit(set, sym->id);
+            return false;
+        }
+        else if(sym->nterm != NULL) {
+            union_bitset(set, sym->nterm->first);
+            if(!sym->nterm->nullable)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static bool nullable_rules(RuleList* list) {
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(list);
+    while(iterate_list(rli, &rule)) {
+        int i;
+        for(i = 0; i < rule->len; i++) {
+            Symbol* sym = get_symbol_by_id(parser_state->symbols, rule->list[i]);
+            if(sym->nterm == NULL || !sym->nterm->nullable)
+                break;
+        }
+        if(i == rule->len)
+            return true;
+    }
+
+    return false;
+}
+
+static void compute_nullable() {
+
+    bool changed = true;
+
+    while(changed) {
+        changed = false;
+
+        NonTerminal* nterm;
+        NonTermListIter* ntli = init_list_iterator(parser_state->non_terminals);
+        while(iterate_list(ntli, &nterm)) {
+            if(!nterm->nullable &&
+               (nullable_rules(nterm->list) || nullable_rules(nterm->tails))) {
+                nterm->nullable = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+static bool first_of_rules(NonTerminal* nterm, RuleList* list) {
+
+    bool changed = false;
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(list);
+    while(iterate_list(rli, &rule)) {
+        clear_bitset(rule->predict);
+        rule->nullable = first_of_string(rule->predict, rule->list, rule->len);
+        if(union_bitset(nterm->first, rule->predict))
+            changed = true;
+    }
+
+    return changed;
+}
+
+static void compute_first() {
+
+    bool changed = true;
+
+    while(changed) {
+        changed = false;
+
+        NonTerminal* nterm;
+        NonTermListIter* ntli = init_list_iterator(parser_state->non_terminals);
+        while(iterate_list(ntli, &nterm)) {
+            if(first_of_rules(nterm, nterm->list))
+                changed = true;
+            if(first_of_rules(nterm, nterm->tails))
+                changed = true;
+        }
+    }
+}
+
+static bool follow_of_rules(NonTerminal* nterm, RuleList* list, BitSet* tmp) {
+
+    bool changed = false;
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(list);
+    while(iterate_list(rli, &rule)) {
+        for(int i = 0; i < rule->len; i++) {
+            Symbol* sym = get_symbol_by_id(parser_state->symbols, rule->list[i]);
+            if(sym->nterm == NULL)
+                continue;
+
+            clear_bitset(tmp);
+            bool nullable = first_of_string(tmp, &rule->list[i + 1], rule->len - i - 1);
+            if(nullable)
+                union_bitset(tmp, nterm->follow);
+            if(union_bitset(sym->nterm->follow, tmp))
+                changed = true;
+        }
+    }
+
+    return changed;
+}
+
+static void compute_follow() {
+
+    bool changed = true;
+    BitSet* tmp = create_bitset(end_bit + 1);
+
+    // the first non-terminal is the start symbol
+    NonTerminal* start;
+    NonTermListIter* ntli = init_list_iterator(parser_state->non_terminals);
+    if(iterate_list(ntli, &start))
+        set_bit(start->follow, end_bit);
+
+    while(changed) {
+        changed = false;
+
+        NonTerminal* nterm;
+        ntli = init_list_iterator(parser_state->non_terminals);
+        while(iterate_list(ntli, &nterm)) {
+            if(follow_of_rules(nterm, nterm->list, tmp))
+                changed = true;
+            if(follow_of_rules(nterm, nterm->tails, tmp))
+                changed = true;
+        }
+    }
+
+    destroy_bitset(tmp);
+}
+
+/*
+ * Add what can follow each non-terminal in the lines to its exit set. The
+ * leading symbol of its own left recursive lines is skipped, because what
+ * follows it there goes on the list instead of ending it.
+ */
+static void exits_of_rules(NonTerminal* nterm, RuleList* list, bool tails, BitSet** exits, BitSet* tmp) {
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(list);
+    while(iterate_list(rli, &rule)) {
+        for(int i = 0; i < rule->len; i++) {
+            Symbol* sym = get_symbol_by_id(parser_state->symbols, rule->list[i]);
+            if(sym->nterm == NULL || (tails && i == 0 && sym->nterm == nterm))
+                continue;
+
+            clear_bitset(tmp);
+            if(first_of_string(tmp, &rule->list[i + 1], rule->len - i - 1))
+                union_bitset(tmp, nterm->follow);
+            union_bitset(exits[sym->nterm->val - BASE_NTERM], tmp);
+        }
+    }
+}
+
+/*
+ * The sets that the generated parser recovers from a syntax error with.
+ * After an error in a non-terminal, the input is skipped up to a token of its
+ * sync set, which is FOLLOW and the %sync terminals. The more set of a
+ * non-terminal is the tokens that cannot come after it, so when it stops
+ * at one of them, it cannot end there and the error is in it. For a list
+ * of left recursive lines, that is an error in the line that did not go on.
+ */
+static void compute_sync() {
+
+    int num = length_list(parser_state->non_terminals);
+    BitSet** exits = _ALLOC_ARRAY(BitSet*, num);
+    BitSet* tmp = create_bitset(end_bit + 1);
+    BitSet* syncs = create_bitset(end_bit + 1);
+    NonTerminal* stream = parser_state->stream;
+
+    for(int i = 0; i < num; i++)
+        exits[i] = create_bitset(end_bit + 1);
+
+    Terminal* term;
+    TermListIter* tli = init_list_iterator(parser_state->terminals);
+    while(iterate_list(tli, &term))
+        if(term->sync)
+            set_bit(syncs, term->id);
+
+    // the start symbol ends at the end of the input, and so does a streamed
+    // element, which is also followed by the next one
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(parser_state->non_terminals);
+    if(iterate_list(ntli, &nterm))
+        set_bit(exits[0], end_bit);
+    if(stream != NULL) {
+        set_bit(exits[stream->val - BASE_NTERM], end_bit);
+        union_bitset(exits[stream->val - BASE_NTERM], stream->first);
+    }
+
+    ntli = init_list_iterator(parser_state->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        exits_of_rules(nterm, nterm->list, false, exits, tmp);
+        exits_of_rules(nterm, nterm->tails, true, exits, tmp);
+    }
+
+    ntli = init_list_iterator(parser_state->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        BitSet* exit = exits[nterm->val - BASE_NTERM];
+
+        nterm->sync = create_bitset(end_bit + 1);
+        union_bitset(nterm->sync, nterm->follow);
+        union_bitset(nterm->sync, exit);
+        union_bitset(nterm->sync, syncs);
+
+        nterm->more = create_bitset(end_bit + 1);
+        tli = init_list_iterator(parser_state->terminals);
+        while(iterate_list(tli, &term))
+            if(!test_bit(exit, term->id))
+                set_bit(nterm->more, term->id);
+    }
+
+    for(int i = 0; i < num; i++)
+        destroy_bitset(exits[i]);
+    _FREE(exits);
+    destroy_bitset(tmp);
+    destroy_bitset(syncs);
+}
+
+/*
+ * Fill in the predict set of every rule and fold them into the predict table
+ * row of the non-terminal. A cell that more than one rule predicts is a
+ * conflict and the generated parser falls back to backtracking for it.
+ */
+static void compute_predict() {
+
+    int num_terms = length_list(parser_state->terminals);
+
+    // map the symbol IDs of the terminals to their column in the table
+    int* column = _ALLOC_ARRAY(int, end_bit + 1);
+    for(int i = 0; i <= end_bit; i++)
+        column[i] = -1;
+
+    int idx = 0;
+    Terminal* term;
+    TermListIter* tli = init_list_iterator(parser_state->terminals);
+    while(iterate_list(tli, &term))
+        column[term->id] = idx++;
+    column[end_bit] = num_terms;
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(parser_state->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        nterm->predict = _ALLOC_ARRAY(uint8_t, num_terms + 1);
+        memset(nterm->predict, PREDICT_NONE, num_terms + 1);
+        nterm->ll1 = true;
+
+        int num = 1;
+        Rule* rule;
+        RuleListIter* rli = init_list_iterator(nterm->list);
+        while(iterate_list(rli, &rule)) {
+            if(rule->nullable)
+                union_bitset(rule->predict, nterm->follow);
+
+            for(int b = next_bit(rule->predict, 0); b >= 0;
+                b = next_bit(rule->predict, b + 1)) {
+                uint8_t* cell = &nterm->predict[column[b]];
+                if(*cell == PREDICT_NONE && num < PREDICT_CONFLICT)
+                    *cell = num;
+                else {
+                    *cell = PREDICT_CONFLICT;
+                    nterm->ll1 = false;
+                }
+            }
+            num++;
+        }
+    }
+
+    _FREE(column);
+}
+
+static void rule_to_str(Str* str, Rule* rule) {
+
+    for(int i = 0; i < rule->len; i++) {
+        if(i > 0)
+            add_string_char(str, ' ');
+        add_string_Str(str, get_symbol_by_id(parser_state->symbols, rule->list[i])->name);
+    }
+}
+
+/*
+ * Publish a warning for the first pair of conflicting rules in every
+ * non-terminal that is not LL(1).
+ */
+static void report_nterm_conflict(NonTerminal* nterm) {
+
+    Rule *first, *second;
+    RuleListIter* outer = init_list_iterator(nterm->list);
+    while(iterate_list(outer, &first)) {
+        RuleListIter* inner = init_list_iterator(nterm->list);
+        while(iterate_list(inner, &second) && second != first) {
+            if(intersects_bitset(first->predict, second->predict)) {
+                Str* a = create_string(NULL);
+                Str* b = create_string(NULL);
+                rule_to_str(a, second);
+                rule_to_str(b, first);
+                warning_at(nterm->line_no, "non-terminal \"%s\" is not LL(1), rules \"%s\" and \"%s\" "
+                           "conflict and will use backtracking",
+                           raw_string(nterm->name), raw_string(a), raw_string(b));
+                destroy_string(a);
+                destroy_string(b);
+                return;
+            }
+        }
+    }
+
+    warning_at(nterm->line_no, "non-terminal \"%s\" has too many rules for the predict table "
+               "and will use backtracking",
+               raw_string(nterm->name));
+}
+
+/*
+ * Public Interface
+ */
+void analyze_grammar(Parser* pstate) {
+
+    LOG(ALEVEL, "ENTER: analyze grammar");
+
+    parser_state = pstate;
+    end_bit = num_symbols(pstate->symbols);
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        nterm->nullable = false;
+        nterm->first = create_bitset(end_bit + 1);
+        nterm->follow = create_bitset(end_bit + 1);
+
+        Rule* rule;
+        RuleListIter* rli = init_list_iterator(nterm->list);
+        while(iterate_list(rli, &rule))
+            rule->predict = create_bitset(end_bit + 1);
+
+        rli = init_list_iterator(nterm->tails);
+        while(iterate_list(rli, &rule))
+            rule->predict = create_bitset(end_bit + 1);
+    }
+
+    compute_nullable();
+    compute_first();
+    compute_follow();
+    compute_sync();
+    compute_predict();
+
+    LOG(ALEVEL, "LEAVE: analyze grammar");
+}
+
+void report_conflicts(Parser* pstate) {
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm))
+        // an operator level does not backtrack over its lines
+        if(!nterm->ll1 && nterm->oper == NULL)
+            report_nterm_conflict(nterm);
+}
+
+/*
+ * The bit in the FOLLOW and predict sets that stands for the end of the
+ * input.
+ */
+int get_end_bit() {
+
+    return end_bit;
+}
@@ -0,0 +1,21 @@
+/*
+ * Grammar analysis. This computes the nullable flags and the FIRST and FOLLOW
+ * sets of the non-terminals, and from those the LL(1) predict set of every
+ * rule. The predict sets are folded into a row per non-terminal that the
+ * emitter writes as the predictive dispatch table.
+ */
+#ifndef _ANALYSIS_H
+#define _ANALYSIS_H
+
+#include "parser.h"
+
+// Values of a predict table cell. Any other value is the rule number plus 1.
+#define PREDICT_NONE     0
+#define PREDICT_CONFLICT 255
+
+void analyze_grammar(Parser* pstate);
+void report_conflicts(Parser* pstate);
+int get_end_bit();
+bool first_of_string(BitSet* set, int* list, int len);
+
+#endif /* _ANALYSIS_H */
@@ -0,0 +1,107 @@
+
+#include "bitset.h"
+
+BitSet* create_bitset(int nbits) {
+
+    BitSet* set = _ALLOC_T(BitSet);
+    set->nbits = nbits;
+    set->nwords = (nbits + 31) / 32;
+    set->bits = _ALLOC_ARRAY(uint32_t, set->nwords);
+    clear_bitset(set);
+
+    return set;
+}
+
+void destroy_bitset(BitSet* set) {
+
+    if(set != NULL) {
+        _FREE(set->bits);
+        _FREE(set);
+    }
+}
+
+void clear_bitset(BitSet* set) {
+
+    memset(set->bits, 0, sizeof(uint32_t) * set->nwords);
+}
+
+void set_bit(BitSet* set, int bit) {
+
+    assert(bit >= 0 && bit < set->nbits);
+    set->bits[bit >> 5] |= 1u << (bit & 31);
+}
+
+bool test_bit(BitSet* set, int bit) {
+
+    assert(bit >= 0 && bit < set->nbits);
+    return (set->bits[bit >> 5] & (1u << (bit & 31))) ? true : false;
+}
+
+/*
+ * Add all of the members of src to dest. Returns true if dest changed, which
+ * is what the fixed point loops need to know.
+ */
+bool union_bitset(BitSet* dest, BitSet* src) {
+
+    assert(dest->nwords == src->nwords);
+
+    bool changed = false;
+    for(int i = 0; i < dest->nwords; i++) {
+        uint32_t val = dest->bits[i] | src->bits[i];
+        if(val != dest->bits[i]) {
+            dest->bits[i] = val;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+bool intersects_bitset(BitSet* a, BitSet* b) {
+
+    assert(a->nwords == b->nwords);
+
+    for(int i = 0; i < a->nwords; i++)
+        if(a->bits[i] & b->bits[i])
+            return true;
+
+    return false;
+}
+
+bool equal_bitset(BitSet* a, BitSet* b) {
+
+    assert(a->nwords == b->nwords);
+
+    for(int i = 0; i < a->nwords; i++)
+        if(a->bits[i] != b->bits[i])
+            return false;
+
+    return true;
+}
+
+int count_bitset(BitSet* set) {
+
+    int count = 0;
+    for(int i = 0; i < set->nwords; i++)
+        count += __builtin_popcount(set->bits[i]);
+
+    return count;
+}
+
+/*
+ * Return the first member that is greater than or equal to bit, or -1 if
+ * there are no more. Iterate a set with:
+ *
+ * for(int b = next_bit(set, 0); b >= 0; b = next_bit(set, b + 1))
+ */
+int next_bit(BitSet* set, int bit) {
+
+    while(bit < set->nbits) {
+        uint32_t word = set->bits[bit >> 5] >> (bit & 31);
+        if(word != 0)
+            return bit + __builtin_ctz(word);
+        bit = (bit | 31) + 1;
+    }
+
+    return -1;
+}
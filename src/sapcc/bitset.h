@@ -0,0 +1,27 @@
+/*
+ * Fixed size bit sets. These are used for the FIRST and FOLLOW sets, where
+ * the members are symbol IDs from the symbol table.
+ */
+#ifndef _BITSET_H
+#define _BITSET_H
+
+#include "util.h"
+
+typedef struct {
+    uint32_t* bits;
+    int nbits;
+    int nwords;
+} BitSet;
+
+BitSet* create_bitset(int nbits);
+void destroy_bitset(BitSet* set);
+void clear_bitset(BitSet* set);
+void set_bit(BitSet* set, int bit);
+bool test_bit(BitSet* set, int bit);
+bool union_bitset(BitSet* dest, BitSet* src);
+bool intersects_bitset(BitSet* a, BitSet* b);
+bool equal_bitset(BitSet* a, BitSet* b);
+int count_bitset(BitSet* set);
+int next_bit(BitSet* set, int bit);
+
+#endif /* _BITSET_H */
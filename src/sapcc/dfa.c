@@ -0,0 +1,679 @@
+
+#include "dfa.h"
+#include "bitset.h"
+#include "errors.h"
+#include "logger.h"
+
+#define DLEVEL 20
+
+// A state of the NFA. A state either moves on a set of bytes to out, or it
+// has up to two empty moves, out and alt.
+typedef struct {
+    BitSet* chars; // the bytes that move to out, NULL for empty moves
+    int out;
+    int alt;
+    int accept;    // the rule plus 1 on the last state of a pattern
+} NfaState;
+
+// A piece of the NFA. The end is an empty state whose moves are not set.
+typedef struct {
+    int start;
+    int end;
+} Frag;
+
+static Parser* parser_state;
+
+static NfaState* nfa;
+static int nfa_len;
+static int nfa_cap;
+
+// the pattern that is being compiled
+static ScanRule* pat_rule;
+static const char* pat;
+static int pat_pos;
+static bool pat_error;
+
+static int add_state(BitSet* chars, int out, int alt) {
+
+    if(nfa_len + 1 > nfa_cap) {
+        nfa_cap <<= 1;
+        nfa = _REALLOC_ARRAY(nfa, NfaState, nfa_cap);
+    }
+
+    nfa[nfa_len].chars = chars;
+    nfa[nfa_len].out = out;
+    nfa[nfa_len].alt = alt;
+    nfa[nfa_len].accept = 0;
+
+    return nfa_len++;
+}
+
+static const char* rule_name(ScanRule* rule) {
+
+    return (rule->name != NULL) ? raw_string(rule->name) : "(skip)";
+}
+
+static void pattern_error(const char* msg) {
+
+    // one error per pattern is enough
+    if(!pat_error)
+        syntax_error("%s in the pattern of scanner rule %s: %s%s%s", msg, rule_name(pat_rule),
+                     pat_rule->literal ? "\"" : "(", pat, pat_rule->literal ? "\"" : ")");
+    pat_error = true;
+}
+
+static Frag empty_frag() {
+
+    int state = add_state(NULL, -1, -1);
+    return (Frag){ state, state };
+}
+
+static Frag chars_frag(BitSet* chars) {
+
+    int end = add_state(NULL, -1, -1);
+    return (Frag){ add_state(chars, end, -1), end };
+}
+
+static Frag char_frag(int ch) {
+
+    BitSet* chars = create_bitset(256);
+    set_bit(chars, ch);
+
+    return chars_frag(chars);
+}
+
+static Frag concat_frag(Frag first, Frag second) {
+
+    nfa[first.end].out = second.start;
+    return (Frag){ first.start, second.end };
+}
+
+/*
+ * When this is entered, the '\' has been read.
+ */
+static int read_escape() {
+
+    int ch = (unsigned char)pat[pat_pos];
+
+    if(ch == '\0') {
+        pattern_error("'\\' at the end");
+        return '\\';
+    }
+    pat_pos++;
+
+    switch(ch) {
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case '0': return '\0';
+        case 'x': {
+            int value = 0;
+            int i;
+            for(i = 0; i < 2 && isxdigit((unsigned char)pat[pat_pos]); i++, pat_pos++)
+                value = value * 16 +
+                        (isdigit((unsigned char)pat[pat_pos]) ? pat[pat_pos] - '0' :
+                                                                tolower(pat[pat_pos]) - 'a' + 10);
+            if(i == 0)
+                pattern_error("expected a hex number after '\\x'");
+            return value;
+        }
+        default: return ch;
+    }
+}
+
+static int read_char() {
+
+    int ch = (unsigned char)pat[pat_pos++];
+
+    return (ch == '\\') ? read_escape() : ch;
+}
+
+/*
+ * When this is entered, the '[' has been read. A ']' right after the '[' or
+ * the '^' is a member of the class.
+ */
+static Frag parse_class() {
+
+    BitSet* chars = create_bitset(256);
+    bool negate = false;
+
+    if(pat[pat_pos] == '^') {
+        negate = true;
+        pat_pos++;
+    }
+
+    for(bool first = true; first || pat[pat_pos] != ']'; first = false) {
+        if(pat[pat_pos] == '\0') {
+            pattern_error("unterminated character class");
+            break;
+        }
+
+        int low = read_char();
+        int high = low;
+        if(pat[pat_pos] == '-' && pat[pat_pos + 1] != ']' && pat[pat_pos + 1] != '\0') {
+            pat_pos++;
+            high = read_char();
+            if(high < low)
+                pattern_error("the range is backwards");
+        }
+
+        for(int ch = low; ch <= high; ch++)
+            set_bit(chars, ch);
+    }
+
+    if(pat[pat_pos] == ']')
+        pat_pos++;
+
+    if(negate) {
+        BitSet* inverse = create_bitset(256);
+        for(int ch = 0; ch < 256; ch++)
+            if(!test_bit(chars, ch))
+                set_bit(inverse, ch);
+        destroy_bitset(chars);
+        chars = inverse;
+    }
+
+    return chars_frag(chars);
+}
+
+static Frag parse_alt();
+
+static Frag parse_atom() {
+
+    int ch = (unsigned char)pat[pat_pos++];
+
+    switch(ch) {
+        case '(': {
+            Frag frag = parse_alt();
+            if(pat[pat_pos] != ')')
+                pattern_error("missing ')'");
+            else
+                pat_pos++;
+            return frag;
+        }
+        case '[':
+            return parse_class();
+        case '.': {
+            // any byte but a new line
+            BitSet* chars = create_bitset(256);
+            for(int i = 0; i < 256; i++)
+                if(i != '\n')
+                    set_bit(chars, i);
+            return chars_frag(chars);
+        }
+        case '\\':
+            return char_frag(read_escape());
+        default:
+            return char_frag(ch);
+    }
+}
+
+static Frag parse_repeat() {
+
+    Frag frag = parse_atom();
+
+    while(true) {
+        int ch = pat[pat_pos];
+        if(ch == '*') {
+            int end = add_state(NULL, -1, -1);
+            nfa[frag.end].out = frag.start;
+            nfa[frag.end].alt = end;
+            frag = (Frag){ add_state(NULL, frag.start, end), end };
+        }
+        else if(ch == '+') {
+            int end = add_state(NULL, -1, -1);
+            nfa[frag.end].out = frag.start;
+            nfa[frag.end].alt = end;
+            frag.end = end;
+        }
+        else if(ch == '?') {
+            int end = add_state(NULL, -1, -1);
+            nfa[frag.end].out = end;
+            frag = (Frag){ add_state(NULL, frag.start, end), end };
+        }
+        else
+            break;
+
+        pat_pos++;
+    }
+
+    return frag;
+}
+
+static bool concat_end() {
+
+    return pat[pat_pos] == '\0' || pat[pat_pos] == '|' || pat[pat_pos] == ')';
+}
+
+static Frag parse_concat() {
+
+    if(concat_end())
+        return empty_frag();
+
+    Frag frag = parse_repeat();
+    while(!concat_end() && !pat_error)
+        frag = concat_frag(frag, parse_repeat());
+
+    return frag;
+}
+
+static Frag parse_alt() {
+
+    Frag frag = parse_concat();
+
+    while(pat[pat_pos] == '|' && !pat_error) {
+        pat_pos++;
+        Frag other = parse_concat();
+        int end = add_state(NULL, -1, -1);
+        nfa[frag.end].out = end;
+        nfa[other.end].out = end;
+        frag = (Frag){ add_state(NULL, frag.start, other.start), end };
+    }
+
+    return frag;
+}
+
+static Frag compile_pattern(ScanRule* rule) {
+
+    pat_rule = rule;
+    pat = raw_string(rule->pattern);
+    pat_pos = 0;
+    pat_error = false;
+
+    Frag frag;
+    if(rule->literal) {
+        frag = empty_frag();
+        while(pat[pat_pos] != '\0')
+            frag = concat_frag(frag, char_frag(read_char()));
+    }
+    else {
+        frag = parse_alt();
+        if(pat[pat_pos] != '\0')
+            pattern_error("unexpected ')'");
+    }
+
+    return frag;
+}
+
+/*
+ * Add every state that can be reached with empty moves.
+ */
+static void closure(BitSet* set, int* stack) {
+
+    int top = 0;
+
+    for(int s = next_bit(set, 0); s >= 0; s = next_bit(set, s + 1))
+        stack[top++] = s;
+
+    while(top > 0) {
+        NfaState* state = &nfa[stack[--top]];
+        if(state->chars != NULL)
+            continue;
+
+        if(state->out >= 0 && !test_bit(set, state->out)) {
+            set_bit(set, state->out);
+            stack[top++] = state->out;
+        }
+        if(state->alt >= 0 && !test_bit(set, state->alt)) {
+            set_bit(set, state->alt);
+            stack[top++] = state->alt;
+        }
+    }
+}
+
+/*
+ * Split the bytes into classes. Every byte set in the NFA splits the
+ * classes into the bytes that are in it and the ones that are not.
+ */
+static int byte_classes(uint8_t* byte_class) {
+
+    int num = 1;
+    int map[512];
+
+    memset(byte_class, 0, 256);
+
+    for(int s = 0; s < nfa_len; s++) {
+        if(nfa[s].chars == NULL)
+            continue;
+
+        for(int i = 0; i < num * 2; i++)
+            map[i] = -1;
+
+        int count = 0;
+        for(int ch = 0; ch < 256; ch++) {
+            int key = byte_class[ch] * 2 + (test_bit(nfa[s].chars, ch) ? 1 : 0);
+            if(map[key] < 0)
+                map[key] = count++;
+            byte_class[ch] = map[key];
+        }
+        num = count;
+    }
+
+    return num;
+}
+
+/*
+ * The sets of NFA states that make the DFA states, with a hash table to
+ * find them.
+ */
+typedef struct {
+    BitSet** list;
+    int len;
+    int cap;
+    int* buckets; // index plus 1, or 0
+    int nbuckets;
+} StateSets;
+
+static uint32_t hash_set(BitSet* set) {
+
+    uint32_t hash = 2166136261u;
+
+    for(int i = 0; i < set->nwords; i++) {
+        hash ^= set->bits[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static int find_bucket(StateSets* sets, BitSet* set) {
+
+    int mask = sets->nbuckets - 1;
+    int slot = (int)(hash_set(set) & (uint32_t)mask);
+
+    while(sets->buckets[slot] != 0 && !equal_bitset(sets->list[sets->buckets[slot] - 1], set))
+        slot = (slot + 1) & mask;
+
+    return slot;
+}
+
+static void grow_buckets(StateSets* sets) {
+
+    _FREE(sets->buckets);
+    sets->nbuckets <<= 1;
+    sets->buckets = _ALLOC_ARRAY(int, sets->nbuckets);
+    memset(sets->buckets, 0, sizeof(int) * sets->nbuckets);
+
+    for(int i = 0; i < sets->len; i++)
+        sets->buckets[find_bucket(sets, sets->list[i])] = i + 1;
+}
+
+/*
+ * Return the DFA state of the set. A new set is copied.
+ */
+static int intern_set(StateSets* sets, BitSet* set) {
+
+    int slot = find_bucket(sets, set);
+    if(sets->buckets[slot] != 0)
+        return sets->buckets[slot] - 1;
+
+    if(sets->len + 1 > sets->cap) {
+        sets->cap <<= 1;
+        sets->list = _REALLOC_ARRAY(sets->list, BitSet*, sets->cap);
+    }
+
+    BitSet* copy = create_bitset(nfa_len);
+    union_bitset(copy, set);
+    sets->list[sets->len] = copy;
+    sets->buckets[slot] = ++sets->len;
+
+    if(sets->len * 2 > sets->nbuckets)
+        grow_buckets(sets);
+
+    return sets->len - 1;
+}
+
+/*
+ * Subset construction. State 0 is the empty set, which is the dead state,
+ * and state 1 is the start. Returns the number of states. The transitions
+ * and the accepted rules are returned in next and accept.
+ */
+static int build_states(BitSet* start, int num_classes, uint8_t* byte_class,
+                        int** next_out, int** accept_out) {
+
+    StateSets sets;
+    sets.cap = 64;
+    sets.len = 0;
+    sets.list = _ALLOC_ARRAY(BitSet*, sets.cap);
+    sets.nbuckets = 128;
+    sets.buckets = _ALLOC_ARRAY(int, sets.nbuckets);
+    memset(sets.buckets, 0, sizeof(int) * sets.nbuckets);
+
+    int* stack = _ALLOC_ARRAY(int, nfa_len);
+    BitSet* move = create_bitset(nfa_len);
+
+    // one byte of every class
+    int rep[256];
+    for(int ch = 255; ch >= 0; ch--)
+        rep[byte_class[ch]] = ch;
+
+    intern_set(&sets, move);
+    closure(start, stack);
+    intern_set(&sets, start);
+
+    int cap = 64;
+    int* next = _ALLOC_ARRAY(int, cap * num_classes);
+    int* accept = _ALLOC_ARRAY(int, cap);
+
+    for(int d = 0; d < sets.len; d++) {
+        if(sets.len > cap) {
+            cap = sets.cap;
+            next = _REALLOC_ARRAY(next, int, cap * num_classes);
+            accept = _REALLOC_ARRAY(accept, int, cap);
+        }
+
+        // the first rule wins when more than one accepts
+        accept[d] = 0;
+        for(int s = next_bit(sets.list[d], 0); s >= 0; s = next_bit(sets.list[d], s + 1))
+            if(nfa[s].accept != 0 && (accept[d] == 0 || nfa[s].accept < accept[d]))
+                accept[d] = nfa[s].accept;
+
+        for(int c = 0; c < num_classes; c++) {
+            clear_bitset(move);
+            for(int s = next_bit(sets.list[d], 0); s >= 0; s = next_bit(sets.list[d], s + 1))
+                if(nfa[s].chars != NULL && test_bit(nfa[s].chars, rep[c]))
+                    set_bit(move, nfa[s].out);
+            closure(move, stack);
+            next[d * num_classes + c] = intern_set(&sets, move);
+        }
+    }
+
+    int num = sets.len;
+    for(int i = 0; i < sets.len; i++)
+        destroy_bitset(sets.list[i]);
+    _FREE(sets.list);
+    _FREE(sets.buckets);
+    _FREE(stack);
+    destroy_bitset(move);
+
+    *next_out = next;
+    *accept_out = accept;
+    return num;
+}
+
+/*
+ * Moore's algorithm. The states start out in blocks by the rule that they
+ * accept and the blocks are split until every state in a block moves to
+ * the same blocks. The blocks are numbered in the order of their first
+ * state, so the dead state stays 0 and the start stays 1.
+ */
+static int minimize(int num, int num_classes, int* next, int* accept, int* block) {
+
+    int* new_block = _ALLOC_ARRAY(int, num);
+    int* first = _ALLOC_ARRAY(int, num); // the first state of every block
+    int num_blocks = 0;
+
+    // the first partition is by the accepted rule
+    for(int s = 0; s < num; s++) {
+        int b;
+        for(b = 0; b < num_blocks; b++)
+            if(accept[first[b]] == accept[s])
+                break;
+        if(b == num_blocks)
+            first[num_blocks++] = s;
+        block[s] = b;
+    }
+
+    while(true) {
+        int count = 0;
+        for(int s = 0; s < num; s++) {
+            int b;
+            for(b = 0; b < count; b++) {
+                int r = first[b];
+                if(block[r] != block[s])
+                    continue;
+
+                int c;
+                for(c = 0; c < num_classes; c++)
+                    if(block[next[r * num_classes + c]] != block[next[s * num_classes + c]])
+                        break;
+                if(c == num_classes)
+                    break;
+            }
+            if(b == count)
+                first[count++] = s;
+            new_block[s] = b;
+        }
+
+        memcpy(block, new_block, sizeof(int) * num);
+        if(count == num_blocks)
+            break;
+        num_blocks = count;
+    }
+
+    _FREE(new_block);
+    _FREE(first);
+
+    return num_blocks;
+}
+
+/*
+ * Every scanner rule must name a terminal, and every terminal should have
+ * a scanner rule.
+ */
+static void check_scan_rules() {
+
+    ScanRule* rule;
+    ScanRuleListIter* srli = init_list_iterator(parser_state->scan_rules);
+    while(iterate_list(srli, &rule)) {
+        if(rule->name == NULL)
+            continue;
+
+        Symbol* sym = find_symbol(parser_state->symbols, raw_string(rule->name));
+        if(sym == NULL || sym->term == NULL)
+            syntax_error("%s in %%scanner is not a terminal", raw_string(rule->name));
+        else
+            rule->term = sym->id;
+    }
+
+    Terminal* term;
+    TermListIter* tli = init_list_iterator(parser_state->terminals);
+    while(iterate_list(tli, &term)) {
+        srli = init_list_iterator(parser_state->scan_rules);
+        while(iterate_list(srli, &rule))
+            if(rule->term == term->id)
+                break;
+        if(rule == NULL || rule->term != term->id)
+            warning("terminal %s has no scanner rule", raw_string(term->name));
+    }
+}
+
+/*
+ * Public Interface
+ */
+Dfa* create_dfa(Parser* pstate) {
+
+    LOG(DLEVEL, "ENTER: create dfa");
+
+    parser_state = pstate;
+    check_scan_rules();
+
+    nfa_cap = 64;
+    nfa_len = 0;
+    nfa = _ALLOC_ARRAY(NfaState, nfa_cap);
+
+    // the start set is the start of every pattern
+    int num_rules = length_list(pstate->scan_rules);
+    int* starts = _ALLOC_ARRAY(int, num_rules);
+    int idx = 0;
+    ScanRule* rule;
+    ScanRuleListIter* srli = init_list_iterator(pstate->scan_rules);
+    while(iterate_list(srli, &rule)) {
+        Frag frag = compile_pattern(rule);
+        nfa[frag.end].accept = idx + 1;
+        starts[idx++] = frag.start;
+    }
+
+    Dfa* dfa = NULL;
+    if(!get_errors()) {
+        BitSet* start = create_bitset(nfa_len);
+        for(int i = 0; i < num_rules; i++)
+            set_bit(start, starts[i]);
+
+        dfa = _ALLOC_T(Dfa);
+        dfa->num_classes = byte_classes(dfa->byte_class);
+
+        int* next;
+        int* accept;
+        int num = build_states(start, dfa->num_classes, dfa->byte_class, &next, &accept);
+        int* block = _ALLOC_ARRAY(int, num);
+        dfa->num_states = minimize(num, dfa->num_classes, next, accept, block);
+        LOG(DLEVEL, "dfa: %d nfa states, %d dfa states, %d minimized, %d byte classes",
+            nfa_len, num, dfa->num_states, dfa->num_classes);
+
+        dfa->next = _ALLOC_ARRAY(int, dfa->num_states * dfa->num_classes);
+        dfa->accept = _ALLOC_ARRAY(int, dfa->num_states);
+        for(int s = 0; s < num; s++) {
+            for(int c = 0; c < dfa->num_classes; c++)
+                dfa->next[block[s] * dfa->num_classes + c] = block[next[s * dfa->num_classes + c]];
+            dfa->accept[block[s]] = accept[s];
+        }
+
+        if(dfa->accept[1] != 0) {
+            srli = init_list_iterator(pstate->scan_rules);
+            for(int i = 0; iterate_list(srli, &rule) && i < dfa->accept[1] - 1; i++)
+                ;
+            syntax_error("the pattern of scanner rule %s matches an empty string",
+                         rule_name(rule));
+        }
+
+        // a rule that no state accepts is hidden by the rules before it
+        idx = 0;
+        srli = init_list_iterator(pstate->scan_rules);
+        while(iterate_list(srli, &rule)) {
+            idx++;
+            int s;
+            for(s = 0; s < dfa->num_states; s++)
+                if(dfa->accept[s] == idx)
+                    break;
+            if(s == dfa->num_states)
+                warning("scanner rule %s is never matched, the rules before it match the same text",
+                        rule_name(rule));
+        }
+
+        _FREE(next);
+        _FREE(accept);
+        _FREE(block);
+        destroy_bitset(start);
+    }
+
+    for(int i = 0; i < nfa_len; i++)
+        if(nfa[i].chars != NULL)
+            destroy_bitset(nfa[i].chars);
+    _FREE(nfa);
+    _FREE(starts);
+
+    LOG(DLEVEL, "LEAVE: create dfa");
+    return dfa;
+}
+
+void destroy_dfa(Dfa* dfa) {
+
+    if(dfa != NULL) {
+        _FREE(dfa->next);
+        _FREE(dfa->accept);
+        _FREE(dfa);
+    }
+}
@@ -0,0 +1,26 @@
+/*
+ * Scanner generator. The patterns of the %scanner rules are compiled into
+ * one NFA, which is turned into a DFA and minimized. The bytes of the input
+ * are mapped to classes first. Bytes that no pattern tells apart share a
+ * class, so a state has one transition per class instead of one per byte.
+ * The generated scanner runs the DFA over the input once per token and
+ * takes the longest match. When two rules match the same text, the first
+ * one wins.
+ */
+#ifndef _DFA_H
+#define _DFA_H
+
+#include "parser.h"
+
+typedef struct _dfa_ {
+    int num_states;          // state 0 is the dead state, 1 is the start
+    int num_classes;
+    uint8_t byte_class[256];
+    int* next;               // num_states rows of num_classes states
+    int* accept;             // the rule that a state accepts plus 1, or 0
+} Dfa;
+
+Dfa* create_dfa(Parser* pstate);
+void destroy_dfa(Dfa* dfa);
+
+#endif /* _DFA_H */
@@ -0,0 +1,705 @@
+
+#include "emit_direct.h"
+#include "analysis.h"
+#include "factor.h"
+#include "precedence.h"
+#include "logger.h"
+
+#define DLEVEL 10
+
+static Parser* parser_state;
+// "COLD_RULE " for the functions of a non-terminal that the profile marks cold
+static const char* rule_attr = "";
+
+static const char* sym_name(int id) {
+
+    return raw_string(get_symbol_by_id(parser_state->symbols, id)->name);
+}
+
+static void emit_line_comment(FILE* fp, NonTerminal* nterm, Rule* rule) {
+
+    fprintf(fp, "// %s :", raw_string(nterm->name));
+    for(int i = 0; i < rule->len; i++)
+        fprintf(fp, " %s", sym_name(rule->list[i]));
+    fprintf(fp, "\n");
+}
+
+/*
+ * One function per rule line. The items are matched in order and the first
+ * one that fails hands back what was matched so far, or recovers from the
+ * error when the line is final. The tails skip the leading recursive symbol,
+ * which is passed in as first.
+ */
+static void emit_line(FILE* fp, NonTerminal* nterm, Rule* rule, const char* kind, int num, int skip) {
+
+    const char* name = raw_string(nterm->name);
+
+    emit_line_comment(fp, nterm, rule);
+    fprintf(fp, "static %sAst* %s_%s_%d(ParserContext* ctx, Ast* first, bool final) {\n\n", rule_attr, name, kind, num);
+    fprintf(fp, "    Ast* ast = create_node(ctx, _nterm_%s, %d, %d, first);\n\n", name, rule->alt, rule->len);
+
+    for(int i = skip; i < rule->len; i++) {
+        Symbol* sym = get_symbol_by_id(parser_state->symbols, rule->list[i]);
+        fprintf(fp, "%s", (i == skip) ? "    if(" : " &&\n       ");
+        if(sym->term != NULL)
+            fprintf(fp, "match_token(ctx, ast, _TOK_%s, final)", raw_string(sym->name));
+        else
+            fprintf(fp, "match_child(ast, parse_%s(ctx, final))", raw_string(sym->name));
+    }
+    fprintf(fp, ")\n        return ast;\n\n");
+
+    fprintf(fp, "    return fail_line(ctx, ast, first, final);\n");
+    fprintf(fp, "}\n\n");
+}
+
+typedef struct {
+    const char* name;   // the non-terminal
+    const char* kind;   // "line" or "tail"
+    Rule** rules;       // the lines by index
+    int count;          // node functions so far
+    bool hot;           // a profile put the hot branch first
+} TreeGen;
+
+/*
+ * A line that ends at the node or below it.
+ */
+static int tree_line(Factor* node) {
+
+    while(node->end == 0)
+        node = node->next[0];
+
+    return node->end - 1;
+}
+
+static void emit_entry(FILE* fp, int id) {
+
+    Symbol* sym = get_symbol_by_id(parser_state->symbols, id);
+
+    if(sym->term != NULL)
+        fprintf(fp, "token_entry(ctx, _TOK_%s)", raw_string(sym->name));
+    else
+        fprintf(fp, "child_entry(ctx, parse_%s(ctx, false))", raw_string(sym->name));
+}
+
+/*
+ * Match the rest of every line that ends below the node again, starting at
+ * the entry depth. This is used when the longest line was not the last
+ * branch that was tried. The entries of a line are at the same index as its
+ * symbols, the tails have the left recursive tree in place of their leading
+ * symbol.
+ */
+static void emit_rematch(FILE* fp, TreeGen* gen, Factor* node, int depth) {
+
+    if(node->end != 0) {
+        Rule* rule = gen->rules[node->end - 1];
+        fprintf(fp, "            case %d:\n", node->end - 1);
+        for(int i = depth; i < rule->len; i++) {
+            fprintf(fp, "                path[%d] = ", i);
+            emit_entry(fp, rule->list[i]);
+            fprintf(fp, ";\n");
+        }
+        fprintf(fp, "                break;\n");
+    }
+
+    for(int i = 0; i < node->num; i++)
+        emit_rematch(fp, gen, node->next[i], depth);
+}
+
+/*
+ * One function per node of the factored tree, the same as match_tree() in
+ * the table parser but with the branches written out. The entries before
+ * the node are in path[0..depth), and a branch that fails is counted in
+ * far when it is not NULL. Returns the number of the function.
+ */
+static int emit_tree_node(FILE* fp, TreeGen* gen, Factor* node, int depth) {
+
+    int* ids = _ALLOC_ARRAY(int, node->num + 1);
+    for(int i = 0; i < node->num; i++)
+        ids[i] = emit_tree_node(fp, gen, node->next[i], depth + 1);
+
+    int id = gen->count++;
+    fprintf(fp, "static %sint %s_%s_node_%d(ParserContext* ctx, AstEntry** path, int start, int* len, FarLine* far) {\n\n",
+            rule_attr, gen->name, gen->kind, id);
+
+    if(node->num == 0) {
+        fprintf(fp, "    (void)path;\n");
+        fprintf(fp, "    (void)far;\n");
+        fprintf(fp, "    *len = ctx->tok_pos - start;\n");
+        fprintf(fp, "    return %d;\n", node->end - 1);
+        fprintf(fp, "}\n\n");
+        _FREE(ids);
+        return id;
+    }
+
+    if(node->end != 0) {
+        fprintf(fp, "    int best = %d;\n", node->end - 1);
+        fprintf(fp, "    int best_len = ctx->tok_pos - start;\n");
+    }
+    else {
+        fprintf(fp, "    int best = -1;\n");
+        fprintf(fp, "    int best_len = -1;\n");
+    }
+    if(node->num > 1)
+        fprintf(fp, "    bool kept = true;\n");
+    fprintf(fp, "    int sub, sub_len, outer;\n");
+
+    for(int i = 0; i < node->num; i++) {
+        bool last = (i == node->num - 1);
+
+        fprintf(fp, "\n    outer = far_enter(ctx);\n");
+        fprintf(fp, "    if((path[%d] = ", depth);
+        emit_entry(fp, node->next[i]->sym);
+        fprintf(fp, ") != NULL) {\n");
+        fprintf(fp, "        far_leave(ctx, outer);\n");
+        fprintf(fp, "        sub = %s_%s_node_%d(ctx, path, start, &sub_len, far);\n", gen->name, gen->kind, ids[i]);
+        fprintf(fp, "        if(sub >= 0 && (sub_len > best_len || (sub_len == best_len && sub < best))) {\n");
+        if(gen->hot && i == 0 && !last) {
+            // the hot branch, when the rule can end after it
+            fprintf(fp, "            if(!in_set(more_set[_nterm_%s - BASE_NTERM], peek_token(ctx)->type)) {\n", gen->name);
+            fprintf(fp, "                *len = sub_len;\n");
+            fprintf(fp, "                return sub;\n");
+            fprintf(fp, "            }\n");
+        }
+        if(last) {
+            fprintf(fp, "            *len = sub_len;\n");
+            fprintf(fp, "            return sub;\n");
+        }
+        else {
+            fprintf(fp, "            best = sub;\n");
+            fprintf(fp, "            best_len = sub_len;\n");
+            fprintf(fp, "            kept = false;\n");
+        }
+        fprintf(fp, "        }\n");
+        fprintf(fp, "        unmatch_entries(ctx, path, %d, (sub >= 0)? %s_%s_lens[sub]: %d);\n",
+                depth, gen->name, gen->kind, depth + 1);
+        fprintf(fp, "    }\n");
+        fprintf(fp, "    else {\n");
+        fprintf(fp, "        if(far != NULL)\n");
+        fprintf(fp, "            line_failed(ctx, far, %d);\n", tree_line(node->next[i]));
+        fprintf(fp, "        far_leave(ctx, outer);\n");
+        fprintf(fp, "    }\n");
+    }
+
+    if(node->num > 1) {
+        fprintf(fp, "\n    if(best >= 0 && !kept) {\n");
+        fprintf(fp, "        switch(best) {\n");
+        for(int i = 0; i < node->num - 1; i++)
+            emit_rematch(fp, gen, node->next[i], depth);
+        fprintf(fp, "        }\n");
+        fprintf(fp, "    }\n");
+    }
+
+    fprintf(fp, "\n    *len = best_len;\n");
+    fprintf(fp, "    return best;\n");
+    fprintf(fp, "}\n\n");
+
+    _FREE(ids);
+    return id;
+}
+
+/*
+ * The factored tree of the lines, for the lookahead tokens that more than
+ * one line can start with. For the tails, first is the left recursive tree
+ * so far and the tree starts after it. When it is final and the tree fails,
+ * or the line that it matched stops at a token that cannot come after the
+ * non-terminal, the line that went the furthest is matched again as final,
+ * the same as match_body() in the table parser. The tree is only called for
+ * a token that the lines can start with.
+ */
+static void emit_tree(FILE* fp, NonTerminal* nterm, RuleList* list, Factor* tree,
+                      const char* kind, int skip) {
+
+    TreeGen gen;
+    gen.name = raw_string(nterm->name);
+    gen.kind = kind;
+    gen.count = 0;
+    gen.hot = nterm->profiled;
+    gen.rules = _ALLOC_ARRAY(Rule*, length_list(list) + 1);
+
+    int max = 0;
+    int num = 0;
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(list);
+    while(iterate_list(rli, &rule)) {
+        gen.rules[num++] = rule;
+        if(rule->len > max)
+            max = rule->len;
+    }
+
+    fprintf(fp, "static const int %s_%s_lens[] = {", gen.name, kind);
+    for(int i = 0; i < num; i++)
+        fprintf(fp, " %d,", gen.rules[i]->len);
+    fprintf(fp, " };\n\n");
+
+    fprintf(fp, "static const uint16_t %s_%s_alts[] = {", gen.name, kind);
+    for(int i = 0; i < num; i++)
+        fprintf(fp, " %d,", gen.rules[i]->alt);
+    fprintf(fp, " };\n\n");
+
+    int root = emit_tree_node(fp, &gen, tree, skip);
+
+    fprintf(fp, "static %sAst* %s_%s_tree(ParserContext* ctx, Ast* first, bool final) {\n\n", rule_attr, gen.name, kind);
+    fprintf(fp, "    AstEntry* path[%d];\n", max);
+    fprintf(fp, "    FarLine far = { -1, -1 };\n");
+    fprintf(fp, "    int len;\n\n");
+    if(skip > 0)
+        fprintf(fp, "    path[0] = create_ast_entry(ctx, AST_NTERM, first);\n");
+    fprintf(fp, "    int best = %s_%s_node_%d(ctx, path, ctx->tok_pos, &len, final? &far: NULL);\n", gen.name, kind, root);
+    fprintf(fp, "    if(best < 0 && !final)\n");
+    fprintf(fp, "        return NULL;\n\n");
+    fprintf(fp, "    Ast* ast = NULL;\n");
+    fprintf(fp, "    if(best >= 0) {\n");
+    fprintf(fp, "        ast = build_node(ctx, _nterm_%s, %s_%s_alts[best], path, %s_%s_lens[best]);\n",
+            gen.name, gen.name, kind, gen.name, kind);
+    fprintf(fp, "        if(!final || !stops_early(ctx, _nterm_%s))\n", gen.name);
+    fprintf(fp, "            return ast;\n");
+    fprintf(fp, "        line_matched(ctx, &far, best);\n");
+    fprintf(fp, "        unmatch_from(ctx, ast, %d);\n", skip);
+    fprintf(fp, "    }\n\n");
+    fprintf(fp, "    switch(far.line) {\n");
+    for(int i = 0; i < num; i++) {
+        fprintf(fp, "    case %d:\n", i);
+        fprintf(fp, "        return %s_%s_%d(ctx, first, true);\n", gen.name, kind, i + 1);
+    }
+    fprintf(fp, "    }\n\n");
+    fprintf(fp, "    return NULL;\n");
+    fprintf(fp, "}\n\n");
+
+    _FREE(gen.rules);
+}
+
+/*
+ * Build the set of lines that each terminal can start. A line is in the set
+ * of every terminal in the FIRST set of its symbols after the skipped ones.
+ * The sets are indexed by the position of the terminal in the terminal list.
+ */
+static BitSet** line_sets(RuleList* list, int skip) {
+
+    int num_terms = get_num_term();
+    int num_lines = length_list(list);
+    BitSet** sets = _ALLOC_ARRAY(BitSet*, num_terms);
+    BitSet* first = create_bitset(get_end_bit() + 1);
+
+    for(int i = 0; i < num_terms; i++)
+        sets[i] = create_bitset(num_lines);
+
+    int line = 0;
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(list);
+    while(iterate_list(rli, &rule)) {
+        clear_bitset(first);
+        first_of_string(first, &rule->list[skip], rule->len - skip);
+
+        int col = 0;
+        Terminal* term;
+        TermListIter* tli = init_list_iterator(parser_state->terminals);
+        while(iterate_list(tli, &term)) {
+            if(test_bit(first, term->id))
+                set_bit(sets[col], line);
+            col++;
+        }
+        line++;
+    }
+
+    destroy_bitset(first);
+    return sets;
+}
+
+/*
+ * The factored tree is only called for a terminal that selects more than
+ * one line.
+ */
+static bool uses_tree(RuleList* list, int skip) {
+
+    int num_terms = get_num_term();
+    BitSet** sets = line_sets(list, skip);
+    bool used = false;
+
+    for(int i = 0; i < num_terms; i++) {
+        if(count_bitset(sets[i]) > 1)
+            used = true;
+        destroy_bitset(sets[i]);
+    }
+    _FREE(sets);
+
+    return used;
+}
+
+/*
+ * The switch on the lookahead token. Terminals that select the same lines
+ * share a case. One line is called directly, more than one is matched with
+ * the factored tree.
+ */
+static void emit_switch(FILE* fp, NonTerminal* nterm, RuleList* list, int skip,
+                        const char* kind, const char* target, const char* first,
+                        const char* final, const char* indent) {
+
+    const char* name = raw_string(nterm->name);
+    int num_terms = get_num_term();
+    BitSet** sets = line_sets(list, skip);
+    bool* done = _ALLOC_ARRAY(bool, num_terms);
+    memset(done, 0, sizeof(bool) * num_terms);
+
+    Terminal** terms = _ALLOC_ARRAY(Terminal*, num_terms);
+    int idx = 0;
+    Terminal* term;
+    TermListIter* tli = init_list_iterator(parser_state->terminals);
+    while(iterate_list(tli, &term))
+        terms[idx++] = term;
+
+    for(int i = 0; i < num_terms; i++) {
+        if(done[i] || count_bitset(sets[i]) == 0)
+            continue;
+
+        for(int j = i; j < num_terms; j++) {
+            if(!done[j] && equal_bitset(sets[i], sets[j])) {
+                fprintf(fp, "%s    case _TOK_%s:\n", indent, raw_string(terms[j]->name));
+                done[j] = true;
+            }
+        }
+
+        int count = count_bitset(sets[i]);
+        if(count == 1) {
+            fprintf(fp, "%s        %s = %s_%s_%d(ctx, %s, %s);\n", indent, target, name, kind,
+                    next_bit(sets[i], 0) + 1, first, final);
+            fprintf(fp, "%s        break;\n", indent);
+        }
+        else {
+            fprintf(fp, "%s        %s = %s_%s_tree(ctx, %s, %s);\n", indent, target, name, kind, first, final);
+            fprintf(fp, "%s        break;\n", indent);
+        }
+    }
+
+    fprintf(fp, "%s    default:\n", indent);
+    fprintf(fp, "%s        %s = NULL;\n", indent, target);
+    fprintf(fp, "%s        break;\n", indent);
+
+    for(int i = 0; i < num_terms; i++)
+        destroy_bitset(sets[i]);
+    _FREE(sets);
+    _FREE(done);
+    _FREE(terms);
+}
+
+/*
+ * The loop stops when no tail matches. If it stops at a token that cannot
+ * come after the list and it is final, a single tail is matched again as
+ * final to find the error in it, and the tree of more than one matches the
+ * tail that went the furthest again, the same as match_tails() in the table
+ * parser.
+ */
+static void emit_tails(FILE* fp, NonTerminal* nterm) {
+
+    const char* name = raw_string(nterm->name);
+
+    fprintf(fp, "// Match the left recursive lines of %s in a loop.\n", name);
+    fprintf(fp, "static %sAst* tails_%s(ParserContext* ctx, Ast* ast, bool final) {\n\n", rule_attr, name);
+    fprintf(fp, "    while(true) {\n");
+    fprintf(fp, "        Ast* next;\n\n");
+    fprintf(fp, "        switch(peek_token(ctx)->type) {\n");
+    emit_switch(fp, nterm, nterm->tails, 1, "tail", "next", "ast", "false", "        ");
+    fprintf(fp, "        }\n\n");
+    fprintf(fp, "        if(next == NULL) {\n");
+    fprintf(fp, "            Token* tok = peek_token(ctx);\n");
+    fprintf(fp, "            if(!final || !in_set(more_set[_nterm_%s - BASE_NTERM], tok->type))\n", name);
+    fprintf(fp, "                return ast;\n");
+    if(length_list(nterm->tails) == 1)
+        fprintf(fp, "            next = %s_tail_1(ctx, ast, true);\n", name);
+    else
+        fprintf(fp, "            next = %s_tail_tree(ctx, ast, true);\n", name);
+    fprintf(fp, "        }\n");
+    fprintf(fp, "        ast = next;\n");
+    fprintf(fp, "    }\n");
+    fprintf(fp, "}\n\n");
+}
+
+static void emit_operand(FILE* fp, int id, const char* final) {
+
+    Symbol* sym = get_symbol_by_id(parser_state->symbols, id);
+
+    // a terminal that is not there is reported by the caller
+    if(sym->term != NULL)
+        fprintf(fp, "token_entry(ctx, _TOK_%s)", raw_string(sym->name));
+    else
+        fprintf(fp, "child_entry(ctx, parse_%s(ctx, %s))", raw_string(sym->name), final);
+}
+
+/*
+ * The operand after an operator of the chain, which is the level next, or
+ * the operand of the chain after the last level. When a terminal operand
+ * fails as final, the node gets the operator and the input that is skipped
+ * after it, and the loop goes on.
+ */
+static void emit_climb_operand(FILE* fp, OperChain* chain, bool final, const char* indent) {
+
+    Symbol* sym = get_symbol_by_id(parser_state->symbols, chain->operand);
+
+    fprintf(fp, "%sswitch(next) {\n", indent);
+    for(int i = 0; i < chain->num; i++) {
+        fprintf(fp, "%scase %d:\n", indent, i);
+        fprintf(fp, "%s    path[2] = child_entry(ctx, parse_%s(ctx, %s));\n", indent,
+                raw_string(chain->levels[i]->name), final ? "true" : "false");
+        fprintf(fp, "%s    break;\n", indent);
+    }
+    fprintf(fp, "%sdefault:\n", indent);
+    if(final && sym->term != NULL) {
+        fprintf(fp, "%s    ast = create_ast_node(ctx, types[level], alt, 3);\n", indent);
+        fprintf(fp, "%s    add_entry(ast, path[0]);\n", indent);
+        fprintf(fp, "%s    add_entry(ast, path[1]);\n", indent);
+        fprintf(fp, "%s    match_token(ctx, ast, _TOK_%s, true);\n", indent, raw_string(sym->name));
+        fprintf(fp, "%s    path[0] = create_ast_entry(ctx, AST_NTERM, recover_line(ctx, ast));\n", indent);
+        fprintf(fp, "%s    top = level;\n", indent);
+        fprintf(fp, "%s    closed = true;\n", indent);
+        fprintf(fp, "%s    continue;\n", indent);
+    }
+    else {
+        fprintf(fp, "%s    path[2] = ", indent);
+        emit_operand(fp, chain->operand, final ? "true" : "false");
+        fprintf(fp, ";\n");
+        fprintf(fp, "%s    break;\n", indent);
+    }
+    fprintf(fp, "%s}\n", indent);
+}
+
+/*
+ * A chain of operator levels is matched by one precedence climbing loop,
+ * the same as climb() in the table parser. The switch on the token finds
+ * the level of an operator and its line, so only the operand of the chain
+ * is called for the first operand. The levels that are not called get the
+ * node of X : Y from wrap_levels().
+ */
+static void emit_climb(FILE* fp, OperChain* chain) {
+
+    const char* name = raw_string(chain->levels[0]->name);
+    int num = chain->num;
+    char final[32];
+
+    fprintf(fp, "// The operator chain");
+    for(int i = 0; i < num; i++)
+        fprintf(fp, " %s", raw_string(chain->levels[i]->name));
+    fprintf(fp, "\n");
+    fprintf(fp, "static Ast* climb_%s(ParserContext* ctx, int min, bool final) {\n\n", name);
+
+    fprintf(fp, "    static const uint16_t types[] = {");
+    for(int i = 0; i < num; i++)
+        fprintf(fp, " _nterm_%s,", raw_string(chain->levels[i]->name));
+    fprintf(fp, " };\n");
+    fprintf(fp, "    static const uint16_t bases[] = {");
+    for(int i = 0; i < num; i++)
+        fprintf(fp, " %d,", chain->levels[i]->oper->base_alt);
+    fprintf(fp, " };\n");
+    fprintf(fp, "    static const bool rights[] = {");
+    for(int i = 0; i < num; i++)
+        fprintf(fp, " %s,", chain->levels[i]->oper->right ? "true" : "false");
+    fprintf(fp, " };\n");
+    fprintf(fp, "    Token* tok = peek_token(ctx);\n");
+    fprintf(fp, "    int errs = ctx->errors;\n");
+    fprintf(fp, "    AstEntry* path[3];\n");
+    fprintf(fp, "    Ast* ast = NULL;\n");
+    fprintf(fp, "    int top = %d;\n", num);
+    fprintf(fp, "    bool closed = false;\n\n");
+
+    // an error in the first operand is reported and recovered from in the
+    // last level, where the lines find it
+    snprintf(final, sizeof(final), "final && min == %d", num - 1);
+    fprintf(fp, "    if((path[0] = ");
+    emit_operand(fp, chain->operand, final);
+    fprintf(fp, ") == NULL) {\n");
+    fprintf(fp, "        if(!final)\n");
+    fprintf(fp, "            return NULL;\n");
+    fprintf(fp, "        if(min == %d) {\n", num - 1);
+    fprintf(fp, "            if(errs == ctx->errors)\n");
+    fprintf(fp, "                expect_error(ctx, tok, types[min]);\n");
+    fprintf(fp, "            return NULL;\n");
+    fprintf(fp, "        }\n");
+    fprintf(fp, "        path[0] = child_entry(ctx, parse_%s(ctx, true));\n", raw_string(chain->levels[num - 1]->name));
+    fprintf(fp, "        ast = (Ast*)path[0]->value;\n");
+    fprintf(fp, "        top = %d;\n", num - 1);
+    fprintf(fp, "        closed = true;\n");
+    fprintf(fp, "    }\n\n");
+
+    fprintf(fp, "    while(true) {\n");
+    fprintf(fp, "        Token* op = peek_token(ctx);\n");
+    fprintf(fp, "        uint16_t alt;\n");
+    fprintf(fp, "        int level;\n\n");
+    fprintf(fp, "        switch(op->type) {\n");
+    for(int i = 0; i < num; i++) {
+        OperLevel* level = chain->levels[i]->oper;
+        for(int j = 0; j < level->num; j++) {
+            fprintf(fp, "        case _TOK_%s:\n", sym_name(level->ops[j]));
+            fprintf(fp, "            level = %d;\n", i);
+            fprintf(fp, "            alt = %d;\n", level->alts[j]);
+            fprintf(fp, "            break;\n");
+        }
+    }
+    fprintf(fp, "        default:\n");
+    fprintf(fp, "            level = -1;\n");
+    fprintf(fp, "            alt = 0;\n");
+    fprintf(fp, "            break;\n");
+    fprintf(fp, "        }\n");
+    fprintf(fp, "        if(level < min || level > top || (level == top && closed))\n");
+    fprintf(fp, "            break;\n\n");
+
+    fprintf(fp, "        int to = rights[level]? level + 1: level;\n");
+    fprintf(fp, "        ast = wrap_levels(ctx, path, ast, types, bases, top, to);\n");
+    fprintf(fp, "        top = to;\n");
+    fprintf(fp, "        path[1] = token_entry(ctx, op->type);\n\n");
+    fprintf(fp, "        int next = rights[level]? level: level + 1;\n");
+    emit_climb_operand(fp, chain, false, "        ");
+    fprintf(fp, "        if(path[2] == NULL) {\n");
+    fprintf(fp, "            if(!in_set(more_set[types[level] - BASE_NTERM], op->type)) {\n");
+    fprintf(fp, "                unmatch_entries(ctx, path, 1, 2);\n");
+    fprintf(fp, "                break;\n");
+    fprintf(fp, "            }\n");
+    fprintf(fp, "            if(!final) {\n");
+    fprintf(fp, "                unmatch_entries(ctx, path, 0, 2);\n");
+    fprintf(fp, "                return NULL;\n");
+    fprintf(fp, "            }\n");
+    emit_climb_operand(fp, chain, true, "            ");
+    fprintf(fp, "        }\n\n");
+
+    fprintf(fp, "        ast = build_node(ctx, types[level], alt, path, 3);\n");
+    fprintf(fp, "        path[0] = create_ast_entry(ctx, AST_NTERM, ast);\n");
+    fprintf(fp, "        top = level;\n");
+    fprintf(fp, "        closed = rights[level];\n");
+    fprintf(fp, "    }\n\n");
+    fprintf(fp, "    return wrap_levels(ctx, path, ast, types, bases, top, min);\n");
+    fprintf(fp, "}\n\n");
+}
+/*
+ * An operator level is matched by the loop of its chain instead of rule
+ * lines, from its place in the chain.
+ */
+static void emit_operator(FILE* fp, NonTerminal* nterm) {
+
+    const char* name = raw_string(nterm->name);
+    OperLevel* level = nterm->oper;
+
+    fprintf(fp, "// %s is a %s associative operator level\n", name, level->right ? "right" : "left");
+    fprintf(fp, "static %sAst* body_%s(ParserContext* ctx, uint16_t type, bool final) {\n\n", rule_attr, name);
+    fprintf(fp, "    (void)type;\n");
+    fprintf(fp, "    return climb_%s(ctx, %d, final);\n", raw_string(level->chain->levels[0]->name), level->index);
+    fprintf(fp, "}\n\n");
+}
+
+/*
+ * The rule lines of the non-terminal and the switch that selects them.
+ */
+static void emit_rules(FILE* fp, NonTerminal* nterm) {
+
+    const char* name = raw_string(nterm->name);
+    int num;
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(nterm->list);
+    for(num = 1; iterate_list(rli, &rule); num++)
+        emit_line(fp, nterm, rule, "line", num, 0);
+
+    rli = init_list_iterator(nterm->tails);
+    for(num = 1; iterate_list(rli, &rule); num++)
+        emit_line(fp, nterm, rule, "tail", num, 1);
+
+    if(length_list(nterm->list) > 1 && uses_tree(nterm->list, 0))
+        emit_tree(fp, nterm, nterm->list, nterm->tree, "line", 0);
+
+    // the tails match their tree again as final after the loop
+    if(length_list(nterm->tails) > 1)
+        emit_tree(fp, nterm, nterm->tails, nterm->tail_tree, "tail", 1);
+
+    if(length_list(nterm->tails) > 0)
+        emit_tails(fp, nterm);
+
+    fprintf(fp, "static %sAst* body_%s(ParserContext* ctx, uint16_t type, bool final) {\n\n", rule_attr, name);
+
+    fprintf(fp, "    Token* tok = peek_token(ctx);\n");
+    fprintf(fp, "    int errs = ctx->errors;\n");
+    fprintf(fp, "    Ast* ast;\n\n");
+    fprintf(fp, "    switch(tok->type) {\n");
+    emit_switch(fp, nterm, nterm->list, 0, "line", "ast", "NULL", "final", "");
+    fprintf(fp, "    }\n\n");
+
+    fprintf(fp, "    if(ast == NULL) {\n");
+    fprintf(fp, "        if(final && errs == ctx->errors)\n");
+    fprintf(fp, "            expect_error(ctx, tok, type);\n");
+    fprintf(fp, "        return NULL;\n");
+    fprintf(fp, "    }\n\n");
+
+    if(length_list(nterm->tails) > 0)
+        fprintf(fp, "    return tails_%s(ctx, ast, final);\n", name);
+    else
+        fprintf(fp, "    return ast;\n");
+    fprintf(fp, "}\n\n");
+}
+
+/*
+ * The function for the non-terminal calls its body. A member of an indirect
+ * left recursive cycle is grown from a seed, and the others go through
+ * match_nterm() for the memo and the rules that are kept for a reparse. The
+ * body is a constant, so the call is direct once match_nterm() is inlined.
+ * When it fails and it is final, it recovers from the error.
+ */
+static void emit_nterm(FILE* fp, NonTerminal* nterm, int slot) {
+
+    const char* name = raw_string(nterm->name);
+
+    rule_attr = nterm->cold ? "COLD_RULE " : "";
+    if(nterm->oper != NULL)
+        emit_operator(fp, nterm);
+    else
+        emit_rules(fp, nterm);
+
+    fprintf(fp, "static %sAst* parse_%s(ParserContext* ctx, bool final) {\n\n", rule_attr, name);
+    fprintf(fp, "    PROFILE_ENTER(ctx, _nterm_%s);\n", name);
+    if(nterm->lr_head)
+        fprintf(fp, "    Ast* ast = grow_seed(ctx, _nterm_%s, body_%s, final);\n", name, name);
+    else
+        fprintf(fp, "    Ast* ast = match_nterm(ctx, _nterm_%s, %d, body_%s, final);\n", name,
+                nterm->memo ? slot : -1, name);
+    fprintf(fp, "    PROFILE_LEAVE(ctx, _nterm_%s, ast);\n\n", name);
+    fprintf(fp, "    return (ast == NULL && final)? recover_start(ctx, _nterm_%s, body_%s, %s): ast;\n", name, name,
+            nterm->lr_head ? "true" : "false");
+    fprintf(fp, "}\n\n");
+}
+
+/*
+ * Public Interface
+ */
+void emit_direct_parser(FILE* fp, Parser* pstate) {
+
+    LOG(DLEVEL, "ENTER: emit direct parser");
+
+    parser_state = pstate;
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm))
+        fprintf(fp, "static %sAst* parse_%s(ParserContext* ctx, bool final);\n",
+                nterm->cold ? "COLD_RULE " : "", raw_string(nterm->name));
+    fprintf(fp, "\n");
+
+    ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm))
+        if(nterm->oper != NULL && nterm->oper->index == 0)
+            emit_climb(fp, nterm->oper->chain);
+
+    int slot = 0;
+    ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        emit_nterm(fp, nterm, slot);
+        if(nterm->memo)
+            slot++;
+    }
+
+    // the first non-terminal is the start symbol
+    ntli = init_list_iterator(pstate->non_terminals);
+    iterate_list(ntli, &nterm);
+
+    fprintf(fp, "Ast* parse(ParserContext* ctx) {\n\n");
+    fprintf(fp, "    int recovered = ctx->recovered;\n\n");
+    fprintf(fp, "    reset_matched(ctx);\n");
+    fprintf(fp, "    Ast* ast = parse_%s(ctx, true);\n\n", raw_string(nterm->name));
+    fprintf(fp, "    return finish_parse(ctx, ast, recovered);\n");
+    fprintf(fp, "}\n\n");
+
+    LOG(DLEVEL, "LEAVE: emit direct parser");
+}
@@ -0,0 +1,14 @@
+/*
+ * Direct coded parser. Instead of the parser_table and the code that reads
+ * it, every non-terminal is written as a C function that switches on the
+ * lookahead token and calls a function for each of its rule lines. Lines
+ * that can start with the same token are tried with backtracking.
+ */
+#ifndef _EMIT_DIRECT_H
+#define _EMIT_DIRECT_H
+
+#include "parser.h"
+
+void emit_direct_parser(FILE* fp, Parser* pstate);
+
+#endif /* _EMIT_DIRECT_H */
@@ -3,348 +3,2147 @@
 
 const char* errors_string =
 "\n"
-"static int errors = 0;\n"
-"static int warnings = 0;\n"
 "#include <stdarg.h>\n"
 "\n"
-"static void syntax_error(const char* fmt, ...) {\n"
+"// Start the message of a syntax error at the token and count it. Returns\n"
+"// false when the error is not reported.\n"
+"static bool error_start(ParserContext* ctx, Token* tok) {\n"
 "\n"
-"    va_list args;\n"
-"\n"
-"    if(get_line_no() > 0)\n"
-"        fprintf(stderr, \"Syntax Error: %%s:%%d:%%d \", get_fname(), get_line_no(), get_col_no());\n"
-"    else\n"
-"        fprintf(stderr, \"Syntax Error: \");\n"
+"    // nothing more is reported until a token is matched after a recovery\n"
+"    if(ctx->tok_pos == ctx->synced)\n"
+"        return false;\n"
 "\n"
-"    va_start(args, fmt);\n"
-"    vfprintf(stderr, fmt, args);\n"
-"    va_end(args);\n"
-"    fprintf(stderr, \"\\n\");\n"
+"    fprintf(stderr, \"Syntax Error: %%s:%%d:%%d \", token_fname(ctx, tok), token_line(ctx, tok), token_col(ctx, tok));\n"
+"    ctx->errors++;\n"
 "\n"
-"    errors++;\n"
+"    return true;\n"
 "}\n"
 "\n"
-"static void syntax_error_token(Token* tok, const char* fmt, ...) {\n"
+"static void syntax_error_token(ParserContext* ctx, Token* tok, const char* fmt, ...) {\n"
 "\n"
 "    va_list args;\n"
 "\n"
-"    fprintf(stderr, \"Syntax Error: %%s:%%d:%%d \", raw_string(tok->fname), tok->line_no, tok->col_no);\n"
+"    if(!error_start(ctx, tok))\n"
+"        return;\n"
 "\n"
 "    va_start(args, fmt);\n"
 "    vfprintf(stderr, fmt, args);\n"
 "    va_end(args);\n"
 "    fprintf(stderr, \"\\n\");\n"
+"}\n"
 "\n"
-"    errors++;\n"
+"int get_errors(ParserContext* ctx) {\n"
+"    return ctx->errors;\n"
 "}\n"
 "\n"
-"static void syntax_warning(const char* fmt, ...) {\n"
+"int get_wanings(ParserContext* ctx) {\n"
+"    return ctx->warnings;\n"
+"}\n"
 "\n"
-"    va_list args;\n"
+"\n";
+
+const char* data_structures_string =
 "\n"
-"    if(get_line_no() > 0)\n"
-"        fprintf(stderr, \"Warning: %%s:%%d:%%d \", get_fname(), get_line_no(), get_col_no());\n"
-"    else\n"
-"        fprintf(stderr, \"Warning: \");\n"
+"// A rule line in the parser table is its length followed by its items.\n"
+"typedef const TableEntry* RuleLine;\n"
 "\n"
-"    va_start(args, fmt);\n"
-"    vfprintf(stderr, fmt, args);\n"
-"    va_end(args);\n"
-"    fprintf(stderr, \"\\n\");\n"
+"// Where the parts of a rule are in the parser table. These are all\n"
+"// constant, so finding a rule does not allocate anything.\n"
+"typedef struct {\n"
+"    uint16_t type;               // the non-terminal value\n"
+"    uint16_t prec;               // rule precedence\n"
+"    uint16_t flags;              // RULE_* flags\n"
+"    uint16_t num_lines;          // number of rule lines\n"
+"    uint16_t num_tails;          // number of left recursive lines\n"
+"    const RuleLine* lines;       // the rule lines\n"
+"    const RuleLine* tails;       // lines that are matched in a loop\n"
+"    const uint16_t* alts;        // the grammar line of the lines, then of the tails\n"
+"    const TableEntry* tree;      // the lines, left factored\n"
+"    const TableEntry* tail_tree; // the tails, left factored\n"
+"    const uint16_t* chain;       // the operator chain that it is matched in\n"
+"    uint16_t level;              // its level in the chain\n"
+"} RuleInfo;\n"
+"\n";
+
+/*
+ * Counters for the work that every non-terminal and rule line does, when
+ * the generated code is built with USE_PROFILE. Otherwise the hooks are
+ * empty and nothing is counted.
+ */
+const char* parser_profile_string =
+"\n"
+"#ifdef USE_PROFILE\n"
+"#ifdef USE_PROFILE_TIME\n"
+"#if defined(__x86_64__) || defined(__i386__)\n"
+"#include <x86intrin.h>\n"
+"#define PROFILE_CLOCK() __rdtsc()\n"
+"#else\n"
+"#include <time.h>\n"
+"static inline uint64_t profile_clock(void) {\n"
 "\n"
-"    warnings++;\n"
+"    struct timespec ts;\n"
+"    clock_gettime(CLOCK_MONOTONIC, &ts);\n"
+"\n"
+"    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;\n"
 "}\n"
+"#define PROFILE_CLOCK() profile_clock()\n"
+"#endif\n"
+"#else\n"
+"#define PROFILE_CLOCK() 0\n"
+"#endif\n"
 "\n"
-"static void fatal_error(const char* fmt, ...) {\n"
+"// A non-terminal that calls itself is only measured at the outermost\n"
+"// call, so the tokens, the rewinds and the time are not counted twice.\n"
+"typedef struct {\n"
+"    uint64_t attempts;\n"
+"    uint64_t matched;\n"
+"    uint64_t failed;\n"
+"    uint64_t tokens;        // consumed by the matches\n"
+"    uint64_t rewound;       // handed back while the non-terminal was active\n"
+"    uint64_t time;          // with USE_PROFILE_TIME, in cycles\n"
+"    int depth;              // the most calls of it that were active at once\n"
+"    int active;\n"
+"    int start_pos;\n"
+"    uint64_t start_rewound;\n"
+"    uint64_t start_time;\n"
+"} RuleProfile;\n"
 "\n"
-"    va_list args;\n"
+"typedef struct _profile_ {\n"
+"    RuleProfile rules[NUM_NTERM];\n"
+"    uint64_t returned[NUM_NTERM][MAX_ALT + 1];  // the top node of a match\n"
+"    uint64_t discarded[NUM_NTERM][MAX_ALT + 1]; // nodes that were handed back\n"
+"    uint64_t rewound;\n"
+"    int depth;\n"
+"    int max_depth;\n"
+"} Profile;\n"
 "\n"
-"    fprintf(stderr, \"Fatal Error: \");\n"
+"static inline Profile* get_profile(ParserContext* ctx) {\n"
 "\n"
-"    va_start(args, fmt);\n"
-"    vfprintf(stderr, fmt, args);\n"
-"    va_end(args);\n"
-"    fprintf(stderr, \"\\n\");\n"
+"    if(ctx->profile == NULL) {\n"
+"        ctx->profile = _ALLOC_T(Profile);\n"
+"        memset(ctx->profile, 0, sizeof(Profile));\n"
+"    }\n"
 "\n"
-"    errors++;\n"
-"    exit(1);\n"
+"    return ctx->profile;\n"
 "}\n"
 "\n"
-"int get_errors() {\n"
-"    return errors;\n"
+"static void profile_enter(ParserContext* ctx, uint16_t type) {\n"
+"\n"
+"    Profile* prof = get_profile(ctx);\n"
+"    RuleProfile* rule = &prof->rules[type - BASE_NTERM];\n"
+"\n"
+"    rule->attempts++;\n"
+"    if(rule->active++ == 0) {\n"
+"        rule->start_pos = ctx->tok_pos;\n"
+"        rule->start_rewound = prof->rewound;\n"
+"        rule->start_time = PROFILE_CLOCK();\n"
+"    }\n"
+"    if(rule->active > rule->depth)\n"
+"        rule->depth = rule->active;\n"
+"    if(++prof->depth > prof->max_depth)\n"
+"        prof->max_depth = prof->depth;\n"
 "}\n"
 "\n"
-"int get_wanings() {\n"
-"    return warnings;\n"
+"static void profile_leave(ParserContext* ctx, uint16_t type, Ast* ast) {\n"
+"\n"
+"    Profile* prof = ctx->profile;\n"
+"    RuleProfile* rule = &prof->rules[type - BASE_NTERM];\n"
+"\n"
+"    if(ast != NULL) {\n"
+"        rule->matched++;\n"
+"        prof->returned[type - BASE_NTERM][ast->alt]++;\n"
+"    }\n"
+"    else\n"
+"        rule->failed++;\n"
+"\n"
+"    if(--rule->active == 0) {\n"
+"        if(ast != NULL)\n"
+"            rule->tokens += ctx->tok_pos - rule->start_pos;\n"
+"        rule->rewound += prof->rewound - rule->start_rewound;\n"
+"        rule->time += PROFILE_CLOCK() - rule->start_time;\n"
+"    }\n"
+"    prof->depth--;\n"
 "}\n"
 "\n"
-"\n";
-
-const char* data_structures_string =
+"#define PROFILE_ENTER(ctx, type) profile_enter((ctx), (type))\n"
+"#define PROFILE_LEAVE(ctx, type, ast) profile_leave((ctx), (type), (ast))\n"
+"#define PROFILE_REWIND(ctx) (get_profile(ctx)->rewound++)\n"
+"#define PROFILE_DISCARD(ctx, ast) (get_profile(ctx)->discarded[(ast)->type - BASE_NTERM][(ast)->alt]++)\n"
 "\n"
-"typedef struct {\n"
-"    uint16_t len;   // length of this line\n"
-"    uint16_t* line; // list of items in the line\n"
-"    int score;      // score of this cache line\n"
-"    int index;      // index of the last match\n"
-"} CacheLine;\n"
+"void reset_profile(ParserContext* ctx) {\n"
 "\n"
-"typedef struct {\n"
-"    int size;           // lines in the cache\n"
-"    CacheLine** lines;  // the actual lines\n"
-"} Cache;\n"
-"\n"
-"typedef struct _rule_ {\n"
-"    uint16_t size;       // the non-terminal value\n"
-"    uint16_t type;       // the non-terminal value\n"
-"    uint16_t prec;       // rule precedence\n"
-"    uint16_t num_lines;  // number of rule lines\n"
-"    CacheLine** list;     // list of lines in the rule\n"
-"} Rule;\n"
+"    if(ctx->profile != NULL)\n"
+"        memset(ctx->profile, 0, sizeof(Profile));\n"
+"}\n"
+"\n"
+"// The non-terminals are sorted by the time in them, or by the attempts\n"
+"// without USE_PROFILE_TIME, and each is followed by the lines that it\n"
+"// returned or handed back. As CSV, every row has all of the columns.\n"
+"void dump_profile(ParserContext* ctx, FILE* fp, bool csv) {\n"
+"\n"
+"    Profile* prof = get_profile(ctx);\n"
+"    int order[NUM_NTERM];\n"
+"\n"
+"    for(int i = 0; i < NUM_NTERM; i++) {\n"
+"        const RuleProfile* rule = &prof->rules[i];\n"
+"        uint64_t key = (rule->time != 0)? rule->time: rule->attempts;\n"
+"        int j = i;\n"
+"        for(; j > 0; j--) {\n"
+"            const RuleProfile* prev = &prof->rules[order[j - 1]];\n"
+"            if(((prev->time != 0)? prev->time: prev->attempts) >= key)\n"
+"                break;\n"
+"            order[j] = order[j - 1];\n"
+"        }\n"
+"        order[j] = i;\n"
+"    }\n"
+"\n"
+"    if(csv)\n"
+"        fprintf(fp, \"rule,alt,attempts,matched,failed,discarded,tokens,rewound,depth,time\\n\");\n"
+"    else {\n"
+"        fprintf(fp, \"tokens rewound: %%llu, deepest nesting: %%d\\n\", (unsigned long long)prof->rewound, prof->max_depth);\n"
+"        fprintf(fp, \"%%-24s %%10s %%10s %%10s %%10s %%10s %%10s %%6s %%14s\\n\", \"rule\", \"attempts\", \"matched\",\n"
+"                \"failed\", \"discarded\", \"tokens\", \"rewound\", \"depth\", \"time\");\n"
+"    }\n"
+"\n"
+"    for(int i = 0; i < NUM_NTERM; i++) {\n"
+"        int n = order[i];\n"
+"        const RuleProfile* rule = &prof->rules[n];\n"
+"        const char* name = nterm_to_str(n + BASE_NTERM);\n"
+"        if(rule->attempts == 0)\n"
+"            continue;\n"
+"\n"
+"        uint64_t discarded = 0;\n"
+"        for(int alt = 0; alt <= MAX_ALT; alt++)\n"
+"            discarded += prof->discarded[n][alt];\n"
+"\n"
+"        fprintf(fp, csv? \"%%s,,%%llu,%%llu,%%llu,%%llu,%%llu,%%llu,%%d,%%llu\\n\":\n"
+"                \"%%-24s %%10llu %%10llu %%10llu %%10llu %%10llu %%10llu %%6d %%14llu\\n\", name,\n"
+"                (unsigned long long)rule->attempts, (unsigned long long)rule->matched,\n"
+"                (unsigned long long)rule->failed, (unsigned long long)discarded,\n"
+"                (unsigned long long)rule->tokens, (unsigned long long)rule->rewound,\n"
+"                rule->depth, (unsigned long long)rule->time);\n"
+"\n"
+"        // alt 0 is a node that was made by error recovery\n"
+"        for(int alt = 0; alt <= MAX_ALT; alt++) {\n"
+"            if(prof->returned[n][alt] == 0 && prof->discarded[n][alt] == 0)\n"
+"                continue;\n"
+"            if(csv)\n"
+"                fprintf(fp, \"%%s,%%d,,%%llu,,%%llu,,,,\\n\", name, alt, (unsigned long long)prof->returned[n][alt],\n"
+"                        (unsigned long long)prof->discarded[n][alt]);\n"
+"            else\n"
+"                fprintf(fp, \"  alt %%-18d %%10s %%10llu %%10s %%10llu\\n\", alt, \"\",\n"
+"                        (unsigned long long)prof->returned[n][alt], \"\", (unsigned long long)prof->discarded[n][alt]);\n"
+"        }\n"
+"    }\n"
+"}\n"
+"#else\n"
+"#define PROFILE_ENTER(ctx, type) ((void)0)\n"
+"#define PROFILE_LEAVE(ctx, type, ast) ((void)0)\n"
+"#define PROFILE_REWIND(ctx) ((void)0)\n"
+"#define PROFILE_DISCARD(ctx, ast) ((void)0)\n"
+"#endif\n"
 "\n";
 
 /*
- * This is the code to emit for the actual parser.
+ * The parts of the parser that do not depend on how the rules are stored.
  */
-const char* parser_finder_string =
+const char* parser_common_string =
+"\n"
+"// The token at the current position. With USE_REPARSE, the furthest\n"
+"// position that the parser looked at is kept, so that a tree is only used\n"
+"// again when none of the tokens that it depends on were edited.\n"
+"static inline Token* peek_token(ParserContext* ctx) {\n"
+"\n"
+"#ifdef USE_REPARSE\n"
+"    if(ctx->tok_pos >= ctx->reach)\n"
+"        ctx->reach = ctx->tok_pos + 1;\n"
+"#endif\n"
+"    return get_token(ctx);\n"
+"}\n"
+"\n"
+"static inline bool in_set(const uint32_t* set, uint16_t type) {\n"
+"\n"
+"    int bit = type - BASE_TERM;\n"
+"    return (set[bit >> 5] & (1u << (bit & 31)))? true: false;\n"
+"}\n"
+"\n"
+"// Move past the token at the current position. The furthest position that\n"
+"// the parser got to is kept, so that after an error the line that went the\n"
+"// furthest can be found.\n"
+"static inline void next_token(ParserContext* ctx) {\n"
+"\n"
+"    consume_token(ctx);\n"
+"    if(++ctx->tok_pos > ctx->far)\n"
+"        ctx->far = ctx->tok_pos;\n"
+"}\n"
+"\n"
+"// A match counts the furthest position that it got to by itself, and when\n"
+"// it is done, the match around it got that far too.\n"
+"static inline int far_enter(ParserContext* ctx) {\n"
+"\n"
+"    int outer = ctx->far;\n"
+"    ctx->far = ctx->tok_pos;\n"
+"\n"
+"    return outer;\n"
+"}\n"
+"\n"
+"static inline int far_leave(ParserContext* ctx, int outer) {\n"
+"\n"
+"    int far = ctx->far;\n"
+"    if(outer > far)\n"
+"        ctx->far = outer;\n"
+"\n"
+"    return far;\n"
+"}\n"
+"\n"
+"// What was matched for one symbol of a rule line, before the line is\n"
+"// known and the node is made.\n"
+"typedef enum {\n"
+"    AST_NTERM,\n"
+"    AST_TERM,\n"
+"} AstType;\n"
+"\n"
+"typedef struct {\n"
+"    AstType type;\n"
+"    void* value;\n"
+"} AstEntry;\n"
+"\n"
+"static AstEntry* create_ast_entry(ParserContext* ctx, AstType type, void* value) {\n"
+"\n"
+"    AstEntry* ptr = PARSE_ALLOC_T(ctx, AstEntry);\n"
+"    ptr->type = type;\n"
+"    ptr->value = value;\n"
+"\n"
+"    return ptr;\n"
+"}\n"
+"\n"
+"static inline void add_entry(Ast* ast, AstEntry* entry) {\n"
+"\n"
+"    if(entry->type == AST_TERM)\n"
+"        add_ast_token(ast, (Token*)entry->value);\n"
+"    else\n"
+"        add_ast_child(ast, (Ast*)entry->value);\n"
+"}\n"
 "\n"
-"static uint16_t* find_rule(uint16_t type) {\n"
+"static void unmatch_from(ParserContext* ctx, Ast* ast, int from);\n"
 "\n"
-"    uint16_t* tmp;\n"
-"    int idx = 1;\n"
+"// Hand the terminals of the entries from..to back to the scanner, last one\n"
+"// first, so that the next rule line can read them again.\n"
+"static void unmatch_entries(ParserContext* ctx, AstEntry** lst, int from, int to) {\n"
 "\n"
-"    for(uint16_t i = 0; i < parser_table[0]; i++) {\n"
-"        tmp = &parser_table[idx];\n"
-"        if(tmp[1] == type)\n"
-"            return tmp;\n"
+"    for(int i = to - 1; i >= from; i--) {\n"
+"        if(lst[i]->type == AST_TERM) {\n"
+"            unget_token(ctx, (Token*)lst[i]->value);\n"
+"            ctx->tok_pos--;\n"
+"            PROFILE_REWIND(ctx);\n"
+"        }\n"
 "        else\n"
-"            idx += tmp[0];\n"
+"            unmatch_from(ctx, (Ast*)lst[i]->value, 0);\n"
 "    }\n"
+"}\n"
 "\n"
-"    return NULL;\n"
+"// Hand back the attributes of the tree. Attributes before the index from\n"
+"// are kept.\n"
+"static void unmatch_from(ParserContext* ctx, Ast* ast, int from) {\n"
+"\n"
+"    PROFILE_DISCARD(ctx, ast);\n"
+"    for(int i = ast->num_attrs - 1; i >= from; i--) {\n"
+"        if(ast_attr_is_token(ast, i)) {\n"
+"            unget_token(ctx, ast->attrs[i].tok);\n"
+"            ctx->tok_pos--;\n"
+"            PROFILE_REWIND(ctx);\n"
+"        }\n"
+"        else\n"
+"            unmatch_from(ctx, ast->attrs[i].ast, 0);\n"
+"    }\n"
 "}\n"
 "\n"
-"static CacheLine* get_line(uint16_t* table) {\n"
+"#if NUM_CHAIN > 0\n"
+"// The tree so far in path[0] is of the level top of an operator chain, or\n"
+"// it is the operand of the chain when top is the number of levels. It is\n"
+"// wrapped in the node of the line X : Y of every level above it, up to the\n"
+"// level to, which is the tree that the rule lines make.\n"
+"static Ast* wrap_levels(ParserContext* ctx, AstEntry** path, Ast* ast, const uint16_t* types, const uint16_t* bases, int top, int to) {\n"
 "\n"
-"    CacheLine* ptr = _ALLOC_T(CacheLine);\n"
-"    ptr->len = table[0];\n"
-"    ptr->line = _ALLOC_ARRAY(uint16_t, table[0]);\n"
-"    memcpy(ptr->line, &table[1], sizeof(uint16_t)*table[0]+1);\n"
+"    for(int i = top - 1; i >= to; i--) {\n"
+"        ast = create_ast_node(ctx, types[i], bases[i], 1);\n"
+"        add_entry(ast, path[0]);\n"
+"        path[0] = create_ast_entry(ctx, AST_NTERM, ast);\n"
+"    }\n"
 "\n"
-"    return ptr;\n"
+"    return ast;\n"
 "}\n"
+"#endif\n"
+"\n"
+"static void unmatch(ParserContext* ctx, Ast* ast) {\n"
 "\n"
-"static Rule* get_rule(uint16_t type) {\n"
+"    unmatch_from(ctx, ast, 0);\n"
+"}\n"
 "\n"
-"    uint16_t* tmp = find_rule(type);\n"
-"    Rule* ptr;\n"
+"// Consume the terminals of a tree that was already matched at the current\n"
+"// position. This is how a left recursive seed is reused.\n"
+"static void replay(ParserContext* ctx, Ast* ast) {\n"
 "\n"
-"    if(tmp == NULL)\n"
-"        return NULL;\n"
-"    else {\n"
-"        ptr = _DUP_MEM_ARRAY(tmp, Rule, tmp[0]);\n"
-"        ptr->list = _ALLOC_ARRAY(CacheLine*, tmp[3]);\n"
-"        uint16_t* index = &tmp[4];\n"
-"        for(uint16_t i = 0; i < tmp[3]; i++) {\n"
-"            ptr->list[i] = get_line(index);\n"
-"            index += index[0]+1;\n"
+"    for(int i = 0; i < ast->num_attrs; i++) {\n"
+"        if(ast_attr_is_token(ast, i)) {\n"
+"            next_token(ctx);\n"
+"        }\n"
+"        else\n"
+"            replay(ctx, ast->attrs[i].ast);\n"
+"    }\n"
+"}\n"
+"\n"
+"// Non-terminals that are part of an indirect left recursive cycle are grown\n"
+"// from a seed. The first pass matches without the recursive rule. Then the\n"
+"// rule is matched again and again, where the recursive call returns the last\n"
+"// result, until the match stops getting longer.\n"
+"typedef struct _lr_head_ {\n"
+"    uint16_t type;\n"
+"    int pos;\n"
+"    Ast* seed;\n"
+"    int seed_len;\n"
+"    struct _lr_head_* next;\n"
+"} LRHead;\n"
+"\n"
+"// The body of a non-terminal that is grown from a seed.\n"
+"typedef Ast* (*BodyFunc)(ParserContext* ctx, uint16_t type, bool final);\n"
+"\n"
+"static Ast* grow_seed(ParserContext* ctx, uint16_t type, BodyFunc body, bool final) {\n"
+"\n"
+"    for(LRHead* head = ctx->lr_heads; head != NULL; head = head->next) {\n"
+"        if(head->type == type && head->pos == ctx->tok_pos) {\n"
+"            if(head->seed != NULL)\n"
+"                replay(ctx, head->seed);\n"
+"            return head->seed;\n"
 "        }\n"
 "    }\n"
 "\n"
-"    return ptr;\n"
+"    LRHead head = { type, ctx->tok_pos, NULL, -1, ctx->lr_heads };\n"
+"    ctx->lr_heads = &head;\n"
+"\n"
+"    while(true) {\n"
+"        Ast* ast = body(ctx, type, final && head.seed == NULL);\n"
+"        if(ast == NULL)\n"
+"            break;\n"
+"\n"
+"        int len = ctx->tok_pos - head.pos;\n"
+"        unmatch(ctx, ast);\n"
+"        if(len <= head.seed_len)\n"
+"            break;\n"
+"\n"
+"        head.seed = ast;\n"
+"        head.seed_len = len;\n"
+"    }\n"
+"\n"
+"    ctx->lr_heads = head.next;\n"
+"    if(head.seed != NULL)\n"
+"        replay(ctx, head.seed);\n"
+"\n"
+"    return head.seed;\n"
 "}\n"
 "\n"
-"static inline bool is_term(uint16_t type) {\n"
-"    return (type >= BASE_TERM && type < BASE_NTERM)? true: false;\n"
+"#ifdef USE_REPARSE\n"
+"// A match counts the furthest position that it looks at by itself, and\n"
+"// when it is done, the match around it has looked that far too.\n"
+"static inline int reach_enter(ParserContext* ctx) {\n"
+"\n"
+"    int outer = ctx->reach;\n"
+"    ctx->reach = ctx->tok_pos;\n"
+"\n"
+"    return outer;\n"
 "}\n"
 "\n"
-"static inline bool is_nterm(uint16_t type) {\n"
-"    return (type < BASE_NTERM)? false: true;\n"
+"static inline int reach_leave(ParserContext* ctx, int outer) {\n"
+"\n"
+"    int reach = ctx->reach;\n"
+"    if(outer > reach)\n"
+"        ctx->reach = outer;\n"
+"\n"
+"    return reach;\n"
+"}\n"
+"\n"
+"static inline void add_reach(ParserContext* ctx, int reach) {\n"
+"\n"
+"    if(reach > ctx->reach)\n"
+"        ctx->reach = reach;\n"
 "}\n"
+"#endif\n"
 "\n"
-"static Cache* create_cache(uint16_t type) {\n"
+"#ifdef USE_MEMO\n"
+"// The memo has a row for every token position that a memoized non-terminal\n"
+"// was tried at, with an entry for each memoized non-terminal. The end is 0\n"
+"// when the entry is not known, -1 when it failed, or else the position\n"
+"// after the match. The far is the furthest position that it got to.\n"
+"typedef struct _memo_entry_ {\n"
+"    Ast* ast;\n"
+"    int end;\n"
+"    int far;\n"
+"#ifdef USE_REPARSE\n"
+"    int reach;\n"
+"#endif\n"
+"} MemoEntry;\n"
 "\n"
-"    const uint16_t* rule = find_rule(type);\n"
-"    if(!rule)\n"
-"        fatal_error(\"match_rule: unknown rule: %%u\\n\", type);\n"
+"static MemoEntry* memo_entry(ParserContext* ctx, int pos, int slot) {\n"
 "\n"
-"    Cache* cache = _ALLOC_T(Cache);\n"
-"    cache->size = rule[3];\n"
-"    cache->lines = _ALLOC_ARRAY(CacheLine*, cache->size);\n"
+"    if(pos >= ctx->memo_cap) {\n"
+"        int cap = (ctx->memo_cap > 0)? ctx->memo_cap: 256;\n"
+"        while(cap <= pos)\n"
+"            cap <<= 1;\n"
+"        MemoEntry** rows = _ALLOC_ARRAY(MemoEntry*, cap);\n"
+"        memset(rows, 0, sizeof(MemoEntry*) * cap);\n"
+"        if(ctx->memo_rows != NULL) {\n"
+"            memcpy(rows, ctx->memo_rows, sizeof(MemoEntry*) * ctx->memo_cap);\n"
+"            _FREE(ctx->memo_rows);\n"
+"        }\n"
+"        ctx->memo_rows = rows;\n"
+"        ctx->memo_cap = cap;\n"
+"    }\n"
 "\n"
-"    uint16_t* tpt = &rule[4];\n"
-"    for(uint16_t i = 0; i < rule[3]; i++) {\n"
-"        CacheLine* line = _ALLOC_T(CacheLine);\n"
-"        line->score = 0;\n"
-"        line->index = 0;\n"
-"        line->len = tpt[0];\n"
-"        line->line = _ALLOC_ARRAY(uint16_t, line->len);\n"
-"        for(uint16_t j = 0; j < line->len; j++)\n"
-"            line->line[j] = tpt[j+1];\n"
-"        cache->lines[i] = line;\n"
-"        tpt += tpt[0]+1;\n"
+"    if(ctx->memo_rows[pos] == NULL) {\n"
+"        ctx->memo_rows[pos] = PARSE_ALLOC_ARRAY(ctx, MemoEntry, NUM_MEMO);\n"
+"        memset(ctx->memo_rows[pos], 0, sizeof(MemoEntry) * NUM_MEMO);\n"
 "    }\n"
 "\n"
-"    return cache;\n"
+"    return &ctx->memo_rows[pos][slot];\n"
 "}\n"
 "\n"
-"static Ast* match_rule(uint16_t type, bool final) {\n"
+"// Match a memoized non-terminal. A match that is already known is replayed\n"
+"// instead of being parsed again. A known failure is only parsed again when\n"
+"// it is final, so that the error is reported, and so is a known match that\n"
+"// stops at a token that cannot come after it.\n"
+"static Ast* memo_rule(ParserContext* ctx, uint16_t type, int slot, BodyFunc body, bool final) {\n"
 "\n"
-"    // create the cache\n"
-"    Cache* cache = create_cache(type);\n"
-"    List* out = create_list(sizeof(AstEntry*));\n"
+"    MemoEntry* entry = memo_entry(ctx, ctx->tok_pos, slot);\n"
 "\n"
-"    // evaluate the rule\n"
-"    Token* tok;\n"
-"    int index = 0;\n"
-"    int line = 0;\n"
-"    int count = cache->size;\n"
-"    CacheLine** lines = (CacheLine**)raw_list(cache->lines);\n"
-"    while(true) {\n"
-"        if(count > 0) {\n"
-"            // Actively matching this rule.\n"
-"            line_no = 0;\n"
-"            for(CacheLine* line = lines[line_no]; line < cache->size; line_no++) {\n"
-"                tok = get_token();\n"
-"                if((index < line->size) && (line->score >= 0)) {\n"
-"                    if(is_nterm(line->line[index])) {\n"
-"                        if(line->line[index] == tok->type) {\n"
-"                            // store it\n"
-"                            append_list(out, create_ast_node(AST_TERM, tok));\n"
-"                            consume_token();\n"
-"                            index++;\n"
-"                            line_no = 0; // start over with the new token\n"
-"                        }\n"
-"                        else {\n"
-"                            if(final) {\n"
-"                                // syntax error: expected a xyz but got a 123\n"
-"                                // throw away the terminals so that error recovery can happen\n"
-"                                syntax_error_token(tok, \"expected a %%s but got a %%s\", term_to_str(line->line[index]), term_to_str(tok->type));\n"
-"                                consume_token();\n"
-"                                return NULL;\n"
-"                            }\n"
-"                            else {\n"
-"                                // Line cannot be a match, and it's not final. Do not consume the token.\n"
-"                                line->score = -1;\n"
-"                                count--;\n"
-"                            }\n"
-"                        }\n"
-"                    }\n"
-"                    else {\n"
-"                        // recurse the non-terminal\n"
-"                        Ast* ast = match_rule(line->line[index], (count > 1)? false: true);\n"
-"                        if(ast != NULL) {\n"
-"                            // obtained a match on this rule index\n"
-"                            append_list(out, ast);\n"
-"                            index++;\n"
-"                        }\n"
-"                        else {\n"
-"                            // no match so negate this rule.\n"
-"                            // (errors can only happen on a term)\n"
-"                            line->score = -1;\n"
-"                            count--;\n"
-"                        }\n"
-"                    }\n"
-"                }\n"
-"            }\n"
-"            else if(count == 0) {\n"
-"                // No more lines. If we reach here, then no match for this \n"
-"                // rule is possible.\n"
-"                if(final) {\n"
-"                    // syntax error\n"
-"                    syntax_error_token(tok, \"unexpected %%s\", term_to_str(tok->type));\n"
-"                    consume_token();\n"
-"                }\n"
-"                else {\n"
-"                    // unget the tokens and return NULL;\n"
-"                    AstEntry** lst = (AstEntry**)raw_list(out);\n"
-"                    for(int i = 0; i < length_list(out); i++) {\n"
-"                        if(lst[i]->type == AST_TERM)\n"
-"                            unconsume_token((Token*)lst[i]->value);\n"
-"                    }\n"
-"                    return NULL;\n"
-"                }\n"
-"            }\n"
-"            else {\n"
-"                // check if there is a rule that succeeded. If the score is \n"
-"                // greater or equal to the line length, and there is at least \n"
-"                // one line then a match is evident. If there is more than one \n"
-"                // line that matches, then take the one with the highest score.\n"
-"                return create_ast_node(AST_NTERM, out);\n"
-"            }\n"
-"        }   \n"
+"    if(entry->end > 0 || (entry->end < 0 && !final)) {\n"
+"#ifdef USE_REPARSE\n"
+"        add_reach(ctx, entry->reach);\n"
+"#endif\n"
+"        if(entry->end < 0) {\n"
+"            if(entry->far > ctx->far)\n"
+"                ctx->far = entry->far;\n"
+"            return NULL;\n"
+"        }\n"
+"        replay(ctx, entry->ast);\n"
+"        if(!final || !in_set(more_set[type - BASE_NTERM], peek_token(ctx)->type))\n"
+"            return entry->ast;\n"
+"        unmatch(ctx, entry->ast);\n"
+"    }\n"
+"\n"
+"#ifdef USE_REPARSE\n"
+"    int outer = reach_enter(ctx);\n"
+"#endif\n"
+"    int far = far_enter(ctx);\n"
+"    Ast* ast = body(ctx, type, final);\n"
+"    entry->ast = ast;\n"
+"    entry->end = (ast != NULL)? ctx->tok_pos: -1;\n"
+"    entry->far = far_leave(ctx, far);\n"
+"#ifdef USE_REPARSE\n"
+"    entry->reach = reach_leave(ctx, outer);\n"
+"#endif\n"
+"\n"
+"    return ast;\n"
+"}\n"
+"#endif\n"
+"\n"
+"// Match a non-terminal that is not grown from a seed, from the memo if it\n"
+"// has a slot there.\n"
+"static inline Ast* match_memo(ParserContext* ctx, uint16_t type, int slot, BodyFunc body, bool final) {\n"
+"\n"
+"#ifdef USE_MEMO\n"
+"    if(slot >= 0)\n"
+"        return memo_rule(ctx, type, slot, body, final);\n"
+"#endif\n"
+"    (void)slot;\n"
+"    return body(ctx, type, final);\n"
+"}\n"
+"\n"
+"#ifdef USE_REPARSE\n"
+"// A rule that matched at a token position is kept for the next parse, in\n"
+"// the row of the position. The len is the number of tokens that it matched\n"
+"// and the reach is how many tokens from its start it looked at. Both are\n"
+"// counted from the start, so after an edit the rows after it only move. A\n"
+"// row is in the order of the reach, the furthest first.\n"
+"typedef struct _span_ {\n"
+"    Ast* ast;\n"
+"    uint32_t len;\n"
+"    uint32_t reach;\n"
+"    uint16_t type;\n"
+"    struct _span_* next;\n"
+"} Span;\n"
+"\n"
+"static Span* find_span(ParserContext* ctx, int pos, uint16_t type) {\n"
+"\n"
+"    if(pos >= ctx->span_cap)\n"
+"        return NULL;\n"
+"\n"
+"    for(Span* span = ctx->span_rows[pos]; span != NULL; span = span->next)\n"
+"        if(span->type == type)\n"
+"            return span;\n"
+"\n"
+"    return NULL;\n"
+"}\n"
+"\n"
+"static void grow_spans(ParserContext* ctx, int size) {\n"
+"\n"
+"    if(size <= ctx->span_cap)\n"
+"        return;\n"
+"\n"
+"    int cap = (ctx->span_cap > 0)? ctx->span_cap: 256;\n"
+"    while(cap < size)\n"
+"        cap <<= 1;\n"
+"    Span** rows = _ALLOC_ARRAY(Span*, cap);\n"
+"    memset(rows, 0, sizeof(Span*) * cap);\n"
+"    if(ctx->span_rows != NULL) {\n"
+"        memcpy(rows, ctx->span_rows, sizeof(Span*) * ctx->span_cap);\n"
+"        _FREE(ctx->span_rows);\n"
+"    }\n"
+"    ctx->span_rows = rows;\n"
+"    ctx->span_cap = cap;\n"
+"}\n"
+"\n"
+"static void add_span(ParserContext* ctx, uint16_t type, int start, Ast* ast, int reach) {\n"
+"\n"
+"    grow_spans(ctx, start + 1);\n"
+"    Span** link = &ctx->span_rows[start];\n"
+"    Span* span = NULL;\n"
+"    for(; *link != NULL; link = &(*link)->next) {\n"
+"        if((*link)->type == type) {\n"
+"            span = *link;\n"
+"            *link = span->next;\n"
+"            break;\n"
+"        }\n"
+"    }\n"
+"    if(span == NULL) {\n"
+"        span = PARSE_ALLOC_T(ctx, Span);\n"
+"        span->type = type;\n"
 "    }\n"
+"\n"
+"    span->ast = ast;\n"
+"    span->len = ctx->tok_pos - start;\n"
+"    span->reach = reach - start;\n"
+"\n"
+"    for(link = &ctx->span_rows[start]; *link != NULL && (*link)->reach > span->reach; link = &(*link)->next)\n"
+"        ;\n"
+"    span->next = *link;\n"
+"    *link = span;\n"
+"}\n"
+"\n"
+"// Use the tree of the last parse if the rule matched at this position and\n"
+"// nothing that it looked at was edited. Otherwise match it and keep it. As\n"
+"// in the memo, a final rule does not use a tree that stops at a token that\n"
+"// cannot come after it.\n"
+"static Ast* span_rule(ParserContext* ctx, uint16_t type, int slot, BodyFunc body, bool final) {\n"
+"\n"
+"    int start = ctx->tok_pos;\n"
+"    Span* span = find_span(ctx, start, type);\n"
+"    if(span != NULL) {\n"
+"        add_reach(ctx, start + span->reach);\n"
+"        skip_tokens(ctx, span->len);\n"
+"        ctx->tok_pos += span->len;\n"
+"        if(ctx->tok_pos > ctx->far)\n"
+"            ctx->far = ctx->tok_pos;\n"
+"        if(!final || !in_set(more_set[type - BASE_NTERM], peek_token(ctx)->type))\n"
+"            return span->ast;\n"
+"        unmatch(ctx, span->ast);\n"
+"    }\n"
+"\n"
+"    int outer = reach_enter(ctx);\n"
+"    Ast* ast = match_memo(ctx, type, slot, body, final);\n"
+"    int reach = reach_leave(ctx, outer);\n"
+"    if(ast != NULL)\n"
+"        add_span(ctx, type, start, ast, reach);\n"
+"\n"
+"    return ast;\n"
+"}\n"
+"\n"
+"// After an edit, the spans at the tokens from first to old_end are gone\n"
+"// and the ones after them move to new_end. A span before the edit that\n"
+"// looked at an edited token is gone too.\n"
+"static void move_spans(ParserContext* ctx, int first, int old_end, int new_end) {\n"
+"\n"
+"    int used = ctx->span_cap;\n"
+"    for(int pos = 0; pos < first && pos < used; pos++) {\n"
+"        Span** row = &ctx->span_rows[pos];\n"
+"        while(*row != NULL && pos + (int)(*row)->reach > first)\n"
+"            *row = (*row)->next;\n"
+"    }\n"
+"\n"
+"    // only the rows up to the last span are moved\n"
+"    while(used > old_end && ctx->span_rows[used - 1] == NULL)\n"
+"        used--;\n"
+"\n"
+"    int delta = new_end - old_end;\n"
+"    if(old_end < used) {\n"
+"        grow_spans(ctx, used + delta);\n"
+"        memmove(&ctx->span_rows[new_end], &ctx->span_rows[old_end], sizeof(Span*) * (used - old_end));\n"
+"        if(delta < 0)\n"
+"            memset(&ctx->span_rows[used + delta], 0, sizeof(Span*) * -delta);\n"
+"        memset(&ctx->span_rows[first], 0, sizeof(Span*) * (new_end - first));\n"
+"    }\n"
+"    else if(first < used)\n"
+"        memset(&ctx->span_rows[first], 0, sizeof(Span*) * (used - first));\n"
+"}\n"
+"#endif\n"
+"\n"
+"// Match a non-terminal that is not grown from a seed. The rules that are\n"
+"// matched while a seed grows depend on the seed, so they are not kept.\n"
+"static inline Ast* match_nterm(ParserContext* ctx, uint16_t type, int slot, BodyFunc body, bool final) {\n"
+"\n"
+"#ifdef USE_REPARSE\n"
+"    if(ctx->lr_heads == NULL)\n"
+"        return span_rule(ctx, type, slot, body, final);\n"
+"#endif\n"
+"    return match_memo(ctx, type, slot, body, final);\n"
 "}\n"
 "\n"
-"Ast* parse() {\n"
+"// Nothing that was matched before is looked at again, so the positions\n"
+"// start over and the memo is cleared. This is done before a parse, and\n"
+"// after each element of a streaming parse.\n"
+"static void reset_matched(ParserContext* ctx) {\n"
 "\n"
-"    return match_rule(BASE_NTERM, true);\n"
+"#ifdef USE_MEMO\n"
+"    if(ctx->memo_rows != NULL)\n"
+"        memset(ctx->memo_rows, 0, sizeof(MemoEntry*) * ctx->memo_cap);\n"
+"#endif\n"
+"    ctx->tok_pos = 0;\n"
+"    ctx->far = 0;\n"
+"    ctx->reach = 0;\n"
+"    ctx->synced = -1;\n"
 "}\n"
 "\n";
 
-const char* parser_testing_string =
-"#if 1\n"
-"static void dump_line_obj(uint16_t obj) {"
-"    if(is_nterm(obj))\n"
-"        printf(\"%%s\", nterm_to_str(obj));\n"
-"    else\n"
-"        printf(\"%%u\", obj);\n"
+/*
+ * Panic mode error recovery, with the sets that the generator computed. It
+ * is emitted for both kinds of parser.
+ */
+const char* parser_recovery_string =
+"\n"
+"// A non-terminal cannot start with the token. The message has the tokens\n"
+"// that it can start with, written one at a time so that none is cut off.\n"
+"static void expect_error(ParserContext* ctx, Token* tok, uint16_t type) {\n"
+"\n"
+"    const uint32_t* set = expect_set[type - BASE_NTERM];\n"
+"    const char* sep = \"\";\n"
+"\n"
+"    if(!error_start(ctx, tok))\n"
+"        return;\n"
+"\n"
+"    fprintf(stderr, \"unexpected %%s while parsing %%s, expected \", term_to_str(tok->type), nterm_to_str(type));\n"
+"    for(int i = 0; i <= NUM_TERM; i++) {\n"
+"        if(in_set(set, BASE_TERM + i)) {\n"
+"            fprintf(stderr, \"%%s%%s\", sep, term_to_str(BASE_TERM + i));\n"
+"            sep = \", \";\n"
+"        }\n"
+"    }\n"
+"    fprintf(stderr, \"\\n\");\n"
 "}\n"
 "\n"
-"static void dump_line(CacheLine* line) {\n"
+"// The line of a factored tree that went the furthest into the input. When\n"
+"// the tree fails, or the line that it matched stops at a token that cannot\n"
+"// come after the non-terminal, the error is in that line, and it is matched\n"
+"// again as final to report the error and recover. A line that failed\n"
+"// scores the furthest position that it got to, and the line that matched\n"
+"// the position after it. A tie goes to the line that failed first, which\n"
+"// tells what was expected at the token.\n"
+"typedef struct {\n"
+"    int score;\n"
+"    int line;\n"
+"} FarLine;\n"
+"\n"
+"static inline void line_failed(ParserContext* ctx, FarLine* far, int line) {\n"
 "\n"
-"    printf(\"    len:%%d \", line->len);\n"
-"    printf(\"score:%%d \", line->score);\n"
-"    printf(\"index:%%d [\", line->index);\n"
-"    int idx = 0;\n"
-"    dump_line_obj(line->line[idx++]);\n"
-"    while(idx < line->len) {\n"
-"        printf(\", \");\n"
-"        dump_line_obj(line->line[idx++]);\n"
+"    if(ctx->far > far->score) {\n"
+"        far->score = ctx->far;\n"
+"        far->line = line;\n"
 "    }\n"
-"    printf(\"]\\n\");\n"
 "}\n"
 "\n"
-"static void dump_cache(Cache* ptr) {\n"
+"static inline void line_matched(ParserContext* ctx, FarLine* far, int line) {\n"
 "\n"
-"    printf(\"line: \");\n"
-"    printf(\"size:%%u\\n\", ptr->size);\n"
-"    for(int i = 0; i < ptr->size; i++)\n"
-"        dump_line(ptr->lines[i]);\n"
-"    printf(\"\\n\");\n"
+"    if(ctx->tok_pos > far->score) {\n"
+"        far->score = ctx->tok_pos;\n"
+"        far->line = line;\n"
+"    }\n"
 "}\n"
 "\n"
-"static void dump_rule(Rule* ptr) {\n"
+"// A non-terminal that was final stopped at a token that cannot come after\n"
+"// it, so the error is in what it matched.\n"
+"static inline bool stops_early(ParserContext* ctx, uint16_t type) {\n"
 "\n"
-"    printf(\"size:%%u\\n\", ptr->size);\n"
-"    printf(\"type:\"); dump_line_obj(ptr->type); printf(\"\\n\");\n"
-"    printf(\"prec:%%u\\n\", ptr->prec);\n"
-"    printf(\"lines:%%u\\n\", ptr->num_lines);\n"
-"    for(unsigned int i = 0; i < ptr->num_lines; i++)\n"
-"        dump_line(ptr->list[i]);\n"
-"    printf(\"\\n\");\n"
+"    return in_set(more_set[type - BASE_NTERM], peek_token(ctx)->type);\n"
 "}\n"
 "\n"
-"int main() {\n"
+"// The tokens that a recovery skips are kept in nodes, so that handing back\n"
+"// or replaying a tree still moves over every token that it took. A node\n"
+"// has a bit for each attribute, so a long skip is a chain of nodes.\n"
+"#define SKIP_CHUNK 62\n"
+"\n"
+"// Skip the input up to a token of the sync set of the non-terminal, which\n"
+"// is its FOLLOW set and the %%sync terminals, or of the start set if it is\n"
+"// not NULL, in one pass. The node that is returned has alt 0 and holds\n"
+"// first and the skipped tokens, and last is the node at the end of the\n"
+"// chain. When the last recovery stopped at the same token, that token is\n"
+"// skipped too, so that the parse always moves on.\n"
+"static Ast* skip_input(ParserContext* ctx, uint16_t type, Ast* first, const uint32_t* start, Ast** last) {\n"
+"\n"
+"    const uint32_t* sync = sync_set[type - BASE_NTERM];\n"
+"    Ast* ast = create_ast_node(ctx, type, 0, SKIP_CHUNK + 2);\n"
+"    Ast* node = ast;\n"
+"    bool stuck = (ctx->synced == ctx->tok_pos);\n"
+"    Token* tok;\n"
+"\n"
+"    if(first != NULL)\n"
+"        add_ast_child(ast, first);\n"
+"\n"
+"    while((tok = peek_token(ctx))->type != _TOK_END_OF_INPUT &&\n"
+"          (stuck || !(in_set(sync, tok->type) || (start != NULL && in_set(start, tok->type))))) {\n"
+"        if(node->num_attrs > SKIP_CHUNK) {\n"
+"            Ast* next = create_ast_node(ctx, type, 0, SKIP_CHUNK + 2);\n"
+"            add_ast_child(node, next);\n"
+"            node = next;\n"
+"        }\n"
+"        add_ast_token(node, tok);\n"
+"        next_token(ctx);\n"
+"        stuck = false;\n"
+"    }\n"
 "\n"
-"    Rule* ptr = (Rule*)get_rule(1001);\n"
-"    dump_rule(ptr);\n"
+"    ctx->synced = ctx->tok_pos;\n"
+"    ctx->recovered++;\n"
+"    *last = node;\n"
 "\n"
-"    ptr = (Rule*)get_rule(1003);\n"
-"    dump_rule(ptr);\n"
+"    return ast;\n"
+"}\n"
 "\n"
-"    ptr = (Rule*)get_rule(1006);\n"
-"    dump_rule(ptr);\n"
+"// After a syntax error in a non-terminal that was final, the input is\n"
+"// skipped to its sync set, so that the rule around it can go on and report\n"
+"// the errors after it.\n"
+"static Ast* recover_rule(ParserContext* ctx, uint16_t type, Ast* first) {\n"
 "\n"
-"    ptr = (Rule*)get_rule(8012);\n"
-"    printf(\"rule == NULL? %%s\\n\", ptr==NULL? \"true\":\"false\");\n"
+"    Ast* last;\n"
 "\n"
-"    Cache* c = create_cache(1005);\n"
-"    dump_cache(c);\n"
+"    return skip_input(ctx, type, first, NULL, &last);\n"
+"}\n"
 "\n"
-"    return 0;\n"
+"// A non-terminal that was final could not start at the token. The input is\n"
+"// skipped to a token that it can start with, where it is matched again, or\n"
+"// to its sync set. A member of a left recursive cycle is grown again.\n"
+"static Ast* recover_start(ParserContext* ctx, uint16_t type, BodyFunc body, bool grow) {\n"
+"\n"
+"    const uint32_t* start = expect_set[type - BASE_NTERM];\n"
+"    Ast* last;\n"
+"    Ast* ast = skip_input(ctx, type, NULL, start, &last);\n"
+"\n"
+"    if(in_set(start, peek_token(ctx)->type)) {\n"
+"        Ast* next = grow? grow_seed(ctx, type, body, true): body(ctx, type, true);\n"
+"        if(next != NULL)\n"
+"            add_ast_child(last, next);\n"
+"    }\n"
+"\n"
+"    return ast;\n"
+"}\n"
+"\n"
+"// A final rule line stopped at a token that does not fit, and the error\n"
+"// was reported. What it matched stays in the node, which gets alt 0 and\n"
+"// the skipped input after it.\n"
+"static Ast* recover_line(ParserContext* ctx, Ast* ast) {\n"
+"\n"
+"    ast->alt = 0;\n"
+"    add_ast_child(ast, recover_rule(ctx, ast->type, NULL));\n"
+"\n"
+"    return ast;\n"
 "}\n"
+"\n"
+"// The end of a parse. A parse that recovered from an error returns NULL,\n"
+"// and with USE_REPARSE nothing of it is kept for the next parse.\n"
+"static Ast* finish_parse(ParserContext* ctx, Ast* ast, int recovered) {\n"
+"\n"
+"    Token* tok = peek_token(ctx);\n"
+"    if(tok->type != _TOK_END_OF_INPUT) {\n"
+"        syntax_error_token(ctx, tok, \"expected the end of input but got a %%s\", term_to_str(tok->type));\n"
+"        ast = NULL;\n"
+"    }\n"
+"\n"
+"    if(ctx->recovered != recovered) {\n"
+"#ifdef USE_REPARSE\n"
+"        if(ctx->span_rows != NULL)\n"
+"            memset(ctx->span_rows, 0, sizeof(Span*) * ctx->span_cap);\n"
+"#endif\n"
+"        return NULL;\n"
+"    }\n"
+"\n"
+"    return ast;\n"
+"}\n"
+"\n";
+
+/*
+ * The support for the streaming parser. It is emitted when there is a
+ * %stream directive.
+ */
+const char* parser_stream_string =
+"\n"
+"// An element was handed to the callback, or it had an error. The scanner\n"
+"// can let go of the text of the element, and with an arena the tree of it\n"
+"// is freed. The positions start over, so the kept rules are dropped. When a\n"
+"// recovery stopped at the end of the element, the next one starts there.\n"
+"static void release_matched(ParserContext* ctx) {\n"
+"\n"
+"    bool synced = (ctx->synced == ctx->tok_pos);\n"
+"\n"
+"    reset_matched(ctx);\n"
+"    release_tokens(ctx);\n"
+"#ifdef USE_REPARSE\n"
+"    if(ctx->span_rows != NULL)\n"
+"        memset(ctx->span_rows, 0, sizeof(Span*) * ctx->span_cap);\n"
 "#endif\n"
+"    if(synced)\n"
+"        ctx->synced = 0;\n"
+"}\n"
+"\n";
+
+/*
+ * This is the code to emit for the actual parser.
+ */
+const char* parser_finder_string =
+"\n"
+"static inline const TableEntry* find_rule(uint16_t type) {\n"
+"\n"
+"    return &parser_table[rule_index[type - BASE_NTERM]];\n"
+"}\n"
+"\n"
+"static inline const RuleInfo* get_rule(uint16_t type) {\n"
+"\n"
+"    return &rule_info[type - BASE_NTERM];\n"
+"}\n"
+"\n"
+"static inline bool is_term(uint16_t type) {\n"
+"    return (type < BASE_NTERM)? true: false;\n"
+"}\n"
+"\n"
+"static inline bool is_nterm(uint16_t type) {\n"
+"    return (type < BASE_NTERM)? false: true;\n"
+"}\n"
+"\n"
+"static Ast* match_rule(ParserContext* ctx, uint16_t type, bool final);\n"
+"\n"
+"// Match one item of a rule line. Returns the entry for the tree, or NULL.\n"
+"static AstEntry* match_entry(ParserContext* ctx, uint16_t item, bool final) {\n"
+"\n"
+"    if(is_term(item)) {\n"
+"        Token* tok = peek_token(ctx);\n"
+"        if(tok->type != item) {\n"
+"            if(final)\n"
+"                syntax_error_token(ctx, tok, \"expected a %%s but got a %%s\", term_to_str(item), term_to_str(tok->type));\n"
+"            return NULL;\n"
+"        }\n"
+"        next_token(ctx);\n"
+"        return create_ast_entry(ctx, AST_TERM, tok);\n"
+"    }\n"
+"\n"
+"    Ast* child = match_rule(ctx, item, final);\n"
+"\n"
+"    return (child != NULL)? create_ast_entry(ctx, AST_NTERM, child): NULL;\n"
+"}\n"
+"\n"
+"// Match every item in the line. If that fails, then the tokens are handed\n"
+"// back and NULL is returned. A failure is a syntax error only if final is\n"
+"// set, and then the line recovers instead of failing.\n"
+"// When first is not NULL, it becomes the first child of the new node. This\n"
+"// is used to build the left recursive tree for the tail lines.\n"
+"static Ast* match_line(ParserContext* ctx, uint16_t type, RuleLine line, uint16_t alt, bool final, Ast* first) {\n"
+"\n"
+"    int from = (first != NULL)? 1: 0;\n"
+"    Ast* ast = create_ast_node(ctx, type, alt, line[0] + from);\n"
+"\n"
+"    if(first != NULL)\n"
+"        add_ast_child(ast, first);\n"
+"\n"
+"    for(int i = 1; i <= line[0]; i++) {\n"
+"        AstEntry* entry = match_entry(ctx, line[i], final);\n"
+"        if(entry == NULL) {\n"
+"            if(final)\n"
+"                return recover_line(ctx, ast);\n"
+"            unmatch_from(ctx, ast, from);\n"
+"            return NULL;\n"
+"        }\n"
+"        add_entry(ast, entry);\n"
+"    }\n"
+"\n"
+"    return ast;\n"
+"}\n"
+"\n"
+"// A node of the factored tree is its size, the symbol, the line that ends\n"
+"// at the node plus 1, and the number of branches, followed by the branches.\n"
+"// A node that no line ends at has branches, so a line is below the first.\n"
+"static inline int tree_line(const TableEntry* node) {\n"
+"\n"
+"    while(node[2] == 0)\n"
+"        node = &node[4];\n"
+"\n"
+"    return node[2] - 1;\n"
+"}\n"
+"\n"
+"// The entries up to and including the node are in path[0..depth). Every\n"
+"// branch is tried and the line that matches the most tokens wins, the first\n"
+"// line wins a tie. The prefix up to the node is matched once, and only the\n"
+"// rest of the winning line is matched again if a later branch was tried.\n"
+"// This returns the line with its entries in the path and the input after\n"
+"// it, or -1 with the input as it was. A branch that fails is counted in\n"
+"// far when it is not NULL. When more is not NULL, a profile put the hot\n"
+"// branch first, and it is taken without trying the others when it stops at\n"
+"// a token that is not in more, so that the rule can end there.\n"
+"static int match_tree(ParserContext* ctx, const RuleLine* lines, const TableEntry* node, AstEntry** path, int depth, int from, int start, int* len, FarLine* far, const uint32_t* more) {\n"
+"\n"
+"    int best = (int)node[2] - 1;\n"
+"    int best_len = (best >= 0)? ctx->tok_pos - start: -1;\n"
+"    bool kept = true; // the entries of the best line are in the path\n"
+"    const TableEntry* branch = &node[4];\n"
+"\n"
+"    for(int i = 0; i < node[3]; i++, branch += branch[0]) {\n"
+"        int outer = far_enter(ctx);\n"
+"        path[depth] = match_entry(ctx, branch[1], false);\n"
+"        if(path[depth] == NULL && far != NULL)\n"
+"            line_failed(ctx, far, tree_line(branch));\n"
+"        far_leave(ctx, outer);\n"
+"        if(path[depth] == NULL)\n"
+"            continue;\n"
+"\n"
+"        int sub_len;\n"
+"        int sub = match_tree(ctx, lines, branch, path, depth + 1, from, start, &sub_len, far, more);\n"
+"        if(sub >= 0 && (sub_len > best_len || (sub_len == best_len && sub < best))) {\n"
+"            best = sub;\n"
+"            best_len = sub_len;\n"
+"            kept = (i == node[3] - 1) || (i == 0 && more != NULL && !in_set(more, peek_token(ctx)->type));\n"
+"            if(kept)\n"
+"                break;\n"
+"        }\n"
+"        unmatch_entries(ctx, path, depth, (sub >= 0)? lines[sub][0] + from: depth + 1);\n"
+"    }\n"
+"\n"
+"    if(best >= 0 && !kept) {\n"
+"        RuleLine line = lines[best];\n"
+"        for(int i = depth - from; i < line[0]; i++)\n"
+"            path[i + from] = match_entry(ctx, line[i + 1], false);\n"
+"    }\n"
+"\n"
+"    *len = best_len;\n"
+"    return best;\n"
+"}\n"
+"\n"
+"// Match the factored tree of the lines. When first is not NULL, it becomes\n"
+"// the first child of the new node, as in match_line(). The line that went\n"
+"// the furthest is in far when it is not NULL.\n"
+"static Ast* match_factored(ParserContext* ctx, uint16_t type, const RuleLine* lines, const uint16_t* alts, const TableEntry* tree, Ast* first, FarLine* far) {\n"
+"\n"
+"    AstEntry* path[MAX_LINE + 1];\n"
+"    int from = 0;\n"
+"    int len;\n"
+"\n"
+"    if(first != NULL)\n"
+"        path[from++] = create_ast_entry(ctx, AST_NTERM, first);\n"
+"    if(far != NULL) {\n"
+"        far->score = -1;\n"
+"        far->line = -1;\n"
+"    }\n"
+"\n"
+"    const uint32_t* more = (get_rule(type)->flags & RULE_HOT_FIRST)? more_set[type - BASE_NTERM]: NULL;\n"
+"    int best = match_tree(ctx, lines, tree, path, from, from, ctx->tok_pos, &len, far, more);\n"
+"    if(best < 0)\n"
+"        return NULL;\n"
+"    if(far != NULL)\n"
+"        line_matched(ctx, far, best);\n"
+"\n"
+"    Ast* ast = create_ast_node(ctx, type, alts[best], lines[best][0] + from);\n"
+"    for(int i = 0; i < lines[best][0] + from; i++)\n"
+"        add_entry(ast, path[i]);\n"
+"\n"
+"    return ast;\n"
+"}\n"
+"\n"
+"// Match the left recursive lines in a loop. Each one that matches makes a\n"
+"// new node with the tree so far as its first child. When the loop stops at\n"
+"// a token that cannot come after the list, the list cannot end there. If\n"
+"// it is final, the line that went the furthest is matched again as final,\n"
+"// so that the error is reported where it is and recovered from, and the\n"
+"// loop goes on.\n"
+"static Ast* match_tails(ParserContext* ctx, const RuleInfo* rule, Ast* ast, bool final) {\n"
+"\n"
+"    FarLine far;\n"
+"    Ast* next;\n"
+"\n"
+"    while(true) {\n"
+"        while((next = match_factored(ctx, rule->type, rule->tails, &rule->alts[rule->num_lines], rule->tail_tree, ast, final? &far: NULL)) != NULL)\n"
+"            ast = next;\n"
+"\n"
+"        if(!final || !stops_early(ctx, rule->type))\n"
+"            return ast;\n"
+"\n"
+"        ast = match_line(ctx, rule->type, rule->tails[far.line], rule->alts[rule->num_lines + far.line], true, ast);\n"
+"    }\n"
+"}\n"
+"\n"
+"#if NUM_CHAIN > 0\n"
+"// The level of the operator in the chain and its line, or -1 if the token\n"
+"// is not an operator of the chain.\n"
+"static inline int climb_level(uint16_t id, uint16_t tok, uint16_t* alt) {\n"
+"\n"
+"    if(!is_term(tok) || tok - BASE_TERM > NUM_TERM)\n"
+"        return -1;\n"
+"\n"
+"    *alt = climb_ops[id][tok - BASE_TERM][1];\n"
+"    return climb_ops[id][tok - BASE_TERM][0] - 1;\n"
+"}\n"
+"\n"
+"// The operator levels of a chain, X : X OP Y | Y or X : Y OP X | Y where\n"
+"// each Y is the next level, are matched by one precedence climbing loop.\n"
+"// The operand at the bottom of the chain is matched, and then the level of\n"
+"// each operator decides where it goes, so the levels in between are not\n"
+"// called. The levels that the tree skips get the node of X : Y, so it is\n"
+"// the same as the lines make. The node of the level min is returned. The\n"
+"// operand after an operator is the call to its level, as in the lines.\n"
+"static Ast* climb(ParserContext* ctx, const uint16_t* chain, int min, bool final) {\n"
+"\n"
+"    uint16_t id = chain[0];\n"
+"    uint16_t operand = chain[1];\n"
+"    int num = chain[2];\n"
+"    const uint16_t* types = &chain[3];\n"
+"    const uint16_t* bases = &chain[3 + num];\n"
+"    const uint16_t* rights = &chain[3 + 2 * num];\n"
+"    Token* tok = peek_token(ctx);\n"
+"    int errs = ctx->errors;\n"
+"    AstEntry* path[3];\n"
+"    Ast* ast = NULL;\n"
+"    int top = num;\n"
+"    bool closed = false;\n"
+"    uint16_t alt;\n"
+"    int level;\n"
+"\n"
+"    // an error in the first operand is reported and recovered from in the\n"
+"    // last level, where the lines find it\n"
+"    if((path[0] = match_entry(ctx, operand, final && min + 1 == num)) == NULL) {\n"
+"        if(!final)\n"
+"            return NULL;\n"
+"        if(min + 1 == num) {\n"
+"            if(errs == ctx->errors)\n"
+"                expect_error(ctx, tok, types[min]);\n"
+"            return NULL;\n"
+"        }\n"
+"        path[0] = match_entry(ctx, types[num - 1], true);\n"
+"        ast = (Ast*)path[0]->value;\n"
+"        top = num - 1;\n"
+"        closed = true;\n"
+"    }\n"
+"\n"
+"    // a level that is done, or a right associative one, takes no more\n"
+"    // operators after the tree so far\n"
+"    while((level = climb_level(id, peek_token(ctx)->type, &alt)) >= min) {\n"
+"        if(level > top || (level == top && closed))\n"
+"            break;\n"
+"\n"
+"        Token* op = peek_token(ctx);\n"
+"        int to = rights[level]? level + 1: level;\n"
+"        ast = wrap_levels(ctx, path, ast, types, bases, top, to);\n"
+"        top = to;\n"
+"        path[1] = match_entry(ctx, op->type, false);\n"
+"\n"
+"        // right associative recurses for the rest of the expression\n"
+"        uint16_t next = rights[level]? types[level]: (level + 1 < num)? types[level + 1]: operand;\n"
+"        if((path[2] = match_entry(ctx, next, false)) == NULL) {\n"
+"            // the level ends before an operator that can come after it, and\n"
+"            // else it cannot end there and the error is in the operand\n"
+"            if(!in_set(more_set[types[level] - BASE_NTERM], op->type)) {\n"
+"                unmatch_entries(ctx, path, 1, 2);\n"
+"                break;\n"
+"            }\n"
+"            if(!final) {\n"
+"                unmatch_entries(ctx, path, 0, 2);\n"
+"                return NULL;\n"
+"            }\n"
+"            if((path[2] = match_entry(ctx, next, true)) == NULL) {\n"
+"                // a terminal operand, which was reported\n"
+"                ast = create_ast_node(ctx, types[level], alt, 3);\n"
+"                add_entry(ast, path[0]);\n"
+"                add_entry(ast, path[1]);\n"
+"                path[0] = create_ast_entry(ctx, AST_NTERM, recover_line(ctx, ast));\n"
+"                top = level;\n"
+"                closed = true;\n"
+"                continue;\n"
+"            }\n"
+"        }\n"
+"\n"
+"        ast = create_ast_node(ctx, types[level], alt, 3);\n"
+"        for(int i = 0; i < 3; i++)\n"
+"            add_entry(ast, path[i]);\n"
+"        path[0] = create_ast_entry(ctx, AST_NTERM, ast);\n"
+"        top = level;\n"
+"        closed = rights[level];\n"
+"    }\n"
+"\n"
+"    return wrap_levels(ctx, path, ast, types, bases, top, min);\n"
+"}\n"
+"#endif\n"
+"\n"
+"#ifdef USE_PREDICT_TABLE\n"
+"// The line that the token predicts for the non-terminal. The comb vector\n"
+"// lays the rows of the table over each other, and a cell is in the row\n"
+"// that its check entry names. Every other cell of the row is empty.\n"
+"static inline uint8_t predict_line(uint16_t type, uint16_t tok) {\n"
+"\n"
+"#ifdef PREDICT_COMB\n"
+"    int row = type - BASE_NTERM;\n"
+"    int cell = predict_base[row] + tok - BASE_TERM;\n"
+"\n"
+"    return (predict_check[cell] == row)? predict_next[cell]: PREDICT_NONE;\n"
+"#else\n"
+"    return predict_table[type - BASE_NTERM][tok - BASE_TERM];\n"
+"#endif\n"
+"}\n"
+"#endif\n"
+"\n"
+"static Ast* match_body(ParserContext* ctx, uint16_t type, bool final) {\n"
+"\n"
+"    const RuleInfo* rule = get_rule(type);\n"
+"    Token* tok = peek_token(ctx);\n"
+"    int errs = ctx->errors;\n"
+"    Ast* ast = NULL;\n"
+"\n"
+"#if NUM_CHAIN > 0\n"
+"    if(rule->flags & RULE_OPERATOR)\n"
+"        return climb(ctx, rule->chain, rule->level, final);\n"
+"#endif\n"
+"\n"
+"#ifdef USE_PREDICT_TABLE\n"
+"    // If the lookahead selects exactly one line, then there is nothing to\n"
+"    // backtrack over. Conflicts fall through to backtracking.\n"
+"    if(is_term(tok->type) && tok->type - BASE_TERM <= NUM_TERM) {\n"
+"        uint8_t line = predict_line(type, tok->type);\n"
+"        if(line == PREDICT_NONE) {\n"
+"            if(final)\n"
+"                expect_error(ctx, tok, type);\n"
+"            return NULL;\n"
+"        }\n"
+"        else if(line != PREDICT_CONFLICT) {\n"
+"            ast = match_line(ctx, type, rule->lines[line - 1], rule->alts[line - 1], final, NULL);\n"
+"            return (ast != NULL && rule->num_tails > 0)? match_tails(ctx, rule, ast, final): ast;\n"
+"        }\n"
+"    }\n"
+"#endif\n"
+"\n"
+"    if(rule->num_lines == 1)\n"
+"        ast = match_line(ctx, type, rule->lines[0], rule->alts[0], final, NULL);\n"
+"    else {\n"
+"        // when it can start with the token, an error is in the line that\n"
+"        // went the furthest\n"
+"        FarLine far;\n"
+"        FarLine* track = (final && in_set(expect_set[type - BASE_NTERM], tok->type))? &far: NULL;\n"
+"\n"
+"        ast = match_factored(ctx, type, rule->lines, rule->alts, rule->tree, NULL, track);\n"
+"        if(track != NULL && (ast == NULL || stops_early(ctx, type))) {\n"
+"            if(ast != NULL)\n"
+"                unmatch(ctx, ast);\n"
+"            ast = match_line(ctx, type, rule->lines[far.line], rule->alts[far.line], true, NULL);\n"
+"        }\n"
+"        else if(ast == NULL) {\n"
+"            if(final && errs == ctx->errors)\n"
+"                expect_error(ctx, tok, type);\n"
+"            return NULL;\n"
+"        }\n"
+"    }\n"
+"\n"
+"    return (ast != NULL && rule->num_tails > 0)? match_tails(ctx, rule, ast, final): ast;\n"
+"}\n"
+"\n"
+"// A non-terminal that fails when it is final recovers from the error, so\n"
+"// it only returns NULL when it is not.\n"
+"static Ast* match_rule(ParserContext* ctx, uint16_t type, bool final) {\n"
+"\n"
+"    Ast* ast;\n"
+"\n"
+"    PROFILE_ENTER(ctx, type);\n"
+"    if(get_rule(type)->flags & RULE_LR_HEAD)\n"
+"        ast = grow_seed(ctx, type, match_body, final);\n"
+"    else {\n"
+"#ifdef USE_MEMO\n"
+"        ast = match_nterm(ctx, type, memo_slot[type - BASE_NTERM], match_body, final);\n"
+"#else\n"
+"        ast = match_nterm(ctx, type, -1, match_body, final);\n"
+"#endif\n"
+"    }\n"
+"    PROFILE_LEAVE(ctx, type, ast);\n"
+"\n"
+"    if(ast == NULL && final)\n"
+"        ast = recover_start(ctx, type, match_body, (get_rule(type)->flags & RULE_LR_HEAD)? true: false);\n"
+"\n"
+"    return ast;\n"
+"}\n"
+"\n"
+"Ast* parse(ParserContext* ctx) {\n"
+"\n"
+"    int recovered = ctx->recovered;\n"
+"\n"
+"    reset_matched(ctx);\n"
+"    Ast* ast = match_rule(ctx, BASE_NTERM, true);\n"
+"\n"
+"    return finish_parse(ctx, ast, recovered);\n"
+"}\n"
+"\n";
+
+/*
+ * Parsing again after an edit, when the generated code is built with
+ * USE_REPARSE.
+ */
+const char* parser_reparse_string =
+"\n"
+"#ifdef USE_REPARSE\n"
+"// Parse the text again after the edits. The tokens that the edits do not\n"
+"// change are kept, and so is the tree of every rule that did not look at\n"
+"// an edited token, so only the rules around the edits are matched again.\n"
+"Ast* reparse(ParserContext* ctx, const TextEdit* edits, int num) {\n"
+"\n"
+"    int first, old_end, new_end;\n"
+"\n"
+"    edit_tokens(ctx, edits, num, &first, &old_end, &new_end);\n"
+"    move_spans(ctx, first, old_end, new_end);\n"
+"\n"
+"    return parse(ctx);\n"
+"}\n"
+"#endif\n"
+"\n";
+
+/*
+ * The support code for the direct coded parser, where every non-terminal
+ * is a function and every rule line is a function that the generator writes.
+ */
+const char* parser_direct_string =
+"\n"
+"// The functions of a rule that the profile found seldom tried are kept out\n"
+"// of the way of the ones that are tried often.\n"
+"#ifdef __GNUC__\n"
+"#define COLD_RULE __attribute__((cold))\n"
+"#else\n"
+"#define COLD_RULE\n"
+"#endif\n"
+"\n"
+"// Start the node for a rule line of size symbols. When first is not NULL,\n"
+"// it is the left recursive tree so far and it becomes the first child of\n"
+"// the new node.\n"
+"static inline Ast* create_node(ParserContext* ctx, uint16_t type, uint16_t alt, int size, Ast* first) {\n"
+"\n"
+"    Ast* ast = create_ast_node(ctx, type, alt, size);\n"
+"    if(first != NULL)\n"
+"        add_ast_child(ast, first);\n"
+"\n"
+"    return ast;\n"
+"}\n"
+"\n"
+"// Match a terminal and add it to the node.\n"
+"static inline bool match_token(ParserContext* ctx, Ast* ast, TokenType type, bool final) {\n"
+"\n"
+"    Token* tok = peek_token(ctx);\n"
+"    if(tok->type != type) {\n"
+"        if(final)\n"
+"            syntax_error_token(ctx, tok, \"expected a %%s but got a %%s\", term_to_str(type), term_to_str(tok->type));\n"
+"        return false;\n"
+"    }\n"
+"\n"
+"    add_ast_token(ast, tok);\n"
+"    next_token(ctx);\n"
+"\n"
+"    return true;\n"
+"}\n"
+"\n"
+"// Add the node of a non-terminal that matched.\n"
+"static inline bool match_child(Ast* ast, Ast* child) {\n"
+"\n"
+"    if(child == NULL)\n"
+"        return false;\n"
+"\n"
+"    add_ast_child(ast, child);\n"
+"    return true;\n"
+"}\n"
+"\n"
+"// A rule line did not match. Hand back the tokens, or recover when it was\n"
+"// final.\n"
+"static inline Ast* fail_line(ParserContext* ctx, Ast* ast, Ast* first, bool final) {\n"
+"\n"
+"    if(final)\n"
+"        return recover_line(ctx, ast);\n"
+"\n"
+"    unmatch_from(ctx, ast, (first != NULL)? 1: 0);\n"
+"    return NULL;\n"
+"}\n"
+"\n"
+"// Match a terminal for the factored tree. Returns the entry or NULL.\n"
+"static inline AstEntry* token_entry(ParserContext* ctx, TokenType type) {\n"
+"\n"
+"    Token* tok = peek_token(ctx);\n"
+"    if(tok->type != type)\n"
+"        return NULL;\n"
+"\n"
+"    next_token(ctx);\n"
+"\n"
+"    return create_ast_entry(ctx, AST_TERM, tok);\n"
+"}\n"
+"\n"
+"static inline AstEntry* child_entry(ParserContext* ctx, Ast* child) {\n"
+"\n"
+"    return (child != NULL)? create_ast_entry(ctx, AST_NTERM, child): NULL;\n"
+"}\n"
+"\n"
+"// Make the node from the entries that the factored tree matched.\n"
+"static Ast* build_node(ParserContext* ctx, uint16_t type, uint16_t alt, AstEntry** path, int size) {\n"
+"\n"
+"    Ast* ast = create_ast_node(ctx, type, alt, size);\n"
+"    for(int i = 0; i < size; i++)\n"
+"        add_entry(ast, path[i]);\n"
+"\n"
+"    return ast;\n"
+"}\n"
+"\n";
+
+const char* parser_testing_string =
+"#ifdef PARSER_TESTING\n"
+"static void dump_line_obj(uint16_t obj) {\n"
+"    if(is_nterm(obj))\n"
+"        printf(\"%%s\", nterm_to_str(obj));\n"
+"    else\n"
+"        printf(\"%%s\", term_to_str(obj));\n"
+"}\n"
+"\n"
+"static void dump_line(RuleLine line) {\n"
+"\n"
+"    printf(\"    len:%%d [\", line[0]);\n"
+"    for(int i = 1; i <= line[0]; i++) {\n"
+"        if(i > 1)\n"
+"            printf(\", \");\n"
+"        dump_line_obj(line[i]);\n"
+"    }\n"
+"    printf(\"]\\n\");\n"
+"}\n"
+"\n"
+"static void dump_rule(const RuleInfo* ptr) {\n"
+"\n"
+"    printf(\"offset:%%u\\n\", rule_index[ptr->type - BASE_NTERM]);\n"
+"    printf(\"type:\"); dump_line_obj(ptr->type); printf(\"\\n\");\n"
+"    printf(\"prec:%%u\\n\", ptr->prec);\n"
+"    printf(\"flags:%%u\\n\", ptr->flags);\n"
+"    printf(\"lines:%%u\\n\", ptr->num_lines);\n"
+"    for(unsigned int i = 0; i < ptr->num_lines; i++)\n"
+"        dump_line(ptr->lines[i]);\n"
+"    printf(\"tails:%%u\\n\", ptr->num_tails);\n"
+"    for(unsigned int i = 0; i < ptr->num_tails; i++)\n"
+"        dump_line(ptr->tails[i]);\n"
+"    printf(\"\\n\");\n"
+"}\n"
+"\n"
+"int main() {\n"
+"\n"
+"    for(uint16_t i = 0; i < NUM_NTERM; i++)\n"
+"        dump_rule(get_rule(BASE_NTERM + i));\n"
+"\n"
+"    return 0;\n"
+"}\n"
+"#endif\n"
+"\n";
+
+/*
+ * The arena for the objects that a parse makes, when the generated code is
+ * built with USE_ARENA. It goes in the AST module so that the scanner can
+ * use it too.
+ */
+const char* arena_string =
+"#ifdef USE_ARENA\n"
+"#ifdef ARENA_HUGE_PAGES\n"
+"#include <sys/mman.h>\n"
+"#endif\n"
+"\n"
+"// The arena is a chain of large blocks. An allocation takes the next bytes\n"
+"// of the current block. Nothing is freed by itself, the whole arena is\n"
+"// reset or freed when the trees in it are not needed any more.\n"
+"typedef struct _arena_block_ {\n"
+"    struct _arena_block_* next;\n"
+"    size_t total;   // bytes in the block, with this header\n"
+"    size_t size;    // bytes that can be allocated\n"
+"    size_t used;\n"
+"} ArenaBlock;\n"
+"\n"
+"#ifndef ARENA_BLOCK\n"
+"#define ARENA_BLOCK ((size_t)1 << 21)\n"
+"#endif\n"
+"#define ARENA_ALIGN(n) (((n) + 15) & ~(size_t)15)\n"
+"#define ARENA_DATA(b) ((char*)(b) + ARENA_ALIGN(sizeof(ArenaBlock)))\n"
+"\n"
+"// the arena of one ParserContext\n"
+"typedef struct _arena_ {\n"
+"    ArenaBlock* first;\n"
+"    ArenaBlock* crnt;\n"
+"} Arena;\n"
+"\n"
+"static ArenaBlock* arena_block(size_t size) {\n"
+"\n"
+"    size_t total = ARENA_ALIGN(sizeof(ArenaBlock)) + size;\n"
+"#ifdef ARENA_HUGE_PAGES\n"
+"    // Huge pages are used if the system has them reserved. Otherwise the\n"
+"    // block is asked to be backed by transparent huge pages.\n"
+"    total = (total + ARENA_BLOCK - 1) & ~(ARENA_BLOCK - 1);\n"
+"    void* ptr = mmap(NULL, total, PROT_READ | PROT_WRITE,\n"
+"                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);\n"
+"    if(ptr == MAP_FAILED) {\n"
+"        ptr = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);\n"
+"        if(ptr != MAP_FAILED)\n"
+"            madvise(ptr, total, MADV_HUGEPAGE);\n"
+"    }\n"
+"    if(ptr == MAP_FAILED)\n"
+"        ptr = NULL;\n"
+"#else\n"
+"    void* ptr = malloc(total);\n"
+"#endif\n"
+"    if(ptr == NULL) {\n"
+"        fprintf(stderr, \"Fatal error: cannot allocate %%zu bytes for the arena\\n\", total);\n"
+"        exit(1);\n"
+"    }\n"
+"\n"
+"    ArenaBlock* block = (ArenaBlock*)ptr;\n"
+"    block->next = NULL;\n"
+"    block->total = total;\n"
+"    block->size = total - ARENA_ALIGN(sizeof(ArenaBlock));\n"
+"    block->used = 0;\n"
+"\n"
+"    return block;\n"
+"}\n"
+"\n"
+"// The memory is cleared, the same as the GC allocator.\n"
+"void* arena_alloc(ParserContext* ctx, size_t size) {\n"
+"\n"
+"    Arena* arena = ctx->arena;\n"
+"    size = ARENA_ALIGN(size);\n"
+"    while(arena->crnt == NULL || arena->crnt->used + size > arena->crnt->size) {\n"
+"        if(arena->crnt != NULL && arena->crnt->next != NULL && arena->crnt->next->size >= size) {\n"
+"            // a block that arena_reset() kept\n"
+"            arena->crnt = arena->crnt->next;\n"
+"            arena->crnt->used = 0;\n"
+"            continue;\n"
+"        }\n"
+"\n"
+"        ArenaBlock* block = arena_block((size > ARENA_BLOCK)? size: ARENA_BLOCK);\n"
+"        if(arena->crnt == NULL)\n"
+"            arena->first = block;\n"
+"        else {\n"
+"            block->next = arena->crnt->next;\n"
+"            arena->crnt->next = block;\n"
+"        }\n"
+"        arena->crnt = block;\n"
+"    }\n"
+"\n"
+"    void* ptr = ARENA_DATA(arena->crnt) + arena->crnt->used;\n"
+"    arena->crnt->used += size;\n"
+"    memset(ptr, 0, size);\n"
+"\n"
+"    return ptr;\n"
+"}\n"
+"\n"
+"// Everything in the arena is gone, but the blocks are kept for the next\n"
+"// parse.\n"
+"void arena_reset(ParserContext* ctx) {\n"
+"\n"
+"    Arena* arena = ctx->arena;\n"
+"    arena->crnt = arena->first;\n"
+"    if(arena->crnt != NULL)\n"
+"        arena->crnt->used = 0;\n"
+"}\n"
+"\n"
+"// Everything in the arena is gone and the blocks are given back.\n"
+"void arena_free(ParserContext* ctx) {\n"
+"\n"
+"    Arena* arena = ctx->arena;\n"
+"    ArenaBlock* next;\n"
+"    for(ArenaBlock* block = arena->first; block != NULL; block = next) {\n"
+"        next = block->next;\n"
+"#ifdef ARENA_HUGE_PAGES\n"
+"        munmap(block, block->total);\n"
+"#else\n"
+"        free(block);\n"
+"#endif\n"
+"    }\n"
+"    arena->first = NULL;\n"
+"    arena->crnt = NULL;\n"
+"}\n"
+"#endif\n"
+"\n";
+
+/*
+ * The context that a parse keeps its state in, declared in the _ast.h file.
+ * It goes in the AST module with the arena that it owns.
+ */
+const char* context_string =
+"\n"
+"ParserContext* create_parser_context() {\n"
+"\n"
+"    ParserContext* ctx = _ALLOC_T(ParserContext);\n"
+"    memset(ctx, 0, sizeof(ParserContext));\n"
+"    ctx->scan = create_scan_state();\n"
+"#ifdef USE_ARENA\n"
+"    ctx->arena = _ALLOC_T(Arena);\n"
+"    memset(ctx->arena, 0, sizeof(Arena));\n"
+"#endif\n"
+"\n"
+"    return ctx;\n"
+"}\n"
+"\n"
+"// The files are closed and the trees, the tokens, and their text are gone.\n"
+"// The arena blocks are kept for the next parse, and the number of errors\n"
+"// goes on counting.\n"
+"void reset_parser_context(ParserContext* ctx) {\n"
+"\n"
+"    reset_scan_state(ctx->scan);\n"
+"#ifdef USE_ARENA\n"
+"    arena_reset(ctx);\n"
+"#endif\n"
+"    if(ctx->span_rows != NULL)\n"
+"        memset(ctx->span_rows, 0, sizeof(ctx->span_rows[0]) * ctx->span_cap);\n"
+"}\n"
+"\n"
+"void destroy_parser_context(ParserContext* ctx) {\n"
+"\n"
+"    destroy_scan_state(ctx->scan);\n"
+"#ifdef USE_ARENA\n"
+"    arena_free(ctx);\n"
+"    _FREE(ctx->arena);\n"
+"#endif\n"
+"    if(ctx->memo_rows != NULL)\n"
+"        _FREE(ctx->memo_rows);\n"
+"    if(ctx->span_rows != NULL)\n"
+"        _FREE(ctx->span_rows);\n"
+"    if(ctx->profile != NULL)\n"
+"        _FREE(ctx->profile);\n"
+"    _FREE(ctx);\n"
+"}\n"
+"\n";
+
+/*
+ * Adding the attributes of a node, declared in the _ast.h file.
+ */
+const char* ast_node_h_string =
+"static inline bool ast_attr_is_token(const Ast* ast, int idx) {\n"
+"    return (ast->terms >> idx) & 1;\n"
+"}\n"
+"\n"
+"static inline void add_ast_token(Ast* ast, Token* tok) {\n"
+"    ast->terms |= (uint64_t)1 << ast->num_attrs;\n"
+"    ast->attrs[ast->num_attrs++].tok = tok;\n"
+"}\n"
+"\n"
+"static inline void add_ast_child(Ast* ast, Ast* child) {\n"
+"    ast->attrs[ast->num_attrs++].ast = child;\n"
+"}\n"
+"\n";
+
+/*
+ * The flat form of the syntax tree, declared in the _ast.h file.
+ */
+const char* ast_tree_h_string =
+"// The syntax tree in preorder, one array for each field of a node. A node\n"
+"// is followed by its subtree, so the first child of the node n is n + 1\n"
+"// and the next sibling of a child c is next[c]. A terminal has the index\n"
+"// of its token in tokens, a rule has -1.\n"
+"typedef struct {\n"
+"    uint16_t* type;     // the rule or the TokenType\n"
+"    uint16_t* num_kids;\n"
+"    uint32_t* next;     // index after the subtree\n"
+"    int32_t* token;\n"
+"    int num_nodes;\n"
+"    Token* tokens;\n"
+"    int num_tokens;\n"
+"} AstTree;\n"
+"\n"
+"AstTree* flatten_ast(Ast* ast);\n"
+"int ast_kid(const AstTree* tree, int node, int idx);\n"
+"\n"
+"static inline uint16_t ast_type(const AstTree* tree, int node) {\n"
+"    return tree->type[node];\n"
+"}\n"
+"\n"
+"static inline int ast_num_kids(const AstTree* tree, int node) {\n"
+"    return tree->num_kids[node];\n"
+"}\n"
+"\n"
+"static inline int ast_first_kid(const AstTree* tree, int node) {\n"
+"    return (tree->num_kids[node] > 0)? node + 1: -1;\n"
+"}\n"
+"\n"
+"// The sibling that follows the node, or the node after the subtree of\n"
+"// its parent if it is the last child.\n"
+"static inline int ast_next_sibling(const AstTree* tree, int node) {\n"
+"    return tree->next[node];\n"
+"}\n"
+"\n"
+"static inline bool ast_is_token(const AstTree* tree, int node) {\n"
+"    return tree->token[node] >= 0;\n"
+"}\n"
+"\n"
+"static inline const Token* ast_token(const AstTree* tree, int node) {\n"
+"    return (tree->token[node] >= 0)? &tree->tokens[tree->token[node]]: NULL;\n"
+"}\n"
+"\n";
+
+const char* ast_tree_string =
+"\n"
+"static void count_ast(Ast* ast, int* nodes, int* tokens) {\n"
+"\n"
+"    (*nodes)++;\n"
+"    for(int i = 0; i < ast->num_attrs; i++) {\n"
+"        if(ast_attr_is_token(ast, i)) {\n"
+"            (*nodes)++;\n"
+"            (*tokens)++;\n"
+"        }\n"
+"        else\n"
+"            count_ast(ast->attrs[i].ast, nodes, tokens);\n"
+"    }\n"
+"}\n"
+"\n"
+"// Write the node and its subtree from the index n on. Returns the index\n"
+"// after the subtree.\n"
+"static uint32_t flatten_node(AstTree* tree, Ast* ast, uint32_t n) {\n"
+"\n"
+"    uint32_t next = n + 1;\n"
+"\n"
+"    tree->type[n] = ast->type;\n"
+"    tree->num_kids[n] = ast->num_attrs;\n"
+"    tree->token[n] = -1;\n"
+"    for(int i = 0; i < ast->num_attrs; i++) {\n"
+"        if(ast_attr_is_token(ast, i)) {\n"
+"            Token* tok = ast->attrs[i].tok;\n"
+"            tree->type[next] = tok->type;\n"
+"            tree->num_kids[next] = 0;\n"
+"            tree->token[next] = tree->num_tokens;\n"
+"            tree->tokens[tree->num_tokens++] = *tok;\n"
+"            tree->next[next] = next + 1;\n"
+"            next++;\n"
+"        }\n"
+"        else\n"
+"            next = flatten_node(tree, ast->attrs[i].ast, next);\n"
+"    }\n"
+"    tree->next[n] = next;\n"
+"\n"
+"    return next;\n"
+"}\n"
+"\n"
+"// Copy the tree into the flat form. The tokens are copied with it, so the\n"
+"// tree that was parsed, and an arena that it is in, can be let go. The\n"
+"// text of the tokens is still kept by the scanner.\n"
+"AstTree* flatten_ast(Ast* ast) {\n"
+"\n"
+"    AstTree* tree = _ALLOC_T(AstTree);\n"
+"    if(ast == NULL)\n"
+"        return tree;\n"
+"\n"
+"    int nodes = 0, tokens = 0;\n"
+"    count_ast(ast, &nodes, &tokens);\n"
+"\n"
+"    tree->type = _ALLOC_ARRAY(uint16_t, nodes);\n"
+"    tree->num_kids = _ALLOC_ARRAY(uint16_t, nodes);\n"
+"    tree->next = _ALLOC_ARRAY(uint32_t, nodes);\n"
+"    tree->token = _ALLOC_ARRAY(int32_t, nodes);\n"
+"    tree->tokens = _ALLOC_ARRAY(Token, tokens + 1);\n"
+"    tree->num_nodes = flatten_node(tree, ast, 0);\n"
+"\n"
+"    return tree;\n"
+"}\n"
+"\n"
+"// The child of the node at idx, found by stepping over its older siblings.\n"
+"int ast_kid(const AstTree* tree, int node, int idx) {\n"
+"\n"
+"    int kid = node + 1;\n"
+"    while(idx-- > 0)\n"
+"        kid = tree->next[kid];\n"
+"\n"
+"    return kid;\n"
+"}\n"
+"\n";
+
+/*
+ * The visitor, which walks the tree with a stack of its own instead of
+ * recursing, so that the depth of the tree does not matter.
+ */
+const char* visitor_h_string =
+"typedef enum {\n"
+"    VISIT_CONTINUE,     // go on with the children\n"
+"    VISIT_SKIP,         // from pre, leave out the children of the node\n"
+"    VISIT_STOP,         // end the walk\n"
+"} VisitResult;\n"
+"\n"
+"typedef VisitResult (*VisitNode)(Ast* ast, void* data);\n"
+"typedef VisitResult (*VisitToken)(Token* tok, void* data);\n"
+"\n"
+"// The callbacks by rule, where VISIT_SLOT() gives the index of a rule. The\n"
+"// pre callback is called before the children of the node and post after\n"
+"// them, also when pre skipped them. A NULL callback continues.\n"
+"typedef struct {\n"
+"    VisitNode pre[VISIT_NUM];\n"
+"    VisitNode post[VISIT_NUM];\n"
+"    VisitToken token;\n"
+"} Visitor;\n"
+"\n"
+"bool visit_ast(const Visitor* visitor, Ast* ast, void* data);\n"
+"\n"
+"// A walk where the subtrees of the rules that are marked in split are\n"
+"// tasks for a pool of threads. Every thread visits with its own data, made\n"
+"// by create from the data of the walk, and the data of the threads is\n"
+"// merged into the data of the walk by reduce when the tasks are done. The\n"
+"// threads take the tasks in any order, so reduce must not depend on it.\n"
+"// Then the nodes that are not in a task are visited in the calling thread.\n"
+"typedef struct {\n"
+"    const Visitor* visitor;\n"
+"    bool split[VISIT_NUM];\n"
+"    int num_threads;                        // 0 is one for each processor\n"
+"    void* (*create)(void* data);            // NULL shares the data\n"
+"    void (*reduce)(void* data, void* part);\n"
+"} ParallelVisitor;\n"
+"\n"
+"bool visit_parallel(const ParallelVisitor* par, Ast* ast, void* data);\n"
+"\n";
+
+const char* visitor_string =
+"#include <pthread.h>\n"
+"#include <stdatomic.h>\n"
+"#include <unistd.h>\n"
+"\n"
+"#if defined(__GNUC__)\n"
+"#define VISIT_PREFETCH(p) __builtin_prefetch(p)\n"
+"#else\n"
+"#define VISIT_PREFETCH(p)\n"
+"#endif\n"
+"\n"
+"// A node that is being visited and the attribute to visit next.\n"
+"typedef struct {\n"
+"    Ast* ast;\n"
+"    int next;\n"
+"} VisitFrame;\n"
+"\n"
+"static inline bool is_split(const bool* split, Ast* ast) {\n"
+"\n"
+"    return split != NULL && split[VISIT_SLOT(ast->type)];\n"
+"}\n"
+"\n"
+"// The node is visited. If it continues, then its first child is fetched\n"
+"// and it is pushed on the stack, with its children left out if it skips.\n"
+"static inline VisitResult visit_enter(const Visitor* visitor, VisitFrame* frame, Ast* ast, void* data) {\n"
+"\n"
+"    VisitNode func = visitor->pre[VISIT_SLOT(ast->type)];\n"
+"    VisitResult result = (func != NULL)? func(ast, data): VISIT_CONTINUE;\n"
+"\n"
+"    if(result == VISIT_CONTINUE && ast->num_attrs > 0 && !ast_attr_is_token(ast, 0))\n"
+"        VISIT_PREFETCH(ast->attrs[0].ast);\n"
+"\n"
+"    frame->ast = ast;\n"
+"    frame->next = (result == VISIT_SKIP)? ast->num_attrs: 0;\n"
+"\n"
+"    return result;\n"
+"}\n"
+"\n"
+"// Walk the tree in depth first order, without going into the subtrees of\n"
+"// the rules in split if it is not NULL. Returns false if a callback stopped\n"
+"// the walk.\n"
+"static bool visit_tree(const Visitor* visitor, Ast* ast, void* data, const bool* split) {\n"
+"\n"
+"    if(ast == NULL || is_split(split, ast))\n"
+"        return true;\n"
+"\n"
+"    int cap = 64;\n"
+"    int top = 0;\n"
+"    VisitFrame* stack = _ALLOC_ARRAY(VisitFrame, cap);\n"
+"    bool done = true;\n"
+"\n"
+"    if(visit_enter(visitor, &stack[top++], ast, data) == VISIT_STOP) {\n"
+"        _FREE(stack);\n"
+"        return false;\n"
+"    }\n"
+"\n"
+"    while(top > 0) {\n"
+"        VisitFrame* frame = &stack[top - 1];\n"
+"        Ast* node = frame->ast;\n"
+"\n"
+"        if(frame->next >= node->num_attrs) {\n"
+"            VisitNode func = visitor->post[VISIT_SLOT(node->type)];\n"
+"            top--;\n"
+"            if(func != NULL && func(node, data) == VISIT_STOP) {\n"
+"                done = false;\n"
+"                break;\n"
+"            }\n"
+"            continue;\n"
+"        }\n"
+"\n"
+"        // the next sibling is fetched while this one is visited\n"
+"        int idx = frame->next++;\n"
+"        if(frame->next < node->num_attrs && !ast_attr_is_token(node, frame->next))\n"
+"            VISIT_PREFETCH(node->attrs[frame->next].ast);\n"
+"\n"
+"        if(ast_attr_is_token(node, idx)) {\n"
+"            if(visitor->token != NULL && visitor->token(node->attrs[idx].tok, data) == VISIT_STOP) {\n"
+"                done = false;\n"
+"                break;\n"
+"            }\n"
+"            continue;\n"
+"        }\n"
+"\n"
+"        if(is_split(split, node->attrs[idx].ast))\n"
+"            continue;\n"
+"\n"
+"        if(top == cap) {\n"
+"            cap <<= 1;\n"
+"            stack = _REALLOC_ARRAY(stack, VisitFrame, cap);\n"
+"        }\n"
+"        if(visit_enter(visitor, &stack[top++], node->attrs[idx].ast, data) == VISIT_STOP) {\n"
+"            done = false;\n"
+"            break;\n"
+"        }\n"
+"    }\n"
+"\n"
+"    _FREE(stack);\n"
+"    return done;\n"
+"}\n"
+"\n"
+"bool visit_ast(const Visitor* visitor, Ast* ast, void* data) {\n"
+"\n"
+"    return visit_tree(visitor, ast, data, NULL);\n"
+"}\n"
+"\n"
+"// The tasks of a thread. The thread takes them from the bottom and the\n"
+"// other threads steal them from the top when they run out.\n"
+"typedef struct {\n"
+"    pthread_mutex_t lock;\n"
+"    Ast** tasks;\n"
+"    int top;\n"
+"    int bottom;\n"
+"} VisitQueue;\n"
+"\n"
+"typedef struct {\n"
+"    const ParallelVisitor* par;\n"
+"    VisitQueue* queues;\n"
+"    int num_queues;\n"
+"    int self;\n"
+"    void* data;\n"
+"    atomic_bool* stop;\n"
+"} VisitWorker;\n"
+"\n"
+"static Ast* take_task(VisitQueue* queue, bool steal) {\n"
+"\n"
+"    Ast* task = NULL;\n"
+"\n"
+"    pthread_mutex_lock(&queue->lock);\n"
+"    if(queue->top < queue->bottom)\n"
+"        task = steal? queue->tasks[queue->top++]: queue->tasks[--queue->bottom];\n"
+"    pthread_mutex_unlock(&queue->lock);\n"
+"\n"
+"    return task;\n"
+"}\n"
+"\n"
+"// No task makes new ones, so a thread is done when every queue is empty.\n"
+"static void* visit_worker(void* arg) {\n"
+"\n"
+"    VisitWorker* worker = (VisitWorker*)arg;\n"
+"\n"
+"    while(!atomic_load(worker->stop)) {\n"
+"        Ast* task = take_task(&worker->queues[worker->self], false);\n"
+"        for(int i = 1; task == NULL && i < worker->num_queues; i++)\n"
+"            task = take_task(&worker->queues[(worker->self + i) %% worker->num_queues], true);\n"
+"        if(task == NULL)\n"
+"            break;\n"
+"\n"
+"        if(!visit_tree(worker->par->visitor, task, worker->data, NULL))\n"
+"            atomic_store(worker->stop, true);\n"
+"    }\n"
+"\n"
+"    return NULL;\n"
+"}\n"
+"\n"
+"// Find the tasks, the outermost subtrees of the rules that are split.\n"
+"static Ast** find_tasks(const bool* split, Ast* ast, int* num) {\n"
+"\n"
+"    int cap = 64, top = 0, count = 0, tcap = 64;\n"
+"    Ast** stack = _ALLOC_ARRAY(Ast*, cap);\n"
+"    Ast** tasks = _ALLOC_ARRAY(Ast*, tcap);\n"
+"\n"
+"    stack[top++] = ast;\n"
+"    while(top > 0) {\n"
+"        Ast* node = stack[--top];\n"
+"        if(split[VISIT_SLOT(node->type)]) {\n"
+"            if(count == tcap) {\n"
+"                tcap <<= 1;\n"
+"                tasks = _REALLOC_ARRAY(tasks, Ast*, tcap);\n"
+"            }\n"
+"            tasks[count++] = node;\n"
+"            continue;\n"
+"        }\n"
+"\n"
+"        // pushed in reverse so the tasks are in the order of the tree\n"
+"        for(int i = node->num_attrs - 1; i >= 0; i--) {\n"
+"            if(ast_attr_is_token(node, i))\n"
+"                continue;\n"
+"            if(top == cap) {\n"
+"                cap <<= 1;\n"
+"                stack = _REALLOC_ARRAY(stack, Ast*, cap);\n"
+"            }\n"
+"            stack[top++] = node->attrs[i].ast;\n"
+"        }\n"
+"    }\n"
+"\n"
+"    _FREE(stack);\n"
+"    *num = count;\n"
+"    return tasks;\n"
+"}\n"
+"\n"
+"bool visit_parallel(const ParallelVisitor* par, Ast* ast, void* data) {\n"
+"\n"
+"    if(ast == NULL)\n"
+"        return true;\n"
+"\n"
+"    int num_tasks;\n"
+"    Ast** tasks = find_tasks(par->split, ast, &num_tasks);\n"
+"\n"
+"    int num = (par->num_threads > 0)? par->num_threads: (int)sysconf(_SC_NPROCESSORS_ONLN);\n"
+"    if(num > num_tasks)\n"
+"        num = num_tasks;\n"
+"    if(num < 1)\n"
+"        num = 1;\n"
+"\n"
+"    VisitQueue* queues = _ALLOC_ARRAY(VisitQueue, num);\n"
+"    VisitWorker* workers = _ALLOC_ARRAY(VisitWorker, num);\n"
+"    pthread_t* threads = _ALLOC_ARRAY(pthread_t, num);\n"
+"    bool* started = _ALLOC_ARRAY(bool, num);\n"
+"    atomic_bool stop;\n"
+"    atomic_init(&stop, false);\n"
+"\n"
+"    // every thread starts with a run of neighboring tasks\n"
+"    for(int i = 0; i < num; i++) {\n"
+"        pthread_mutex_init(&queues[i].lock, NULL);\n"
+"        queues[i].tasks = tasks;\n"
+"        queues[i].top = (int)((long)num_tasks * i / num);\n"
+"        queues[i].bottom = (int)((long)num_tasks * (i + 1) / num);\n"
+"\n"
+"        workers[i].par = par;\n"
+"        workers[i].queues = queues;\n"
+"        workers[i].num_queues = num;\n"
+"        workers[i].self = i;\n"
+"        workers[i].data = (par->create != NULL)? par->create(data): data;\n"
+"        workers[i].stop = &stop;\n"
+"    }\n"
+"\n"
+"    // The calling thread is the first worker. If a thread cannot be\n"
+"    // started, then its tasks are stolen by the others.\n"
+"    for(int i = 1; i < num; i++)\n"
+"        started[i] = (pthread_create(&threads[i], NULL, visit_worker, &workers[i]) == 0);\n"
+"    visit_worker(&workers[0]);\n"
+"    for(int i = 1; i < num; i++)\n"
+"        if(started[i])\n"
+"            pthread_join(threads[i], NULL);\n"
+"\n"
+"    for(int i = 0; i < num; i++) {\n"
+"        if(par->create != NULL && par->reduce != NULL)\n"
+"            par->reduce(data, workers[i].data);\n"
+"        pthread_mutex_destroy(&queues[i].lock);\n"
+"    }\n"
+"\n"
+"    _FREE(queues);\n"
+"    _FREE(workers);\n"
+"    _FREE(threads);\n"
+"    _FREE(started);\n"
+"    _FREE(tasks);\n"
+"\n"
+"    if(atomic_load(&stop))\n"
+"        return false;\n"
+"\n"
+"    return visit_tree(par->visitor, ast, data, par->split);\n"
+"}\n"
+"\n";
+
+/*
+ * The batch driver, which parses a list of files on a pool of threads with
+ * a context for each thread.
+ */
+const char* parser_batch_string =
+"\n"
+"#include <pthread.h>\n"
+"#include <stdatomic.h>\n"
+"#include <unistd.h>\n"
+"\n"
+"typedef struct {\n"
+"    const char** fnames;\n"
+"    int num;\n"
+"    atomic_int next;    // the next file that a thread takes\n"
+"    BatchFunc func;\n"
+"    void* data;\n"
+"} Batch;\n"
+"\n"
+"typedef struct {\n"
+"    Batch* batch;\n"
+"    ParserContext* ctx;\n"
+"} BatchWorker;\n"
+"\n"
+"// A thread takes the next file that no thread has taken until there are\n"
+"// none left. The context is reset before every file, so the memory that a\n"
+"// thread keeps depends on the largest file and not on the batch.\n"
+"static void* batch_worker(void* ptr) {\n"
+"\n"
+"    BatchWorker* worker = (BatchWorker*)ptr;\n"
+"    Batch* batch = worker->batch;\n"
+"    int idx;\n"
+"\n"
+"    while((idx = atomic_fetch_add(&batch->next, 1)) < batch->num) {\n"
+"        reset_parser_context(worker->ctx);\n"
+"        open_file(worker->ctx, batch->fnames[idx]);\n"
+"        Ast* ast = parse(worker->ctx);\n"
+"        if(batch->func != NULL)\n"
+"            batch->func(worker->ctx, batch->fnames[idx], ast, batch->data);\n"
+"    }\n"
+"\n"
+"    return NULL;\n"
+"}\n"
+"\n"
+"int parse_files(const char** fnames, int num, int num_threads, BatchFunc func, void* data) {\n"
+"\n"
+"    int num_workers = (num_threads > 0)? num_threads: (int)sysconf(_SC_NPROCESSORS_ONLN);\n"
+"    if(num_workers > num)\n"
+"        num_workers = num;\n"
+"    if(num_workers < 1)\n"
+"        num_workers = 1;\n"
+"\n"
+"    Batch batch;\n"
+"    batch.fnames = fnames;\n"
+"    batch.num = num;\n"
+"    atomic_init(&batch.next, 0);\n"
+"    batch.func = func;\n"
+"    batch.data = data;\n"
+"\n"
+"    BatchWorker* workers = _ALLOC_ARRAY(BatchWorker, num_workers);\n"
+"    pthread_t* threads = _ALLOC_ARRAY(pthread_t, num_workers);\n"
+"    bool* started = _ALLOC_ARRAY(bool, num_workers);\n"
+"    for(int i = 0; i < num_workers; i++) {\n"
+"        workers[i].batch = &batch;\n"
+"        workers[i].ctx = create_parser_context();\n"
+"    }\n"
+"\n"
+"    // The calling thread is the first worker. If a thread cannot be\n"
+"    // started, then the others take its files.\n"
+"    for(int i = 1; i < num_workers; i++)\n"
+"        started[i] = (pthread_create(&threads[i], NULL, batch_worker, &workers[i]) == 0);\n"
+"    batch_worker(&workers[0]);\n"
+"    for(int i = 1; i < num_workers; i++)\n"
+"        if(started[i])\n"
+"            pthread_join(threads[i], NULL);\n"
+"\n"
+"    int errs = 0;\n"
+"    for(int i = 0; i < num_workers; i++) {\n"
+"        errs += get_errors(workers[i].ctx);\n"
+"        destroy_parser_context(workers[i].ctx);\n"
+"    }\n"
+"\n"
+"    _FREE(workers);\n"
+"    _FREE(threads);\n"
+"    _FREE(started);\n"
+"\n"
+"    return errs;\n"
+"}\n"
 "\n";
 
 #endif /* _EMIT_PARSER_H */
@@ -0,0 +1,881 @@
+#include "emit_scanner.h"
+#include "dfa.h"
+#include "logger.h"
+
+#define SCLEVEL 10
+
+static Parser* parser_state;
+
+/*
+ * The code that runs the DFA. It needs the tables and the scan_action()
+ * function that the generator writes.
+ */
+static const char* scanner_string =
+"\n"
+"// One input file. The file is read in chunks into a buffer and the DFA runs\n"
+"// over the buffer, so a token is found in one pass without reading\n"
+"// characters one at a time. The text of a token is a slice of the buffer,\n"
+"// so the buffer keeps everything from the first token that is still\n"
+"// needed. That is the whole file unless release_tokens() is called.\n"
+"typedef struct {\n"
+"    char* buffer;\n"
+"    uint32_t size;     // bytes in the buffer\n"
+"    uint32_t cap;\n"
+"    uint32_t base;     // offset in the file of the start of the buffer\n"
+"    uint32_t keep;     // the first offset that a token still needs\n"
+"    FILE* fp;          // NULL when the whole file has been read\n"
+"    const char* name;\n"
+"    int line;          // line and column of the start of the buffer\n"
+"    int col;\n"
+"    uint32_t* lines;   // where each line after the first starts in the buffer\n"
+"    int num_lines;\n"
+"    int cap_lines;\n"
+"    uint32_t lines_end; // how far the buffer was searched for lines\n"
+"} ScanFile;\n"
+"\n"
+"// An open file on the input stack.\n"
+"typedef struct _scan_input_ {\n"
+"    int file;\n"
+"    uint32_t pos;\n"
+"    struct _scan_input_* prev;\n"
+"} ScanInput;\n"
+"\n"
+"// input is read this much at a time\n"
+"#define SCAN_CHUNK 0x10000\n"
+"\n"
+"// tokens are handed out of blocks instead of one allocation each, the\n"
+"// blocks come from the arena when there is one\n"
+"#define TOKEN_BLOCK 1024\n"
+"\n"
+"#ifdef USE_REPARSE\n"
+"// A token of the stream, with where the scan after it starts and the\n"
+"// furthest place that the scanner had looked at when it was made. An edit\n"
+"// before the reach can change the token.\n"
+"typedef struct {\n"
+"    Token* tok;\n"
+"    uint32_t next;\n"
+"    uint32_t reach;\n"
+"} ScanEntry;\n"
+"#endif\n"
+"\n"
+"// The scanner part of a ParserContext.\n"
+"struct _scan_state_ {\n"
+"    Token token;       // the token that the actions change\n"
+"    ScanFile* files;   // every file that was opened, a token has the index of its file\n"
+"    int num_files;\n"
+"    int cap_files;\n"
+"    ScanInput* input;\n"
+"    Token* crnt;\n"
+"    Token* end_token;\n"
+"    int errors;\n"
+"    Token* tok_block;\n"
+"    int tok_left;\n"
+"    Token** ungot;     // tokens that the parser handed back, the last one is read first\n"
+"    int num_ungot;\n"
+"    int cap_ungot;\n"
+"#ifdef USE_REPARSE\n"
+"    ScanEntry* toks;   // every token that was scanned, by position\n"
+"    int num_toks;\n"
+"    int cap_toks;\n"
+"    int pos;           // the position of the current token\n"
+"    uint32_t peek;     // the furthest place that the scanner looked at\n"
+"#endif\n"
+"};\n"
+"\n"
+"// Find the line and column of a place in the buffer. The lines are found\n"
+"// when they are first needed.\n"
+"static void find_location(ScanFile* file, uint32_t pos, int* line, int* col) {\n"
+"\n"
+"    for(; file->lines_end < file->size; file->lines_end++) {\n"
+"        if(file->buffer[file->lines_end] == '\\n') {\n"
+"            if(file->num_lines + 1 > file->cap_lines) {\n"
+"                file->cap_lines = (file->cap_lines > 0)? file->cap_lines << 1: 64;\n"
+"                file->lines = (file->lines == NULL)?\n"
+"                        _ALLOC_ARRAY(uint32_t, file->cap_lines):\n"
+"                        _REALLOC_ARRAY(file->lines, uint32_t, file->cap_lines);\n"
+"            }\n"
+"            file->lines[file->num_lines++] = file->lines_end + 1;\n"
+"        }\n"
+"    }\n"
+"\n"
+"    // the number of lines that start at or before the place\n"
+"    int low = 0;\n"
+"    int high = file->num_lines;\n"
+"    while(low < high) {\n"
+"        int mid = (low + high) / 2;\n"
+"        if(file->lines[mid] <= pos)\n"
+"            low = mid + 1;\n"
+"        else\n"
+"            high = mid;\n"
+"    }\n"
+"\n"
+"    *line = file->line + low;\n"
+"    *col = (low == 0)? file->col + (int)pos: (int)(pos - file->lines[low - 1]) + 1;\n"
+"}\n"
+"\n"
+"// Read the next chunk of the file. The text before the first token that is\n"
+"// still needed is dropped first. Returns false at the end of the file.\n"
+"static bool fill_buffer(ScanFile* file) {\n"
+"\n"
+"    if(file->fp == NULL)\n"
+"        return false;\n"
+"\n"
+"    uint32_t drop = file->keep - file->base;\n"
+"    if(drop > 0) {\n"
+"        find_location(file, drop, &file->line, &file->col);\n"
+"        memmove(file->buffer, &file->buffer[drop], file->size - drop);\n"
+"        file->size -= drop;\n"
+"        file->base = file->keep;\n"
+"        file->num_lines = 0;\n"
+"        file->lines_end = 0;\n"
+"    }\n"
+"\n"
+"    if(file->size + SCAN_CHUNK > file->cap) {\n"
+"        while(file->size + SCAN_CHUNK > file->cap)\n"
+"            file->cap <<= 1;\n"
+"        // the extra byte is for token_str()\n"
+"        file->buffer = _REALLOC_ARRAY(file->buffer, char, file->cap + 1);\n"
+"    }\n"
+"\n"
+"    size_t len = fread(&file->buffer[file->size], 1, SCAN_CHUNK, file->fp);\n"
+"    file->size += len;\n"
+"    if(len == 0) {\n"
+"        fclose(file->fp);\n"
+"        file->fp = NULL;\n"
+"    }\n"
+"\n"
+"    return len > 0;\n"
+"}\n"
+"\n"
+"static void scanner_error(ScanState* scan, const char* fmt, ...) {\n"
+"\n"
+"    va_list args;\n"
+"    ScanFile* file = &scan->files[scan->input->file];\n"
+"    int line, col;\n"
+"\n"
+"    find_location(file, scan->input->pos - file->base, &line, &col);\n"
+"    fprintf(stderr, \"Scanner Error: %%s:%%d:%%d: \", file->name, line, col);\n"
+"    va_start(args, fmt);\n"
+"    vfprintf(stderr, fmt, args);\n"
+"    va_end(args);\n"
+"    fputc('\\n', stderr);\n"
+"    scan->errors++;\n"
+"}\n"
+"\n"
+"static bool scan_action(ScanState* scan, int rule);\n"
+"\n"
+"static Token* scan_token(ParserContext* ctx) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"    while(scan->input != NULL) {\n"
+"        ScanFile* file = &scan->files[scan->input->file];\n"
+"        uint32_t start = scan->input->pos - file->base;\n"
+"        if(start >= file->size) {\n"
+"            if(fill_buffer(file))\n"
+"                continue;\n"
+"\n"
+"            // the file is done, go back to the one that opened it\n"
+"            ScanInput* prev = scan->input->prev;\n"
+"            _FREE(scan->input);\n"
+"            scan->input = prev;\n"
+"            continue;\n"
+"        }\n"
+"\n"
+"        // run the DFA as far as it goes and keep the last accepting state\n"
+"        const unsigned char* buf = (const unsigned char*)file->buffer;\n"
+"        uint32_t end = start;\n"
+"        uint32_t i;\n"
+"        int state = 1;\n"
+"        int rule = 0;\n"
+"        for(i = start; i < file->size; i++) {\n"
+"            state = scan_next[scan_row[state]][scan_class[buf[i]]];\n"
+"            if(state == 0)\n"
+"                break;\n"
+"            if(scan_accept[state] != 0) {\n"
+"                rule = scan_accept[state];\n"
+"                end = i + 1;\n"
+"            }\n"
+"        }\n"
+"\n"
+"        // the match could go on in the next chunk, so scan it again\n"
+"        if(i == file->size && fill_buffer(file))\n"
+"            continue;\n"
+"\n"
+"#ifdef USE_REPARSE\n"
+"        // the byte that stopped the DFA was looked at too\n"
+"        uint32_t seen = file->base + ((i < file->size)? i + 1: i);\n"
+"        if(seen > scan->peek)\n"
+"            scan->peek = seen;\n"
+"#endif\n"
+"\n"
+"        if(rule == 0) {\n"
+"            if(isprint(buf[start]))\n"
+"                scanner_error(scan, \"unexpected character '%%c'\", buf[start]);\n"
+"            else\n"
+"                scanner_error(scan, \"unexpected character 0x%%02X\", buf[start]);\n"
+"            scan->input->pos++;\n"
+"            continue;\n"
+"        }\n"
+"\n"
+"        scan->token.offset = scan->input->pos;\n"
+"        scan->token.len = end - start;\n"
+"        scan->token.file = scan->input->file;\n"
+"        scan->input->pos += end - start;\n"
+"        if(scan_action(scan, rule)) {\n"
+"            Token* tok = create_token(ctx);\n"
+"            *tok = scan->token;\n"
+"            return tok;\n"
+"        }\n"
+"    }\n"
+"\n"
+"    if(scan->end_token == NULL) {\n"
+"        // the end of input is at the end of the last file, it is not in\n"
+"        // the arena because it is kept\n"
+"        scan->end_token = _ALLOC_T(Token);\n"
+"        memset(scan->end_token, 0, sizeof(Token));\n"
+"        scan->end_token->type = _TOK_END_OF_INPUT;\n"
+"        if(scan->num_files > 0) {\n"
+"            scan->end_token->file = scan->num_files - 1;\n"
+"            scan->end_token->offset = scan->files[scan->num_files - 1].base + scan->files[scan->num_files - 1].size;\n"
+"        }\n"
+"    }\n"
+"\n"
+"    return scan->end_token;\n"
+"}\n"
+"\n"
+"// Where the text of a token is in the buffer of its file, or -1 if it was\n"
+"// released.\n"
+"static int64_t token_pos(ScanState* scan, const Token* tok) {\n"
+"\n"
+"    if(tok->file >= scan->num_files)\n"
+"        return -1;\n"
+"\n"
+"    ScanFile* file = &scan->files[tok->file];\n"
+"    uint32_t pos = tok->offset - file->base;\n"
+"\n"
+"    return (pos <= file->size && file->buffer != NULL)? (int64_t)pos: -1;\n"
+"}\n"
+"\n"
+"#ifdef USE_REPARSE\n"
+"// Where the scan after the last token starts.\n"
+"static uint32_t scan_next_pos(ScanState* scan) {\n"
+"\n"
+"    if(scan->input != NULL)\n"
+"        return scan->input->pos;\n"
+"\n"
+"    ScanFile* file = &scan->files[scan->num_files - 1];\n"
+"    return file->base + file->size;\n"
+"}\n"
+"\n"
+"static void add_scan_entry(ScanState* scan, Token* tok) {\n"
+"\n"
+"    if(scan->num_toks + 1 > scan->cap_toks) {\n"
+"        scan->cap_toks = (scan->cap_toks > 0)? scan->cap_toks << 1: 1024;\n"
+"        scan->toks = (scan->toks == NULL)?\n"
+"                _ALLOC_ARRAY(ScanEntry, scan->cap_toks):\n"
+"                _REALLOC_ARRAY(scan->toks, ScanEntry, scan->cap_toks);\n"
+"    }\n"
+"\n"
+"    ScanEntry* entry = &scan->toks[scan->num_toks++];\n"
+"    entry->tok = tok;\n"
+"    entry->next = scan_next_pos(scan);\n"
+"    entry->reach = scan->peek;\n"
+"}\n"
+"#endif\n"
+"\n"
+"/*\n"
+"    Public Interface.\n"
+" */\n"
+"ScanState* create_scan_state() {\n"
+"\n"
+"    ScanState* scan = _ALLOC_T(ScanState);\n"
+"    memset(scan, 0, sizeof(ScanState));\n"
+"\n"
+"    return scan;\n"
+"}\n"
+"\n"
+"// Close the files and let go of their text and tokens, so that the state\n"
+"// can start a new parse. The tables of the state are kept.\n"
+"void reset_scan_state(ScanState* scan) {\n"
+"\n"
+"    while(scan->input != NULL) {\n"
+"        ScanInput* prev = scan->input->prev;\n"
+"        _FREE(scan->input);\n"
+"        scan->input = prev;\n"
+"    }\n"
+"\n"
+"    for(int i = 0; i < scan->num_files; i++) {\n"
+"        ScanFile* file = &scan->files[i];\n"
+"        if(file->fp != NULL)\n"
+"            fclose(file->fp);\n"
+"        if(file->lines != NULL)\n"
+"            _FREE(file->lines);\n"
+"        _FREE(file->buffer);\n"
+"        _FREE(file->name);\n"
+"    }\n"
+"\n"
+"    scan->num_files = 0;\n"
+"    scan->crnt = NULL;\n"
+"    scan->end_token = NULL;\n"
+"    scan->num_ungot = 0;\n"
+"    scan->tok_left = 0;\n"
+"#ifdef USE_REPARSE\n"
+"    scan->num_toks = 0;\n"
+"    scan->pos = 0;\n"
+"    scan->peek = 0;\n"
+"#endif\n"
+"}\n"
+"\n"
+"void destroy_scan_state(ScanState* scan) {\n"
+"\n"
+"    reset_scan_state(scan);\n"
+"    if(scan->files != NULL)\n"
+"        _FREE(scan->files);\n"
+"    if(scan->ungot != NULL)\n"
+"        _FREE(scan->ungot);\n"
+"#ifdef USE_REPARSE\n"
+"    if(scan->toks != NULL)\n"
+"        _FREE(scan->toks);\n"
+"#endif\n"
+"    _FREE(scan);\n"
+"}\n"
+"\n"
+"Token* create_token(ParserContext* ctx) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"    if(scan->tok_left == 0) {\n"
+"        scan->tok_block = PARSE_ALLOC_ARRAY(ctx, Token, TOKEN_BLOCK);\n"
+"        scan->tok_left = TOKEN_BLOCK;\n"
+"    }\n"
+"\n"
+"    Token* tok = &scan->tok_block[TOKEN_BLOCK - scan->tok_left--];\n"
+"    memset(tok, 0, sizeof(Token));\n"
+"\n"
+"    return tok;\n"
+"}\n"
+"\n"
+"// Push a file on the input stack. The tokens of the file come after the\n"
+"// current token.\n"
+"void open_file(ParserContext* ctx, const char* fname) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"    FILE* fp = fopen(fname, \"rb\");\n"
+"    if(fp == NULL || scan->num_files >= UINT16_MAX) {\n"
+"        fprintf(stderr, \"Fatal error: cannot open input file: %%s\\n\", fname);\n"
+"        exit(1);\n"
+"    }\n"
+"\n"
+"    if(scan->files == NULL) {\n"
+"        scan->cap_files = 8;\n"
+"        scan->files = _ALLOC_ARRAY(ScanFile, scan->cap_files);\n"
+"    }\n"
+"    else if(scan->num_files + 1 > scan->cap_files) {\n"
+"        scan->cap_files <<= 1;\n"
+"        scan->files = _REALLOC_ARRAY(scan->files, ScanFile, scan->cap_files);\n"
+"    }\n"
+"\n"
+"    ScanFile* file = &scan->files[scan->num_files];\n"
+"    memset(file, 0, sizeof(ScanFile));\n"
+"    file->cap = SCAN_CHUNK;\n"
+"    file->buffer = _ALLOC_ARRAY(char, file->cap + 1);\n"
+"    file->fp = fp;\n"
+"    file->name = _DUP_STR(fname);\n"
+"    file->line = 1;\n"
+"    file->col = 1;\n"
+"\n"
+"    // a file that is opened when no input is left starts a new parse\n"
+"    if(scan->input == NULL) {\n"
+"        scan->crnt = NULL;\n"
+"        scan->end_token = NULL;\n"
+"        scan->num_ungot = 0;\n"
+"        scan->tok_left = 0;\n"
+"#ifdef USE_REPARSE\n"
+"        scan->num_toks = 0;\n"
+"        scan->pos = 0;\n"
+"        scan->peek = 0;\n"
+"#endif\n"
+"    }\n"
+"\n"
+"    ScanInput* ptr = _ALLOC_T(ScanInput);\n"
+"    ptr->file = scan->num_files++;\n"
+"    ptr->pos = 0;\n"
+"    ptr->prev = scan->input;\n"
+"    scan->input = ptr;\n"
+"}\n"
+"\n"
+"Token* get_token(ParserContext* ctx) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"#ifdef USE_REPARSE\n"
+"    // the tokens are kept by position, so the parser moves over them\n"
+"    if(scan->pos < scan->num_toks)\n"
+"        return scan->toks[scan->pos].tok;\n"
+"\n"
+"    Token* tok = scan_token(ctx);\n"
+"    if(tok != scan->end_token)\n"
+"        add_scan_entry(scan, tok);\n"
+"\n"
+"    return tok;\n"
+"#else\n"
+"    if(scan->num_ungot > 0)\n"
+"        return scan->ungot[scan->num_ungot - 1];\n"
+"\n"
+"    if(scan->crnt == NULL)\n"
+"        scan->crnt = scan_token(ctx);\n"
+"\n"
+"    return scan->crnt;\n"
+"#endif\n"
+"}\n"
+"\n"
+"void unget_token(ParserContext* ctx, Token* tok) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"#ifdef USE_REPARSE\n"
+"    // the token is the one before the position\n"
+"    (void)tok;\n"
+"    scan->pos--;\n"
+"#else\n"
+"    if(scan->ungot == NULL) {\n"
+"        scan->cap_ungot = 16;\n"
+"        scan->ungot = _ALLOC_ARRAY(Token*, scan->cap_ungot);\n"
+"    }\n"
+"    else if(scan->num_ungot + 1 > scan->cap_ungot) {\n"
+"        scan->cap_ungot <<= 1;\n"
+"        scan->ungot = _REALLOC_ARRAY(scan->ungot, Token*, scan->cap_ungot);\n"
+"    }\n"
+"    scan->ungot[scan->num_ungot++] = tok;\n"
+"#endif\n"
+"}\n"
+"\n"
+"void consume_token(ParserContext* ctx) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"#ifdef USE_REPARSE\n"
+"    if(scan->pos == scan->num_toks)\n"
+"        get_token(ctx);\n"
+"    if(scan->pos < scan->num_toks)\n"
+"        scan->pos++;\n"
+"#else\n"
+"    if(scan->num_ungot > 0)\n"
+"        scan->num_ungot--;\n"
+"    else\n"
+"        scan->crnt = scan_token(ctx);\n"
+"#endif\n"
+"}\n"
+"\n"
+"// The tokens that were consumed are not used again. Their text can be\n"
+"// dropped the next time that a buffer is filled. The location and text of\n"
+"// those tokens are not known after that. With an arena, the arena is\n"
+"// reset and the tokens that are still needed are copied into it again.\n"
+"// With USE_REPARSE every token is kept for the next parse, so nothing is\n"
+"// released.\n"
+"void release_tokens(ParserContext* ctx) {\n"
+"\n"
+"#ifdef USE_REPARSE\n"
+"    (void)ctx;\n"
+"#else\n"
+"    ScanState* scan = ctx->scan;\n"
+"#ifdef USE_ARENA\n"
+"    Token* kept = _ALLOC_ARRAY(Token, scan->num_ungot + 1);\n"
+"    for(int i = 0; i <= scan->num_ungot; i++) {\n"
+"        Token* tok = (i < scan->num_ungot)? scan->ungot[i]: scan->crnt;\n"
+"        if(tok != NULL)\n"
+"            kept[i] = *tok;\n"
+"    }\n"
+"\n"
+"    arena_reset(ctx);\n"
+"    scan->tok_left = 0;\n"
+"    for(int i = 0; i <= scan->num_ungot; i++) {\n"
+"        Token** ptr = (i < scan->num_ungot)? &scan->ungot[i]: &scan->crnt;\n"
+"        if(*ptr != NULL && *ptr != scan->end_token) {\n"
+"            *ptr = create_token(ctx);\n"
+"            **ptr = kept[i];\n"
+"        }\n"
+"    }\n"
+"    _FREE(kept);\n"
+"#endif\n"
+"\n"
+"    for(int i = 0; i < scan->num_files; i++)\n"
+"        scan->files[i].keep = scan->files[i].base + scan->files[i].size;\n"
+"    for(ScanInput* ptr = scan->input; ptr != NULL; ptr = ptr->prev)\n"
+"        scan->files[ptr->file].keep = ptr->pos;\n"
+"\n"
+"    for(int i = 0; i <= scan->num_ungot; i++) {\n"
+"        Token* tok = (i < scan->num_ungot)? scan->ungot[i]: scan->crnt;\n"
+"        if(tok == NULL || tok == scan->end_token)\n"
+"            continue;\n"
+"        ScanFile* file = &scan->files[tok->file];\n"
+"        if(tok->offset - file->base < file->keep - file->base)\n"
+"            file->keep = tok->offset;\n"
+"    }\n"
+"#endif\n"
+"}\n"
+"\n"
+"#ifdef USE_REPARSE\n"
+"// Step over tokens that were scanned before, for a tree that is used again.\n"
+"void skip_tokens(ParserContext* ctx, int num) {\n"
+"\n"
+"    ctx->scan->pos += num;\n"
+"}\n"
+"\n"
+"// Apply the edits to the text and scan it again from the first token that\n"
+"// the scanner made after it looked at an edited byte, until a scan starts\n"
+"// after the edits where an old one did. The tokens before that are kept,\n"
+"// and so are the ones after it, which are moved. The tokens from first to\n"
+"// old_end are replaced by the ones from first to new_end. The edits are in\n"
+"// the order of the text and do not overlap. Only the whole text of one file\n"
+"// can be edited.\n"
+"void edit_tokens(ParserContext* ctx, const TextEdit* edits, int num, int* first, int* old_end, int* new_end) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"    if(scan->num_files != 1 || scan->files[0].base != 0) {\n"
+"        fprintf(stderr, \"Fatal error: only the whole text of one file can be edited\\n\");\n"
+"        exit(1);\n"
+"    }\n"
+"\n"
+"    ScanFile* file = &scan->files[0];\n"
+"    while(fill_buffer(file))\n"
+"        ;\n"
+"\n"
+"    scan->pos = 0;\n"
+"    *first = *old_end = *new_end = scan->num_toks;\n"
+"    if(num == 0)\n"
+"        return;\n"
+"\n"
+"    // the edits are merged into one, from the start of the first to the\n"
+"    // end of the last\n"
+"    uint32_t start = edits[0].offset;\n"
+"    uint32_t end = start;\n"
+"    uint32_t len = 0;\n"
+"    for(int i = 0; i < num; i++) {\n"
+"        if(edits[i].offset < end || edits[i].offset + edits[i].len > file->size) {\n"
+"            fprintf(stderr, \"Fatal error: edit %%d is out of order or past the end of the text\\n\", i);\n"
+"            exit(1);\n"
+"        }\n"
+"        len += (edits[i].offset - end) + edits[i].text_len;\n"
+"        end = edits[i].offset + edits[i].len;\n"
+"    }\n"
+"\n"
+"    char* text = _ALLOC_ARRAY(char, len + 1);\n"
+"    uint32_t n = 0;\n"
+"    end = start;\n"
+"    for(int i = 0; i < num; i++) {\n"
+"        memcpy(&text[n], &file->buffer[end], edits[i].offset - end);\n"
+"        n += edits[i].offset - end;\n"
+"        if(edits[i].text_len > 0)\n"
+"            memcpy(&text[n], edits[i].text, edits[i].text_len);\n"
+"        n += edits[i].text_len;\n"
+"        end = edits[i].offset + edits[i].len;\n"
+"    }\n"
+"\n"
+"    int64_t delta = (int64_t)len - (int64_t)(end - start);\n"
+"    if(file->size + delta > file->cap) {\n"
+"        while(file->size + delta > file->cap)\n"
+"            file->cap <<= 1;\n"
+"        file->buffer = _REALLOC_ARRAY(file->buffer, char, file->cap + 1);\n"
+"    }\n"
+"    memmove(&file->buffer[start + len], &file->buffer[end], file->size - end);\n"
+"    memcpy(&file->buffer[start], text, len);\n"
+"    file->size += delta;\n"
+"    file->num_lines = 0;\n"
+"    file->lines_end = 0;\n"
+"    _FREE(text);\n"
+"\n"
+"    // the first token that the scanner made after it looked at the edit\n"
+"    int low = 0;\n"
+"    int high = scan->num_toks;\n"
+"    while(low < high) {\n"
+"        int mid = (low + high) / 2;\n"
+"        if(scan->toks[mid].reach > start)\n"
+"            high = mid;\n"
+"        else\n"
+"            low = mid + 1;\n"
+"    }\n"
+"\n"
+"    // the scan starts again where the token before it ended\n"
+"    uint32_t lazy = (scan->input != NULL)? scan->input->pos: UINT32_MAX;\n"
+"    uint32_t peek = scan->peek;\n"
+"    if(scan->input == NULL) {\n"
+"        scan->input = _ALLOC_T(ScanInput);\n"
+"        scan->input->file = 0;\n"
+"        scan->input->prev = NULL;\n"
+"    }\n"
+"    scan->input->pos = (low > 0)? scan->toks[low - 1].next: 0;\n"
+"    scan->peek = (low > 0)? scan->toks[low - 1].reach: 0;\n"
+"    scan->end_token = NULL;\n"
+"\n"
+"    // The new tokens are scanned until a scan ends where an old one did,\n"
+"    // after the edits. The old tokens from there on are what the scanner\n"
+"    // would make again. If the old tokens run out first, then the rest is\n"
+"    // scanned when the parser gets to it.\n"
+"    ScanEntry* fresh = NULL;\n"
+"    int num_fresh = 0;\n"
+"    int cap_fresh = 0;\n"
+"    int old = low;\n"
+"    bool synced = false;\n"
+"    while(true) {\n"
+"        uint32_t pos = scan_next_pos(scan);\n"
+"        while(old < scan->num_toks && (int64_t)scan->toks[old].next + delta < pos)\n"
+"            old++;\n"
+"        if(old == scan->num_toks || scan->input == NULL)\n"
+"            break;\n"
+"        if(scan->toks[old].next >= end && (int64_t)scan->toks[old].next + delta == pos) {\n"
+"            synced = true;\n"
+"            break;\n"
+"        }\n"
+"\n"
+"        Token* tok = scan_token(ctx);\n"
+"        if(tok == scan->end_token)\n"
+"            break;\n"
+"\n"
+"        if(num_fresh + 1 > cap_fresh) {\n"
+"            cap_fresh = (cap_fresh > 0)? cap_fresh << 1: 64;\n"
+"            fresh = (fresh == NULL)?\n"
+"                    _ALLOC_ARRAY(ScanEntry, cap_fresh):\n"
+"                    _REALLOC_ARRAY(fresh, ScanEntry, cap_fresh);\n"
+"        }\n"
+"        fresh[num_fresh].tok = tok;\n"
+"        fresh[num_fresh].next = scan_next_pos(scan);\n"
+"        fresh[num_fresh].reach = scan->peek;\n"
+"        num_fresh++;\n"
+"    }\n"
+"\n"
+"    int tail = synced? old + 1: scan->num_toks;\n"
+"    int count = low + num_fresh + (scan->num_toks - tail);\n"
+"    if(count > scan->cap_toks) {\n"
+"        while(count > scan->cap_toks)\n"
+"            scan->cap_toks <<= 1;\n"
+"        scan->toks = _REALLOC_ARRAY(scan->toks, ScanEntry, scan->cap_toks);\n"
+"    }\n"
+"    memmove(&scan->toks[low + num_fresh], &scan->toks[tail], sizeof(ScanEntry) * (scan->num_toks - tail));\n"
+"    if(num_fresh > 0) {\n"
+"        memcpy(&scan->toks[low], fresh, sizeof(ScanEntry) * num_fresh);\n"
+"        _FREE(fresh);\n"
+"    }\n"
+"\n"
+"    // the tokens after the edits are the same, they are only moved\n"
+"    uint32_t reach = scan->peek;\n"
+"    for(int i = low + num_fresh; i < count; i++) {\n"
+"        ScanEntry* entry = &scan->toks[i];\n"
+"        entry->tok->offset += delta;\n"
+"        entry->next += delta;\n"
+"        entry->reach += delta;\n"
+"        if(entry->reach < reach)\n"
+"            entry->reach = reach;\n"
+"        reach = entry->reach;\n"
+"    }\n"
+"\n"
+"    if(synced) {\n"
+"        // the scan goes on from where the old one was\n"
+"        if(lazy == UINT32_MAX) {\n"
+"            _FREE(scan->input);\n"
+"            scan->input = NULL;\n"
+"        }\n"
+"        else\n"
+"            scan->input->pos = lazy + delta;\n"
+"        if(peek + delta > scan->peek)\n"
+"            scan->peek = peek + delta;\n"
+"    }\n"
+"\n"
+"    scan->num_toks = count;\n"
+"    *first = low;\n"
+"    *old_end = tail;\n"
+"    *new_end = low + num_fresh;\n"
+"}\n"
+"#endif\n"
+"\n"
+"const char* token_fname(ParserContext* ctx, const Token* tok) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"    return (tok->file < scan->num_files)? scan->files[tok->file].name: \"\";\n"
+"}\n"
+"\n"
+"int token_line(ParserContext* ctx, const Token* tok) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"    int line = 0, col = 0;\n"
+"    int64_t pos = token_pos(scan, tok);\n"
+"    if(pos >= 0)\n"
+"        find_location(&scan->files[tok->file], pos, &line, &col);\n"
+"\n"
+"    return line;\n"
+"}\n"
+"\n"
+"int token_col(ParserContext* ctx, const Token* tok) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"    int line = 0, col = 0;\n"
+"    int64_t pos = token_pos(scan, tok);\n"
+"    if(pos >= 0)\n"
+"        find_location(&scan->files[tok->file], pos, &line, &col);\n"
+"\n"
+"    return col;\n"
+"}\n"
+"\n"
+"// The text is not terminated, it is len characters long.\n"
+"const char* token_text(ParserContext* ctx, const Token* tok) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"    int64_t pos = token_pos(scan, tok);\n"
+"\n"
+"    return (pos >= 0)? &scan->files[tok->file].buffer[pos]: \"\";\n"
+"}\n"
+"\n"
+"// The text is copied out of the buffer in one piece.\n"
+"Str* token_str(ParserContext* ctx, const Token* tok) {\n"
+"\n"
+"    ScanState* scan = ctx->scan;\n"
+"    int64_t pos = token_pos(scan, tok);\n"
+"    if(pos < 0)\n"
+"        return create_string(NULL);\n"
+"\n"
+"    char* buf = scan->files[tok->file].buffer;\n"
+"    uint32_t end = pos + tok->len;\n"
+"    char save = buf[end];\n"
+"    buf[end] = '\\0';\n"
+"    Str* str = create_string(&buf[pos]);\n"
+"    buf[end] = save;\n"
+"\n"
+"    return str;\n"
+"}\n"
+"\n";
+
+static const char* table_type(int max) {
+
+    return (max < 256) ? "uint8_t" : "uint16_t";
+}
+
+static void emit_numbers(FILE* fp, int* list, int len, const char* indent) {
+
+    for(int i = 0; i < len; i++)
+        fprintf(fp, "%s%d,%s", (i % 16 == 0) ? indent : " ", list[i],
+                (i % 16 == 15 || i == len - 1) ? "\n" : "");
+}
+
+/*
+ * The bytes are mapped to their class, and the states to their row of the
+ * transition table. States that have the same transitions share a row.
+ */
+static void emit_tables(FILE* fp, Dfa* dfa) {
+
+    int classes = dfa->num_classes;
+    int* row = _ALLOC_ARRAY(int, dfa->num_states);
+    int* first = _ALLOC_ARRAY(int, dfa->num_states); // the first state of a row
+    int num_rows = 0;
+
+    for(int s = 0; s < dfa->num_states; s++) {
+        int r;
+        for(r = 0; r < num_rows; r++)
+            if(!memcmp(&dfa->next[first[r] * classes], &dfa->next[s * classes],
+                       sizeof(int) * classes))
+                break;
+        if(r == num_rows)
+            first[num_rows++] = s;
+        row[s] = r;
+    }
+
+    LOG(SCLEVEL, "scanner: %d states, %d byte classes, %d rows", dfa->num_states, classes,
+        num_rows);
+
+    int byte_class[256];
+    for(int i = 0; i < 256; i++)
+        byte_class[i] = dfa->byte_class[i];
+
+    fprintf(fp, "// scanner DFA: %d states, %d byte classes, %d distinct rows\n",
+            dfa->num_states, classes, num_rows);
+    fprintf(fp, "static const uint8_t scan_class[256] = {\n");
+    emit_numbers(fp, byte_class, 256, "    ");
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "static const %s scan_row[%d] = {\n", table_type(num_rows), dfa->num_states);
+    emit_numbers(fp, row, dfa->num_states, "    ");
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "static const %s scan_next[%d][%d] = {\n", table_type(dfa->num_states),
+            num_rows, classes);
+    for(int r = 0; r < num_rows; r++) {
+        fprintf(fp, "    {\n");
+        emit_numbers(fp, &dfa->next[first[r] * classes], classes, "        ");
+        fprintf(fp, "    },\n");
+    }
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "// the rule that a state accepts plus 1, or 0\n");
+    fprintf(fp, "static const %s scan_accept[%d] = {\n",
+            table_type(length_list(parser_state->scan_rules) + 1), dfa->num_states);
+    emit_numbers(fp, dfa->accept, dfa->num_states, "    ");
+    fprintf(fp, "};\n");
+
+    _FREE(row);
+    _FREE(first);
+}
+
+/*
+ * One case per scanner rule. The code block of the rule runs after the
+ * token is filled in. A rule without a name is skipped.
+ */
+static void emit_actions(FILE* fp) {
+
+    fprintf(fp, "// Run the action of the rule that matched. Returns false if the match\n");
+    fprintf(fp, "// is skipped.\n");
+    fprintf(fp, "static bool scan_action(ScanState* scan, int rule) {\n\n");
+    fprintf(fp, "// the actions change the token of the state by this name\n");
+    fprintf(fp, "#define token (scan->token)\n\n");
+    fprintf(fp, "    switch(rule) {\n");
+
+    int idx = 1;
+    ScanRule* rule;
+    ScanRuleListIter* srli = init_list_iterator(parser_state->scan_rules);
+    while(iterate_list(srli, &rule)) {
+        const char* name = (rule->name != NULL) ? raw_string(rule->name) : NULL;
+        fprintf(fp, "        case %d: // %s\n", idx++, (name != NULL) ? name : "skipped");
+        if(name != NULL)
+            fprintf(fp, "            token.type = _TOK_%s;\n", name);
+        if(rule->code != NULL)
+            fprintf(fp, "            %s\n", raw_string(rule->code));
+        fprintf(fp, "            return %s;\n", (name != NULL) ? "true" : "false");
+    }
+
+    fprintf(fp, "        default:\n");
+    fprintf(fp, "            return false;\n");
+    fprintf(fp, "    }\n\n");
+    fprintf(fp, "#undef token\n");
+    fprintf(fp, "}\n\n");
+}
+
+static void emit_tok_to_str(FILE* fp) {
+
+    fprintf(fp, "const char* tok_to_str(TokenType type) {\n\n");
+    fprintf(fp, "    switch(type) {\n");
+
+    Terminal* term;
+    TermListIter* tli = init_list_iterator(parser_state->terminals);
+    while(iterate_list(tli, &term))
+        fprintf(fp, "        case _TOK_%s: return \"%s\";\n", raw_string(term->name),
+                raw_string(term->name));
+
+    fprintf(fp, "        case _TOK_END_OF_INPUT: return \"END OF INPUT\";\n");
+    fprintf(fp, "        default: return \"UNKNOWN\";\n");
+    fprintf(fp, "    }\n");
+    fprintf(fp, "}\n");
+}
+
+/*
+ * Public Interface
+ */
+void emit_scanner(FILE* fp, Parser* pstate) {
+
+    LOG(SCLEVEL, "ENTER: emit scanner");
+
+    parser_state = pstate;
+
+    fprintf(fp, "#include <stdarg.h>\n");
+    fprintf(fp, "#include <ctype.h>\n\n");
+
+    emit_tables(fp, pstate->dfa);
+    fprintf(fp, scanner_string);
+    emit_actions(fp);
+    emit_tok_to_str(fp);
+
+    LOG(SCLEVEL, "LEAVE: emit scanner");
+}
@@ -0,0 +1,13 @@
+/*
+ * Scanner emitter. When the grammar has a %scanner section, the DFA that
+ * the scanner generator built is written to <name>_scanner.c as tables,
+ * with the code that runs it and the actions of the scanner rules.
+ */
+#ifndef _EMIT_SCANNER_H
+#define _EMIT_SCANNER_H
+
+#include "parser.h"
+
+void emit_scanner(FILE* fp, Parser* pstate);
+
+#endif /* _EMIT_SCANNER_H */
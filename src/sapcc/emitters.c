@@ -1,5 +1,10 @@
 
 #include "parser.h"
+#include "analysis.h"
+#include "emit_direct.h"
+#include "emit_scanner.h"
+#include "factor.h"
+#include "precedence.h"
 #include "emitters.h"
 #include "paths.h"
 #include "logger.h"
@@ -9,6 +14,12 @@
 typedef struct {
     Str* base;
     Parser* pstate;
+    bool compress;          // pack the tables of the table backend
+    const char* table_type; // the type of the parser table entries
+    int entry_size;         // the bytes of one parser table entry
+    int* rule_size;         // the entries of each non-terminal in the parser table
+    int* line_offset;       // where each line is in the parser table, in the
+                            // order of the line table
 } Emitters;
 
 static Emitters* emitters;
@@ -53,7 +64,7 @@ static void source_post(FILE* fp) {
     fclose(fp);
 }
 
-static FILE* source_pre(const char* name) {
+static FILE* source_open(const char* name) {
 
     char buffer[1024];
     char* p;
@@ -65,10 +76,31 @@ static FILE* source_pre(const char* name) {
 
     FILE* fp = fopen(buffer, "w");
     opening(fp);
+    return fp;
+}
+
+static FILE* source_pre(const char* name) {
+
+    FILE* fp = source_open(name);
     fprintf(fp, "#include \"util.h\"\n\n");
     return fp;
 }
 
+/*
+ * A source file that starts threads. With the GC, the threads are created
+ * through it so that it can find them.
+ */
+static FILE* thread_source_pre(const char* name) {
+
+    FILE* fp = source_open(name);
+    fprintf(fp, "#ifdef USE_GC\n");
+    fprintf(fp, "#define GC_THREADS\n");
+    fprintf(fp, "#include \"gc.h\"\n");
+    fprintf(fp, "#endif\n");
+    fprintf(fp, "#include \"util.h\"\n");
+    return fp;
+}
+
 static void init_emitters(Parser* pstate) {
 
     emitters = _ALLOC_T(Emitters);
@@ -84,9 +116,23 @@ static void init_emitters(Parser* pstate) {
     }
     FINAL
 
+    emitters->compress = get_cmd_int(cmd, "compress") ? true : false;
+
     LOG(ELEVEL, "using the output name: %s\n", raw_string(emitters->base));
 }
 
+static void emit_scanner_c() {
+
+    if(emitters->pstate->dfa == NULL)
+        return;
+
+    FILE* fp = source_pre("_scanner");
+    fprintf(fp, "#include \"%s_scanner.h\"\n", raw_string(emitters->base));
+    fprintf(fp, "#include \"%s_ast.h\"\n", raw_string(emitters->base));
+    emit_scanner(fp, emitters->pstate);
+    source_post(fp);
+}
+
 static void emit_scanner_h() {
 
     FILE* fp = header_pre("_scanner");
@@ -96,124 +142,835 @@ static void emit_scanner_h() {
     fprintf(fp, "typedef enum {\n");
     while(iterate_list(tli, &term))
         fprintf(fp, "    _TOK_%s = %d,\n", raw_string(term->name), term->val);
+    fprintf(fp, "    _TOK_END_OF_INPUT = %d,\n", BASE_TERM + get_num_term());
     fprintf(fp, "} TokenType;\n\n");
 
+    fprintf(fp, "// The text of a token is a slice of the file that it came from. The line\n");
+    fprintf(fp, "// and column are found from the offset when they are needed.\n");
     fprintf(fp, "typedef struct {\n");
-    fprintf(fp, "    Str* str;\n");
-    fprintf(fp, "    TokenType type;\n");
-    fprintf(fp, "    int line_no;\n");
-    fprintf(fp, "    int col_no;\n");
-    fprintf(fp, "    Str* fname;\n");
+    fprintf(fp, "    uint32_t offset;   // where the text starts in the file\n");
+    fprintf(fp, "    uint32_t len;      // length of the text\n");
+    fprintf(fp, "    uint16_t type;     // the TokenType\n");
+    fprintf(fp, "    uint16_t file;     // index of the file in the file table\n");
     fprintf(fp, "} Token;\n\n");
 
-    fprintf(fp, "extern Token token;\n\n");
+    fprintf(fp, "// The state of a parse is kept in a ParserContext, declared in the\n");
+    fprintf(fp, "// _ast.h file. The ScanState is the part of it that the scanner keeps.\n");
+    fprintf(fp, "typedef struct _parser_context_ ParserContext;\n");
+    fprintf(fp, "typedef struct _scan_state_ ScanState;\n\n");
 
     fprintf(fp, "/*\n    Public Interface.\n */\n");
-    fprintf(fp, "Token* create_token();\n");
-    fprintf(fp, "void open_file(const char* fname);\n");
-    fprintf(fp, "Token* get_token();\n");
-    fprintf(fp, "void unget_token(Token* tok);\n");
-    fprintf(fp, "void consume_token();\n");
-    fprintf(fp, "int get_line_no();\n");
-    fprintf(fp, "int get_col_no();\n");
-    fprintf(fp, "const char* get_fname();\n");
+    fprintf(fp, "ScanState* create_scan_state();\n");
+    fprintf(fp, "void reset_scan_state(ScanState* scan);\n");
+    fprintf(fp, "void destroy_scan_state(ScanState* scan);\n");
+    fprintf(fp, "Token* create_token(ParserContext* ctx);\n");
+    fprintf(fp, "void open_file(ParserContext* ctx, const char* fname);\n");
+    fprintf(fp, "Token* get_token(ParserContext* ctx);\n");
+    fprintf(fp, "void unget_token(ParserContext* ctx, Token* tok);\n");
+    fprintf(fp, "void consume_token(ParserContext* ctx);\n");
+    fprintf(fp, "const char* token_fname(ParserContext* ctx, const Token* tok);\n");
+    fprintf(fp, "int token_line(ParserContext* ctx, const Token* tok);\n");
+    fprintf(fp, "int token_col(ParserContext* ctx, const Token* tok);\n");
+    fprintf(fp, "const char* token_text(ParserContext* ctx, const Token* tok);\n");
+    fprintf(fp, "Str* token_str(ParserContext* ctx, const Token* tok);\n");
+    fprintf(fp, "void release_tokens(ParserContext* ctx);\n");
     fprintf(fp, "const char* tok_to_str(TokenType type);\n\n");
 
+    fprintf(fp, "// Built with USE_REPARSE, the tokens are kept by position so that an\n");
+    fprintf(fp, "// edit of the text only scans the tokens that it can change again.\n");
+    fprintf(fp, "#ifdef USE_REPARSE\n");
+    fprintf(fp, "// An edit replaces len bytes of the text at offset with text_len bytes.\n");
+    fprintf(fp, "typedef struct {\n");
+    fprintf(fp, "    uint32_t offset;\n");
+    fprintf(fp, "    uint32_t len;\n");
+    fprintf(fp, "    const char* text;\n");
+    fprintf(fp, "    uint32_t text_len;\n");
+    fprintf(fp, "} TextEdit;\n\n");
+    fprintf(fp, "void skip_tokens(ParserContext* ctx, int num);\n");
+    fprintf(fp, "void edit_tokens(ParserContext* ctx, const TextEdit* edits, int num, int* first, int* old_end, int* new_end);\n");
+    fprintf(fp, "#endif\n\n");
+
     header_post(fp);
 }
 
-static bool is_a_terminal(Str* str) {
+static void emit_name(FILE* fp, int id) {
 
-    Terminal* term;
-    TermListIter* tli = init_list_iterator(emitters->pstate->terminals);
-    while(iterate_list(tli, &term))
-        if(!comp_string(term->name, str))
-            return true;
+    Symbol* sym = get_symbol_by_id(emitters->pstate->symbols, id);
 
-    return false;
+    if(sym->term != NULL)
+        fprintf(fp, "_TOK_%s", raw_string(sym->name));
+    else
+        fprintf(fp, "_nterm_%s", raw_string(sym->name));
 }
 
-static void emit_name(FILE* fp, Str* str) {
+/*
+ * The smallest unsigned type that holds every value up to max.
+ */
+static const char* entry_type(int max) {
 
-    if(is_a_terminal(str))
-        fprintf(fp, "_TOK_%s", raw_string(str));
-    else
-        fprintf(fp, "_nterm_%s", raw_string(str));
+    return (max <= 0xff)? "uint8_t": (max <= 0xffff)? "uint16_t": "uint32_t";
+}
+
+static int entry_bytes(int max) {
+
+    return (max <= 0xff)? 1: (max <= 0xffff)? 2: 4;
 }
 
-static int get_rule_size(NonTerminal* nterm) {
+int get_rule_size(NonTerminal* nterm) {
 
-    int value = 4;
+    int value = 6;
 
     Rule* rule;
     RuleListIter* riter = init_list_iterator(nterm->list);
     while(iterate_list(riter, &rule))
-        value += length_list(rule->list) + 1;
+        value += rule->len + 1;
+
+    // the tails do not include the leading recursive symbol
+    riter = init_list_iterator(nterm->tails);
+    while(iterate_list(riter, &rule))
+        value += rule->len;
 
-    return value;
+    return value + factor_tree_size(nterm->tree) + factor_tree_size(nterm->tail_tree);
+}
+
+/*
+ * The lines that are stored in this rule. A line that is stored in an
+ * earlier rule is left out, and line and offset count the lines and the
+ * entries so far.
+ */
+static void emit_rule_lines(FILE* fp, RuleList* list, int skip, int* line, int* offset) {
+
+    Rule* rule;
+    RuleListIter* riter = init_list_iterator(list);
+    while(iterate_list(riter, &rule)) {
+        if(emitters->line_offset[(*line)++] < *offset)
+            continue;
+        *offset += rule->len - skip + 1;
+
+        fprintf(fp, ",\n        %d, ", rule->len - skip);
+        emit_name(fp, rule->list[skip]);
+
+        for(int i = skip + 1; i < rule->len; i++) {
+            fprintf(fp, ", ");
+            emit_name(fp, rule->list[i]);
+        }
+    }
+}
+
+/*
+ * Each node of the factored tree is its size, the symbol that it matches,
+ * the line that ends there plus 1, and the number of branches, followed by
+ * the branches.
+ */
+static void emit_factor_tree(FILE* fp, Factor* tree, int depth) {
+
+    fprintf(fp, ",\n        %*s%d, ", depth * 2, "", factor_tree_size(tree));
+    if(tree->sym < 0)
+        fprintf(fp, "0");
+    else
+        emit_name(fp, tree->sym);
+    fprintf(fp, ", %d, %d", tree->end, tree->num);
+
+    for(int i = 0; i < tree->num; i++)
+        emit_factor_tree(fp, tree->next[i], depth + 1);
+}
+
+static const char* rule_flags(NonTerminal* nterm) {
+
+    static char flags[64];
+
+    flags[0] = '\0';
+    if(nterm->lr_head)
+        strcat(flags, "|RULE_LR_HEAD");
+    if(nterm->oper != NULL)
+        strcat(flags, "|RULE_OPERATOR");
+    if(nterm->profiled)
+        strcat(flags, "|RULE_HOT_FIRST");
+
+    return (flags[0] != '\0') ? &flags[1] : "0";
+}
+
+/*
+ * The operator chains by number. Each one belongs to the level that it
+ * starts at.
+ */
+static OperChain** get_chains(NonTermList* list) {
+
+    OperChain** chains = _ALLOC_ARRAY(OperChain*, get_num_chains() + 1);
+
+    NonTerminal* nterm;
+    NonTermListIter* ntiter = init_list_iterator(list);
+    while(iterate_list(ntiter, &nterm))
+        if(nterm->oper != NULL && nterm->oper->index == 0)
+            chains[nterm->oper->chain->id] = nterm->oper->chain;
+
+    return chains;
+}
+
+/*
+ * Every operator chain is its number, the operand of its last level, the
+ * number of levels, and then the type, the line of X : Y and if it is right
+ * associative for each level. The operators of the chain map each token to
+ * its level plus one, 0 when it is not an operator, and its line. The
+ * offset of every chain in the table is in offset.
+ */
+static void emit_climb_tables(FILE* fp, OperChain** chains, int* offset) {
+
+    int num_terms = get_num_term() + 1;
+    int pos = 0;
+
+    fprintf(fp, "static const uint16_t climb_table[] = {\n");
+    for(int i = 0; i < get_num_chains(); i++) {
+        OperChain* chain = chains[i];
+        offset[i] = pos;
+        fprintf(fp, "    %d, ", chain->id);
+        emit_name(fp, chain->operand);
+        fprintf(fp, ", %d,", chain->num);
+        for(int j = 0; j < chain->num; j++)
+            fprintf(fp, " _nterm_%s,", raw_string(chain->levels[j]->name));
+        for(int j = 0; j < chain->num; j++)
+            fprintf(fp, " %d,", chain->levels[j]->oper->base_alt);
+        for(int j = 0; j < chain->num; j++)
+            fprintf(fp, " %d,", chain->levels[j]->oper->right ? 1 : 0);
+        fprintf(fp, "\n");
+        pos += 3 + 3 * chain->num;
+    }
+    fprintf(fp, "};\n\n");
+
+    int* level = _ALLOC_ARRAY(int, num_terms);
+    int* alt = _ALLOC_ARRAY(int, num_terms);
+
+    fprintf(fp, "static const uint16_t climb_ops[NUM_CHAIN][NUM_TERM + 1][2] = {\n");
+    for(int i = 0; i < get_num_chains(); i++) {
+        OperChain* chain = chains[i];
+        memset(level, 0, sizeof(int) * num_terms);
+        memset(alt, 0, sizeof(int) * num_terms);
+        for(int j = 0; j < chain->num; j++) {
+            OperLevel* oper = chain->levels[j]->oper;
+            for(int k = 0; k < oper->num; k++) {
+                int term = get_symbol_by_id(emitters->pstate->symbols, oper->ops[k])->term->val - BASE_TERM;
+                level[term] = j + 1;
+                alt[term] = oper->alts[k];
+            }
+        }
+
+        fprintf(fp, "    // %s\n    {", raw_string(chain->levels[0]->name));
+        for(int j = 0; j < num_terms; j++) {
+            if(j > 0 && (j % 8) == 0)
+                fprintf(fp, "\n     ");
+            fprintf(fp, " { %d, %d },", level[j], alt[j]);
+        }
+        fprintf(fp, " },\n");
+    }
+    fprintf(fp, "};\n\n");
+
+    _FREE(level);
+    _FREE(alt);
 }
 
 static void emit_rule_list(FILE* fp, NonTermList* list) {
 
+    int line = 0;
+    int offset = 1;
+
     NonTerminal* nterm;
     NonTermListIter* ntiter = init_list_iterator(list);
     while(iterate_list(ntiter, &nterm)) {
-        fprintf(fp, ",\n\n    %d,\n", get_rule_size(nterm));
+        int size = emitters->rule_size[nterm->val - BASE_NTERM];
+        fprintf(fp, ",\n\n    %d,\n", size);
         fprintf(fp, "    _nterm_%s,\n", raw_string(nterm->name));
         fprintf(fp, "    %d,\n", nterm->prec);
-        fprintf(fp, "    %d", length_list(nterm->list));
+        fprintf(fp, "    %s,\n", rule_flags(nterm));
+        fprintf(fp, "    %d,\n", length_list(nterm->list));
+        fprintf(fp, "    %d", length_list(nterm->tails));
+
+        int next = offset + size;
+        offset += 6;
+        emit_rule_lines(fp, nterm->list, 0, &line, &offset);
+        emit_rule_lines(fp, nterm->tails, 1, &line, &offset);
+        emit_factor_tree(fp, nterm->tree, 0);
+        emit_factor_tree(fp, nterm->tail_tree, 0);
+        offset = next;
+    }
+}
 
-        Rule* rule;
-        RuleListIter* riter = init_list_iterator(nterm->list);
-        while(iterate_list(riter, &rule)) {
-            Str* str;
-            StrListIter* siter = init_list_iterator(rule->list);
+/*
+ * The lines store the same items. A tail is stored without its leading
+ * recursive symbol.
+ */
+static bool same_line(Rule* rule, int skip, Rule* other, int other_skip) {
 
-            iterate_list(siter, &str);
-            fprintf(fp, ",\n        %d, ", length_list(rule->list));
-            emit_name(fp, str);
+    if(rule->len - skip != other->len - other_skip)
+        return false;
 
-            while(iterate_list(siter, &str)) {
-                fprintf(fp, ", ");
-                emit_name(fp, str);
+    for(int i = 0; i < rule->len - skip; i++)
+        if(rule->list[i + skip] != other->list[i + other_skip])
+            return false;
+
+    return true;
+}
+
+/*
+ * Find where every line is in the parser table and the size of every rule,
+ * which is its header, its lines, and its trees. When the tables are
+ * compressed, a line with the same items as a line before it, in any rule,
+ * is not stored again and it refers to the first one. The lines are
+ * numbered as in the line table, the lines of a rule and then its tails.
+ */
+static void layout_table() {
+
+    NonTermList* list = emitters->pstate->non_terminals;
+    NonTerminal* nterm;
+    NonTermListIter* ntiter;
+    Rule* rule;
+    RuleListIter* riter;
+
+    int num_lines = 0;
+    ntiter = init_list_iterator(list);
+    while(iterate_list(ntiter, &nterm))
+        num_lines += length_list(nterm->list) + length_list(nterm->tails);
+
+    emitters->rule_size = _ALLOC_ARRAY(int, length_list(list) + 1);
+    emitters->line_offset = _ALLOC_ARRAY(int, num_lines + 1);
+
+    // the lines that are stored, with the number of leading symbols that
+    // are not stored
+    Rule** stored = _ALLOC_ARRAY(Rule*, num_lines + 1);
+    int* stored_skip = _ALLOC_ARRAY(int, num_lines + 1);
+    int* stored_offset = _ALLOC_ARRAY(int, num_lines + 1);
+    int num_stored = 0;
+
+    int line = 0;
+    int offset = 1;
+    ntiter = init_list_iterator(list);
+    while(iterate_list(ntiter, &nterm)) {
+        int start = offset;
+        offset += 6;
+        for(int skip = 0; skip < 2; skip++) {
+            riter = init_list_iterator((skip == 0)? nterm->list: nterm->tails);
+            while(iterate_list(riter, &rule)) {
+                int found = -1;
+                for(int i = 0; emitters->compress && i < num_stored && found < 0; i++)
+                    if(same_line(rule, skip, stored[i], stored_skip[i]))
+                        found = stored_offset[i];
+
+                if(found < 0) {
+                    stored[num_stored] = rule;
+                    stored_skip[num_stored] = skip;
+                    stored_offset[num_stored++] = offset;
+                    found = offset;
+                    offset += rule->len - skip + 1;
+                }
+                emitters->line_offset[line++] = found;
             }
         }
+        offset += factor_tree_size(nterm->tree) + factor_tree_size(nterm->tail_tree);
+        emitters->rule_size[nterm->val - BASE_NTERM] = offset - start;
     }
+
+    LOG(ELEVEL, "%d of %d lines stored in %d entries", num_stored, num_lines, offset);
+
+    _FREE(stored);
+    _FREE(stored_skip);
+    _FREE(stored_offset);
+
+    // The entries are the symbols and the values of the rules, and the
+    // values in a rule are not larger than the rule. Bytes are only used
+    // when the tables are compressed, and 32 bits when a grammar needs them.
+    int max = BASE_NTERM + get_num_nterm();
+    ntiter = init_list_iterator(list);
+    while(iterate_list(ntiter, &nterm)) {
+        if(emitters->rule_size[nterm->val - BASE_NTERM] > max)
+            max = emitters->rule_size[nterm->val - BASE_NTERM];
+        if(nterm->prec > max)
+            max = nterm->prec;
+    }
+    if(!emitters->compress && max <= 0xffff)
+        max = 0xffff;
+    emitters->table_type = entry_type(max);
+    emitters->entry_size = entry_bytes(max);
+}
+
+static void emit_line_refs(FILE* fp, RuleList* list, int* line) {
+
+    for(int i = 0; i < length_list(list); i++)
+        fprintf(fp, "    &parser_table[%d],\n", emitters->line_offset[(*line)++]);
+}
+
+/*
+ * The index from the non-terminal to its offset in the parser table, and
+ * the lines and trees of every rule, so that the parser finds them without
+ * searching the table.
+ */
+static void emit_rule_index(FILE* fp) {
+
+    NonTermList* list = emitters->pstate->non_terminals;
+    NonTerminal* nterm;
+    NonTermListIter* ntiter;
+    int offset;
+
+    offset = 1;
+    ntiter = init_list_iterator(list);
+    while(iterate_list(ntiter, &nterm))
+        offset += emitters->rule_size[nterm->val - BASE_NTERM];
+
+    fprintf(fp, "static const %s rule_index[NUM_NTERM] = {", entry_type(offset));
+    offset = 1;
+    ntiter = init_list_iterator(list);
+    while(iterate_list(ntiter, &nterm)) {
+        fprintf(fp, " %d,", offset);
+        offset += emitters->rule_size[nterm->val - BASE_NTERM];
+    }
+    fprintf(fp, " };\n\n");
+
+    fprintf(fp, "static const RuleLine line_table[] = {\n");
+    int line = 0;
+    ntiter = init_list_iterator(list);
+    while(iterate_list(ntiter, &nterm)) {
+        emit_line_refs(fp, nterm->list, &line);
+        emit_line_refs(fp, nterm->tails, &line);
+    }
+    fprintf(fp, "};\n\n");
+
+    // the number of every line in the grammar, which the nodes are tagged with
+    fprintf(fp, "static const uint16_t line_alts[] = {");
+    ntiter = init_list_iterator(list);
+    while(iterate_list(ntiter, &nterm)) {
+        Rule* rule;
+        RuleListIter* riter = init_list_iterator(nterm->list);
+        while(iterate_list(riter, &rule))
+            fprintf(fp, " %d,", rule->alt);
+        riter = init_list_iterator(nterm->tails);
+        while(iterate_list(riter, &rule))
+            fprintf(fp, " %d,", rule->alt);
+    }
+    fprintf(fp, " };\n\n");
+
+    int num_chains = get_num_chains();
+    OperChain** chains = get_chains(list);
+    int* chain_offset = _ALLOC_ARRAY(int, num_chains + 1);
+    if(num_chains > 0)
+        emit_climb_tables(fp, chains, chain_offset);
+
+    fprintf(fp, "static const RuleInfo rule_info[NUM_NTERM] = {\n");
+    offset = 1;
+    line = 0;
+    ntiter = init_list_iterator(list);
+    while(iterate_list(ntiter, &nterm)) {
+        int num_lines = length_list(nterm->list);
+        int num_tails = length_list(nterm->tails);
+        int size = emitters->rule_size[nterm->val - BASE_NTERM];
+        int tree = offset + size - factor_tree_size(nterm->tree) - factor_tree_size(nterm->tail_tree);
+
+        fprintf(fp, "    { _nterm_%s, %d, %s, %d, %d, &line_table[%d], &line_table[%d], "
+                    "&line_alts[%d], &parser_table[%d], &parser_table[%d], ",
+                raw_string(nterm->name), nterm->prec, rule_flags(nterm),
+                num_lines, num_tails, line, line + num_lines, line,
+                tree, tree + factor_tree_size(nterm->tree));
+
+        if(nterm->oper != NULL)
+            fprintf(fp, "&climb_table[%d], %d },\n", chain_offset[nterm->oper->chain->id], nterm->oper->index);
+        else
+            fprintf(fp, "NULL, 0 },\n");
+
+        line += num_lines + num_tails;
+        offset += size;
+    }
+    fprintf(fp, "};\n\n");
+
+    _FREE(chains);
+    _FREE(chain_offset);
+}
+
+/*
+ * The type of the parser table entries, the smallest that holds every
+ * symbol and every value of the rules.
+ */
+static void emit_table_entry(FILE* fp) {
+
+    fprintf(fp, "typedef %s TableEntry;\n", emitters->table_type);
 }
 
 static void emit_rule_table(FILE* fp) {
 
+    int max = 0;
+    NonTerminal* nterm;
+    NonTermListIter* ntiter = init_list_iterator(emitters->pstate->non_terminals);
+    while(iterate_list(ntiter, &nterm)) {
+        Rule* rule;
+        RuleListIter* riter = init_list_iterator(nterm->list);
+        while(iterate_list(riter, &rule))
+            if(rule->len > max)
+                max = rule->len;
+        riter = init_list_iterator(nterm->tails);
+        while(iterate_list(riter, &rule))
+            if(rule->len > max)
+                max = rule->len;
+    }
+
     fprintf(fp, "// parser table encoding\n");
+    fprintf(fp, "#define RULE_LR_HEAD 0x01\n");
+    fprintf(fp, "#define RULE_OPERATOR 0x02\n");
+    fprintf(fp, "#define RULE_HOT_FIRST 0x04\n");
+    fprintf(fp, "#define MAX_LINE %d\n\n", max);
 
-    fprintf(fp, "static uint16_t parser_table[] = {\n");
+    fprintf(fp, "static const TableEntry parser_table[] = {\n");
     fprintf(fp, "    %d", length_list(emitters->pstate->non_terminals));
     emit_rule_list(fp, emitters->pstate->non_terminals);
     fprintf(fp, "\n};\n\n");
+
+    emit_rule_index(fp);
 }
 
-#include "emit_parser.h"
+typedef struct {
+    int row;
+    int cells; // the cells that are not PREDICT_NONE
+} CombRow;
 
-static void emit_parser_c() {
+static int comb_order(const void* a, const void* b) {
+
+    const CombRow* x = a;
+    const CombRow* y = b;
+
+    return (x->cells != y->cells)? y->cells - x->cells: x->row - y->row;
+}
+
+static void emit_comb_array(FILE* fp, const char* type, const char* name, const int* values, int num) {
+
+    fprintf(fp, "static const %s %s[%d] = {", type, name, num);
+    for(int i = 0; i < num; i++) {
+        if((i % 16) == 0)
+            fprintf(fp, "\n   ");
+        fprintf(fp, " %d,", values[i]);
+    }
+    fprintf(fp, "\n};\n\n");
+}
+
+/*
+ * The predict table as a comb vector. Every row is placed at the first
+ * offset where its cells land on free cells, from the fullest row down,
+ * and the check entry of a cell is the row that owns it. The empty cells
+ * are PREDICT_NONE, so the rows of a large grammar interleave. There is a
+ * full row of room after the last offset, so any terminal can be looked up.
+ * The base has a cell for every row, and check and next have room for every
+ * row and column. Returns the cells of check and next that are used.
+ */
+static int pack_predict(int* base, int* check, int* next) {
+
+    int rows = get_num_nterm();
+    int cols = get_num_term() + 1;
 
-    FILE* fp = source_pre("_parser");
+    NonTerminal** nterms = _ALLOC_ARRAY(NonTerminal*, rows + 1);
+    CombRow* order = _ALLOC_ARRAY(CombRow, rows + 1);
+    int* used = _ALLOC_ARRAY(int, cols + 1);
 
     NonTerminal* nterm;
     NonTermListIter* ntli = init_list_iterator(emitters->pstate->non_terminals);
-    fprintf(fp, "typedef enum {\n");
+    while(iterate_list(ntli, &nterm)) {
+        int row = nterm->val - BASE_NTERM;
+        nterms[row] = nterm;
+        order[row].row = row;
+        order[row].cells = 0;
+        for(int i = 0; i < cols; i++)
+            if(nterm->predict[i] != PREDICT_NONE)
+                order[row].cells++;
+    }
+    qsort(order, rows, sizeof(CombRow), comb_order);
+
+    for(int i = 0; i < (rows + 1) * cols; i++) {
+        check[i] = rows;
+        next[i] = PREDICT_NONE;
+    }
+
+    int size = cols;
+    for(int r = 0; r < rows; r++) {
+        int row = order[r].row;
+        uint8_t* predict = nterms[row]->predict;
+
+        int num = 0;
+        for(int i = 0; i < cols; i++)
+            if(predict[i] != PREDICT_NONE)
+                used[num++] = i;
+
+        int offset = 0;
+        for(int i = 0; i < num; i++)
+            if(check[offset + used[i]] != rows) {
+                offset++;
+                i = -1;
+            }
+
+        base[row] = offset;
+        for(int i = 0; i < num; i++) {
+            check[offset + used[i]] = row;
+            next[offset + used[i]] = predict[used[i]];
+        }
+        if(offset + cols > size)
+            size = offset + cols;
+    }
+
+    LOG(ELEVEL, "predict table packed from %d to %d cells", rows * cols, size);
+
+    _FREE(nterms);
+    _FREE(order);
+    _FREE(used);
+
+    return size;
+}
+
+static void emit_predict_comb(FILE* fp) {
+
+    int rows = get_num_nterm();
+    int cols = get_num_term() + 1;
+    int* base = _ALLOC_ARRAY(int, rows + 1);
+    int* check = _ALLOC_ARRAY(int, (rows + 1) * cols);
+    int* next = _ALLOC_ARRAY(int, (rows + 1) * cols);
+
+    int size = pack_predict(base, check, next);
+
+    fprintf(fp, "#define PREDICT_COMB\n\n");
+    emit_comb_array(fp, entry_type(size), "predict_base", base, rows);
+    emit_comb_array(fp, entry_type(rows), "predict_check", check, size);
+    emit_comb_array(fp, "uint8_t", "predict_next", next, size);
+
+    _FREE(base);
+    _FREE(check);
+    _FREE(next);
+}
+
+/*
+ * The bytes of the predict table as it is emitted, which is the comb vector
+ * when the tables are compressed.
+ */
+static int predict_size() {
+
+    int rows = get_num_nterm();
+    int cols = get_num_term() + 1;
+
+    if(!emitters->compress)
+        return rows * cols;
+
+    int* base = _ALLOC_ARRAY(int, rows + 1);
+    int* check = _ALLOC_ARRAY(int, (rows + 1) * cols);
+    int* next = _ALLOC_ARRAY(int, (rows + 1) * cols);
+
+    int size = pack_predict(base, check, next);
+
+    _FREE(base);
+    _FREE(check);
+    _FREE(next);
+
+    return rows * entry_bytes(size) + size * (entry_bytes(rows) + 1);
+}
+
+/*
+ * One row per non-terminal and one column per terminal, plus a column for
+ * the end of the input. The cell holds the rule line to use, or one of the
+ * PREDICT_* values.
+ */
+static void emit_predict_table(FILE* fp) {
+
+    fprintf(fp, "// LL(1) predict table\n");
+    fprintf(fp, "#define USE_PREDICT_TABLE\n");
+    fprintf(fp, "#define PREDICT_NONE %d\n", PREDICT_NONE);
+    fprintf(fp, "#define PREDICT_CONFLICT %d\n\n", PREDICT_CONFLICT);
+
+    if(emitters->compress) {
+        emit_predict_comb(fp);
+        return;
+    }
+
+    fprintf(fp, "static const uint8_t predict_table[%d][NUM_TERM + 1] = {\n",
+            get_num_nterm());
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(emitters->pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        fprintf(fp, "    // %s\n    {", raw_string(nterm->name));
+        for(int i = 0; i <= get_num_term(); i++) {
+            if(i > 0 && (i % 16) == 0)
+                fprintf(fp, "\n     ");
+            fprintf(fp, " %d,", nterm->predict[i]);
+        }
+        fprintf(fp, " },\n");
+    }
+    fprintf(fp, "};\n\n");
+}
+
+/*
+ * A set of terminals as a bit for each token type from BASE_TERM, with the
+ * end of the input last.
+ */
+static void emit_term_set(FILE* fp, BitSet* set, NonTerminal* nterm) {
+
+    int words = (get_num_term() + 1 + 31) / 32;
+    uint32_t* bits = _ALLOC_ARRAY(uint32_t, words);
+    memset(bits, 0, sizeof(uint32_t) * words);
+
+    int col = 0;
+    Terminal* term;
+    TermListIter* tli = init_list_iterator(emitters->pstate->terminals);
+    while(iterate_list(tli, &term)) {
+        if(test_bit(set, term->id))
+            bits[col / 32] |= 1u << (col % 32);
+        col++;
+    }
+    if(test_bit(set, get_end_bit()))
+        bits[col / 32] |= 1u << (col % 32);
+
+    fprintf(fp, "    {");
+    for(int i = 0; i < words; i++)
+        fprintf(fp, " 0x%08x,", bits[i]);
+    fprintf(fp, " }, // %s\n", raw_string(nterm->name));
+
+    _FREE(bits);
+}
+
+/*
+ * The sets for error recovery and the messages, one row for every
+ * non-terminal. The expected tokens are the FIRST set, the input is skipped
+ * to the sync set after an error, and a non-terminal cannot stop at a token
+ * of the more set.
+ */
+static void emit_sync_sets(FILE* fp) {
+
+    static const char* names[] = { "expect_set", "sync_set", "more_set" };
+
+    fprintf(fp, "// error recovery\n");
+    fprintf(fp, "#define SET_WORDS %d\n\n", (get_num_term() + 1 + 31) / 32);
+
+    for(int i = 0; i < 3; i++) {
+        fprintf(fp, "static const uint32_t %s[NUM_NTERM][SET_WORDS] = {\n", names[i]);
+        NonTerminal* nterm;
+        NonTermListIter* ntli = init_list_iterator(emitters->pstate->non_terminals);
+        while(iterate_list(ntli, &nterm))
+            emit_term_set(fp, (i == 0)? nterm->first: (i == 1)? nterm->sync: nterm->more, nterm);
+        fprintf(fp, "};\n\n");
+    }
+}
+
+/*
+ * The memoized non-terminals are numbered in the order they are defined.
+ * The table parser looks the number up by the non-terminal, -1 is not
+ * memoized. The direct parser has the number written into its functions.
+ */
+static void emit_memo(FILE* fp, bool direct) {
+
+    int num = 0;
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(emitters->pstate->non_terminals);
     while(iterate_list(ntli, &nterm))
-        fprintf(fp, "    _nterm_%s = %d,\n", raw_string(nterm->name), nterm->val);
-    fprintf(fp, "} NonTerminalType;\n\n");
+        if(nterm->memo)
+            num++;
+
+    if(num == 0)
+        return;
+
+    fprintf(fp, "// packrat memoization\n");
+    fprintf(fp, "#define USE_MEMO\n");
+    fprintf(fp, "#define NUM_MEMO %d\n\n", num);
+
+    if(direct)
+        return;
+
+    fprintf(fp, "static const int16_t memo_slot[NUM_NTERM] = {");
+    num = 0;
+    ntli = init_list_iterator(emitters->pstate->non_terminals);
+    while(iterate_list(ntli, &nterm))
+        fprintf(fp, " %d,", nterm->memo ? num++ : -1);
+    fprintf(fp, " };\n\n");
+}
+
+#include "emit_parser.h"
+
+/*
+ * The input is parsed as a list of the streamed element instead of from
+ * the start symbol. Each element goes to the callback as soon as it is
+ * matched and then the parser and the scanner let go of it, so the memory
+ * that is used depends on the largest element and not on the input.
+ */
+static void emit_stream(FILE* fp, bool direct) {
+
+    NonTerminal* nterm = emitters->pstate->stream;
+    if(nterm == NULL)
+        return;
+
+    fprintf(fp, parser_stream_string);
+    fprintf(fp, "bool parse_stream(ParserContext* ctx, void (*callback)(ParserContext* ctx, Ast* ast)) {\n\n");
+    fprintf(fp, "    int recovered = ctx->recovered;\n\n");
+    fprintf(fp, "    reset_matched(ctx);\n");
+    fprintf(fp, "    while(peek_token(ctx)->type != _TOK_END_OF_INPUT) {\n");
+    fprintf(fp, "        int errs = ctx->recovered;\n");
+    if(direct)
+        fprintf(fp, "        Ast* ast = parse_%s(ctx, true);\n\n", raw_string(nterm->name));
+    else
+        fprintf(fp, "        Ast* ast = match_rule(ctx, _nterm_%s, true);\n\n", raw_string(nterm->name));
+    fprintf(fp, "        // an element with an error is not handed on\n");
+    fprintf(fp, "        if(ctx->recovered == errs)\n");
+    fprintf(fp, "            callback(ctx, ast);\n");
+    fprintf(fp, "        release_matched(ctx);\n");
+    fprintf(fp, "    }\n\n");
+    fprintf(fp, "    return ctx->recovered == recovered;\n");
+    fprintf(fp, "}\n\n");
+}
+
+/*
+ * The highest line number of any non-terminal, tails included. The profile
+ * counts the nodes of every line.
+ */
+static int max_alt() {
+
+    int max = 0;
+    NonTerminal* nterm;
+    Rule* rule;
+    NonTermListIter* ntli = init_list_iterator(emitters->pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        RuleListIter* riter = init_list_iterator(nterm->list);
+        while(iterate_list(riter, &rule))
+            if(rule->alt > max)
+                max = rule->alt;
+        riter = init_list_iterator(nterm->tails);
+        while(iterate_list(riter, &rule))
+            if(rule->alt > max)
+                max = rule->alt;
+    }
+
+    return max;
+}
+
+static void emit_parser_c() {
+
+    FILE* fp = thread_source_pre("_parser");
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli;
 
     fprintf(fp, "#include \"%s_parser.h\"\n", raw_string(emitters->base));
     fprintf(fp, "#include \"%s_scanner.h\"\n", raw_string(emitters->base));
     fprintf(fp, "#include \"%s_ast.h\"\n\n", raw_string(emitters->base));
 
+    // the symbols are numbered densely, the terminals and the end of the
+    // input, then the non-terminals from BASE_NTERM
     fprintf(fp, "#define BASE_TERM %d\n", BASE_TERM);
-    fprintf(fp, "#define BASE_NTERM %d\n\n", BASE_NTERM);
+    fprintf(fp, "#define BASE_NTERM %d\n", BASE_NTERM);
+    fprintf(fp, "#define NUM_TERM %d\n", get_num_term());
+    fprintf(fp, "#define NUM_NTERM %d\n", get_num_nterm());
+    fprintf(fp, "#define MAX_ALT %d\n", max_alt());
+    fprintf(fp, "#define NUM_CHAIN %d\n\n", get_num_chains());
+
+    bool direct = !strcmp(get_cmd_raw(cmd, "backend"), "direct");
+    emit_memo(fp, direct);
+
+    if(!direct) {
+        layout_table();
+        emit_table_entry(fp);
+        fprintf(fp, data_structures_string);
 
-    emit_rule_table(fp);
+        emit_rule_table(fp);
 
-    fprintf(fp, data_structures_string);
+        if(get_cmd_int(cmd, "predict"))
+            emit_predict_table(fp);
+    }
+    emit_sync_sets(fp);
 
     fprintf(fp, "static const char* nterm_to_str(uint16_t type) {\n");
     ntli = init_list_iterator(emitters->pstate->non_terminals);
@@ -225,11 +982,36 @@ static void emit_parser_c() {
         fprintf(fp, "        (type == _nterm_%s)? \"%s\" :\n", name, name);
     }
     fprintf(fp, "                \"UNKNOWN\";\n");
+    fprintf(fp, "}\n\n");
+
+    fprintf(fp, "static const char* term_to_str(uint16_t type) {\n");
+    fprintf(fp, "    return ");
+    Terminal* term;
+    TermListIter* tli = init_list_iterator(emitters->pstate->terminals);
+    while(iterate_list(tli, &term)) {
+        name = raw_string(term->name);
+        fprintf(fp, "(type == _TOK_%s)? \"%s\" :\n        ", name, name);
+    }
+    fprintf(fp, "(type == _TOK_END_OF_INPUT)? \"END OF INPUT\" :\n");
+    fprintf(fp, "                \"UNKNOWN\";\n");
     fprintf(fp, "}\n");
 
     fprintf(fp, errors_string);
-    fprintf(fp, parser_finder_string);
-    fprintf(fp, parser_testing_string);
+    fprintf(fp, parser_profile_string);
+    fprintf(fp, parser_common_string);
+    fprintf(fp, parser_recovery_string);
+
+    if(direct) {
+        fprintf(fp, parser_direct_string);
+        emit_direct_parser(fp, emitters->pstate);
+    }
+    else {
+        fprintf(fp, parser_finder_string);
+        fprintf(fp, parser_testing_string);
+    }
+    emit_stream(fp, direct);
+    fprintf(fp, parser_reparse_string);
+    fprintf(fp, parser_batch_string);
 
     source_post(fp);
 }
@@ -238,7 +1020,31 @@ static void emit_parser_h() {
 
     FILE* fp = header_pre("_parser");
 
-    fprintf(fp, "void* parser();\n\n");
+    fprintf(fp, "#include \"%s_ast.h\"\n\n", raw_string(emitters->base));
+    fprintf(fp, "Ast* parse(ParserContext* ctx);\n");
+    if(emitters->pstate->stream != NULL)
+        fprintf(fp, "bool parse_stream(ParserContext* ctx, void (*callback)(ParserContext* ctx, Ast* ast));\n");
+    fprintf(fp, "int get_errors(ParserContext* ctx);\n\n");
+
+    fprintf(fp, "#ifdef USE_REPARSE\n");
+    fprintf(fp, "Ast* reparse(ParserContext* ctx, const TextEdit* edits, int num);\n");
+    fprintf(fp, "#endif\n\n");
+
+    fprintf(fp, "// Built with USE_PROFILE, the parser counts the attempts, the matches,\n");
+    fprintf(fp, "// and the tokens that were handed back for every non-terminal and rule\n");
+    fprintf(fp, "// line. USE_PROFILE_TIME adds the cycles spent in each.\n");
+    if(get_cmd_int(cmd, "profile"))
+        fprintf(fp, "#define USE_PROFILE\n");
+    fprintf(fp, "#ifdef USE_PROFILE\n");
+    fprintf(fp, "void dump_profile(ParserContext* ctx, FILE* fp, bool csv);\n");
+    fprintf(fp, "void reset_profile(ParserContext* ctx);\n");
+    fprintf(fp, "#endif\n\n");
+
+    fprintf(fp, "// Called for every file of a batch, on the thread that parsed it. The\n");
+    fprintf(fp, "// tree is NULL after a syntax error. The tree and the tokens are in the\n");
+    fprintf(fp, "// context, which is reset for the next file after the call.\n");
+    fprintf(fp, "typedef void (*BatchFunc)(ParserContext* ctx, const char* fname, Ast* ast, void* data);\n\n");
+    fprintf(fp, "int parse_files(const char** fnames, int num, int num_threads, BatchFunc func, void* data);\n\n");
 
     header_post(fp);
 }
@@ -247,55 +1053,220 @@ static void emit_ast_c() {
 
     FILE* fp = source_pre("_ast");
     fprintf(fp, "#include \"%s_ast.h\"\n\n", raw_string(emitters->base));
-    fprintf(fp, "Ast* create_ast_node(uint16_t type, List* lst) {\n\n");
-    fprintf(fp, "    Ast* ptr = _ALLOC_T(Ast);\n");
+    fprintf(fp, arena_string);
+    fprintf(fp, context_string);
+    fprintf(fp, "// The node has room for size attributes.\n");
+    fprintf(fp, "Ast* create_ast_node(ParserContext* ctx, uint16_t type, uint16_t alt, int size) {\n\n");
+    fprintf(fp, "    Ast* ptr = (Ast*)PARSE_ALLOC_ARRAY(ctx, char, sizeof(Ast) + sizeof(AstAttr) * size);\n");
     fprintf(fp, "    ptr->type = type;\n");
-    fprintf(fp, "    ptr->attr_list = lst;\n\n");
+    fprintf(fp, "    ptr->alt = alt;\n");
+    fprintf(fp, "    ptr->num_attrs = 0;\n");
+    fprintf(fp, "    ptr->terms = 0;\n\n");
     fprintf(fp, "    return ptr;\n");
     fprintf(fp, "}\n\n");
-    fprintf(fp, "void add_ast_attr(Ast* ast, AstEntry* attr) {\n");
-    fprintf(fp, "    append_list(ast->attr_list, (void*)attr);\n");
-    fprintf(fp, "}\n\n");
+    fprintf(fp, ast_tree_string);
     source_post(fp);
 }
 
+/*
+ * The name of the field for the symbol at idx in the rule. The symbol name
+ * gets an "f_" prefix so that it cannot be taken by a keyword, a macro, or
+ * the node header, and a symbol that is in the rule more than once is
+ * numbered.
+ */
+static void emit_field_name(FILE* fp, Rule* rule, int idx) {
+
+    const char* name = raw_string(get_symbol_by_id(emitters->pstate->symbols, rule->list[idx])->name);
+
+    int count = 0, num = 0;
+    for(int i = 0; i < rule->len; i++) {
+        if(rule->list[i] == rule->list[idx]) {
+            count++;
+            if(i <= idx)
+                num++;
+        }
+    }
+
+    fprintf(fp, "f_%s", name);
+    if(count > 1)
+        fprintf(fp, "_%d", num);
+}
+
+/*
+ * A struct for every line of the non-terminal, with a field for every
+ * symbol, that has the layout of the node that the line makes.
+ */
+static void emit_alt_struct(FILE* fp, NonTerminal* nterm, Rule* rule) {
+
+    const char* name = raw_string(nterm->name);
+    SymbolTable* tab = emitters->pstate->symbols;
+
+    fprintf(fp, "// %s :", name);
+    for(int i = 0; i < rule->len; i++)
+        fprintf(fp, " %s", raw_string(get_symbol_by_id(tab, rule->list[i])->name));
+    fprintf(fp, "\n");
+    fprintf(fp, "typedef struct {\n");
+    fprintf(fp, "    AST_HEADER;\n");
+    for(int i = 0; i < rule->len; i++) {
+        fprintf(fp, "    %s ", (get_symbol_by_id(tab, rule->list[i])->term != NULL)? "Token*": "Ast*");
+        emit_field_name(fp, rule, i);
+        fprintf(fp, ";\n");
+    }
+    fprintf(fp, "} Ast_%s_%d;\n\n", name, rule->alt);
+}
+
+static void emit_alt_structs(FILE* fp) {
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(emitters->pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        const char* name = raw_string(nterm->name);
+        int num = length_list(nterm->list) + length_list(nterm->tails);
+        Rule** rules = _ALLOC_ARRAY(Rule*, num);
+
+        // the tails were moved out of the lines, put them back in order
+        Rule* rule;
+        RuleListIter* rli = init_list_iterator(nterm->list);
+        while(iterate_list(rli, &rule))
+            rules[rule->alt - 1] = rule;
+        rli = init_list_iterator(nterm->tails);
+        while(iterate_list(rli, &rule))
+            rules[rule->alt - 1] = rule;
+
+        fprintf(fp, "enum {\n");
+        for(int i = 0; i < num; i++)
+            fprintf(fp, "    _alt_%s_%d = %d,\n", name, i + 1, i + 1);
+        fprintf(fp, "};\n\n");
+
+        for(int i = 0; i < num; i++)
+            emit_alt_struct(fp, nterm, rules[i]);
+
+        _FREE(rules);
+    }
+}
+
 static void emit_ast_h() {
 
     FILE* fp = header_pre("_ast");
-    fprintf(fp, "#include \"util.h\"\n\n");
+    fprintf(fp, "#include \"util.h\"\n");
+    fprintf(fp, "#include \"%s_scanner.h\"\n\n", raw_string(emitters->base));
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(emitters->pstate->non_terminals);
     fprintf(fp, "typedef enum {\n");
-    fprintf(fp, "    AST_NTERM,\n");
-    fprintf(fp, "    AST_TERM,\n");
-    fprintf(fp, "} AstType;\n\n");
-    fprintf(fp, "typedef struct {\n");
-    fprintf(fp, "    uint16_t type;\n");
-    fprintf(fp, "    List* attr_list;\n");
-    fprintf(fp, "} Ast;\n\n");
-    fprintf(fp, "typedef struct {\n");
-    fprintf(fp, "    AstType type;\n");
-    fprintf(fp, "    void* value;\n");
-    fprintf(fp, "} AstEntry;\n\n");
-    fprintf(fp, "Ast* create_ast_node(uint16_t type, List* lst);\n");
-    fprintf(fp, "void add_ast_attr(Ast* ast, AstEntry* attr);\n\n");
+    while(iterate_list(ntli, &nterm))
+        fprintf(fp, "    _nterm_%s = %d,\n", raw_string(nterm->name), nterm->val);
+    fprintf(fp, "} NonTerminalType;\n\n");
+
+    fprintf(fp, "typedef struct _ast_ Ast;\n\n");
+    fprintf(fp, "typedef union {\n");
+    fprintf(fp, "    Token* tok;\n");
+    fprintf(fp, "    Ast* ast;\n");
+    fprintf(fp, "} AstAttr;\n\n");
+    fprintf(fp, "// Every node starts with this. The alt is the rule line that made the\n");
+    fprintf(fp, "// node, from 1 in the order of the grammar, and bit i of terms is set\n");
+    fprintf(fp, "// when the attribute i is a token.\n");
+    fprintf(fp, "#define AST_HEADER \\\n");
+    fprintf(fp, "    uint16_t type; \\\n");
+    fprintf(fp, "    uint16_t alt; \\\n");
+    fprintf(fp, "    uint16_t num_attrs; \\\n");
+    fprintf(fp, "    uint64_t terms\n\n");
+    fprintf(fp, "struct _ast_ {\n");
+    fprintf(fp, "    AST_HEADER;\n");
+    fprintf(fp, "    AstAttr attrs[];\n");
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "// The node of a rule line can be read as the Ast_<rule>_<alt> struct of\n");
+    fprintf(fp, "// the line, which names the attributes.\n");
+    emit_alt_structs(fp);
+
+    fprintf(fp, "// Everything that a parse keeps between the calls of the scanner and\n");
+    fprintf(fp, "// the parser. A context is used by one thread at a time, and each\n");
+    fprintf(fp, "// thread of a batch parse has its own.\n");
+    fprintf(fp, "struct _parser_context_ {\n");
+    fprintf(fp, "    ScanState* scan;\n");
+    fprintf(fp, "    struct _arena_* arena;          // with USE_ARENA\n");
+    fprintf(fp, "    int errors;\n");
+    fprintf(fp, "    int warnings;\n");
+    fprintf(fp, "    int tok_pos;                    // number of tokens that have been consumed\n");
+    fprintf(fp, "    int far;                        // the furthest position that was matched to\n");
+    fprintf(fp, "    struct _lr_head_* lr_heads;     // the left recursive rules being grown\n");
+    fprintf(fp, "    struct _memo_entry_** memo_rows;\n");
+    fprintf(fp, "    int memo_cap;\n");
+    fprintf(fp, "    int reach;                      // the furthest position that was looked at\n");
+    fprintf(fp, "    struct _span_** span_rows;      // with USE_REPARSE, the rules kept for the next parse\n");
+    fprintf(fp, "    int span_cap;\n");
+    fprintf(fp, "    int synced;                     // where the last recovery from an error stopped\n");
+    fprintf(fp, "    int recovered;                  // number of recoveries\n");
+    fprintf(fp, "    struct _profile_* profile;      // with USE_PROFILE\n");
+    fprintf(fp, "};\n\n");
+    fprintf(fp, "ParserContext* create_parser_context();\n");
+    fprintf(fp, "void reset_parser_context(ParserContext* ctx);\n");
+    fprintf(fp, "void destroy_parser_context(ParserContext* ctx);\n\n");
+
+    fprintf(fp, "// Built with USE_ARENA, everything that a parse makes comes from one\n");
+    fprintf(fp, "// arena that is reset or freed at once, and the GC is not used for it.\n");
+    fprintf(fp, "// ARENA_HUGE_PAGES backs the arena with huge pages.\n");
+    fprintf(fp, "#ifdef USE_ARENA\n");
+    fprintf(fp, "void* arena_alloc(ParserContext* ctx, size_t size);\n");
+    fprintf(fp, "void arena_reset(ParserContext* ctx);\n");
+    fprintf(fp, "void arena_free(ParserContext* ctx);\n");
+    fprintf(fp, "#define PARSE_ALLOC_T(ctx, t) ((t*)arena_alloc((ctx), sizeof(t)))\n");
+    fprintf(fp, "#define PARSE_ALLOC_ARRAY(ctx, t, n) ((t*)arena_alloc((ctx), sizeof(t) * (n)))\n");
+    fprintf(fp, "#else\n");
+    fprintf(fp, "#define PARSE_ALLOC_T(ctx, t) ((void)(ctx), _ALLOC_T(t))\n");
+    fprintf(fp, "#define PARSE_ALLOC_ARRAY(ctx, t, n) ((void)(ctx), _ALLOC_ARRAY(t, n))\n");
+    fprintf(fp, "#endif\n\n");
+    fprintf(fp, "Ast* create_ast_node(ParserContext* ctx, uint16_t type, uint16_t alt, int size);\n\n");
+    fprintf(fp, ast_node_h_string);
+    fprintf(fp, ast_tree_h_string);
     header_post(fp);
 }
 
 static void emit_visitor_c() {
 
-    FILE* fp = source_pre("_visitor");
+    FILE* fp = thread_source_pre("_visitor");
+    fprintf(fp, "#include \"%s_visitor.h\"\n", raw_string(emitters->base));
+    fprintf(fp, visitor_string);
     source_post(fp);
 }
 
 static void emit_visitor_h() {
 
     FILE* fp = header_pre("_visitor");
+    fprintf(fp, "#include \"%s_ast.h\"\n\n", raw_string(emitters->base));
+    fprintf(fp, "#define VISIT_NUM %d\n", get_num_nterm());
+    fprintf(fp, "#define VISIT_SLOT(type) ((type) - %d)\n\n", BASE_NTERM);
+    fprintf(fp, visitor_h_string);
     header_post(fp);
 }
 
+/*
+ * The size of the tables that the table backend is emitted with, as the
+ * options select them.
+ */
+void get_table_size(Parser* pstate, TableSize* size) {
+
+    init_emitters(pstate);
+    layout_table();
+
+    size->entries = 1;
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm))
+        size->entries += emitters->rule_size[nterm->val - BASE_NTERM];
+    size->entry_size = emitters->entry_size;
+    size->predict = get_cmd_int(cmd, "predict") ? predict_size() : 0;
+
+    _FREE(emitters->rule_size);
+    _FREE(emitters->line_offset);
+}
+
 void emit_all(Parser* pstate) {
 
     init_emitters(pstate);
     emit_scanner_h();
+    emit_scanner_c();
     emit_parser_c();
     emit_parser_h();
     emit_ast_c();
@@ -4,6 +4,14 @@
 #include "util.h"
 extern CmdLine cmd;
 
+typedef struct {
+    int entries;    // entries of the parser table
+    int entry_size; // bytes of one entry
+    int predict;    // bytes of the predict table, 0 with -p0
+} TableSize;
+
 void emit_all(Parser* pstate);
+int get_rule_size(NonTerminal* nterm);
+void get_table_size(Parser* pstate, TableSize* size);
 
 #endif /* _EMITTERS_H */
@@ -29,6 +29,23 @@ void syntax_error(const char* fmt, ...) {
     // TODO: error recovery.
 }
 
+// A syntax error in a part of the grammar that was read before.
+void syntax_error_at(int line_no, const char* fmt, ...) {
+
+    va_list args;
+
+    if(line_no > 0)
+        fprintf(stderr, "Syntax Error: %s:%d: ", get_fname(), line_no);
+    else
+        fprintf(stderr, "Syntax Error: ");
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    errors++;
+    fputc('\n', stderr);
+}
+
 void warning(const char* fmt, ...) {
 
     va_list args;
@@ -45,6 +62,24 @@ void warning(const char* fmt, ...) {
     fputc('\n', stderr);
 }
 
+// A warning about a part of the grammar that was read before, such as a
+// non-terminal, at the line where it is and not where the scanner is now.
+void warning_at(int line_no, const char* fmt, ...) {
+
+    va_list args;
+
+    if(line_no > 0)
+        fprintf(stderr, "Warning: %s:%d: ", get_fname(), line_no);
+    else
+        fprintf(stderr, "Warning: ");
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    warnings++;
+    fputc('\n', stderr);
+}
+
 void fatal(const char* fmt, ...) {
 
     va_list args;
@@ -5,7 +5,9 @@
 
 // Convience functions
 void syntax_error(const char* fmt, ...);
+void syntax_error_at(int line_no, const char* fmt, ...);
 void warning(const char* fmt, ...);
+void warning_at(int line_no, const char* fmt, ...);
 void fatal(const char* fmt, ...);
 
 // Only the convience functions update these.
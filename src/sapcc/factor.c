@@ -0,0 +1,149 @@
+
+#include "factor.h"
+#include "logger.h"
+
+#define FLEVEL 20
+
+static Factor* create_factor(int sym) {
+
+    Factor* ptr = _ALLOC_T(Factor);
+    ptr->sym = sym;
+    ptr->end = 0;
+    ptr->num = 0;
+    ptr->cap = 4;
+    ptr->next = _ALLOC_ARRAY(Factor*, ptr->cap);
+
+    return ptr;
+}
+
+static Factor* add_branch(Factor* node, int sym) {
+
+    for(int i = 0; i < node->num; i++)
+        if(node->next[i]->sym == sym)
+            return node->next[i];
+
+    if(node->num + 1 > node->cap) {
+        node->cap <<= 1;
+        node->next = _REALLOC_ARRAY(node->next, Factor*, node->cap);
+    }
+
+    Factor* ptr = create_factor(sym);
+    node->next[node->num++] = ptr;
+
+    return ptr;
+}
+
+/*
+ * Build the prefix tree for a list of rule lines. The first skip symbols of
+ * every line are left out, which is how the leading recursive symbol of the
+ * left recursive tails is dropped.
+ */
+Factor* create_factor_tree(RuleList* list, int skip) {
+
+    Factor* root = create_factor(-1);
+
+    int num = 1;
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(list);
+    while(iterate_list(rli, &rule)) {
+        Factor* node = root;
+        for(int i = skip; i < rule->len; i++)
+            node = add_branch(node, rule->list[i]);
+
+        // duplicate lines can never be matched, the first one wins
+        if(node->end == 0)
+            node->end = num;
+        num++;
+    }
+
+    return root;
+}
+
+void destroy_factor_tree(Factor* tree) {
+
+    if(tree != NULL) {
+        for(int i = 0; i < tree->num; i++)
+            destroy_factor_tree(tree->next[i]);
+        _FREE(tree->next);
+        _FREE(tree);
+    }
+}
+
+/*
+ * Number of table entries that the tree takes when it is emitted. Every node
+ * is its size, symbol, end, and number of branches.
+ */
+int factor_tree_size(Factor* tree) {
+
+    int size = 4;
+    for(int i = 0; i < tree->num; i++)
+        size += factor_tree_size(tree->next[i]);
+
+    return size;
+}
+
+/*
+ * Number of nodes where more than one rule line continues, not counting the
+ * root. Every one of these is a prefix that is matched once instead of once
+ * per line.
+ */
+int factor_shared_prefixes(Factor* tree) {
+
+    int count = 0;
+    for(int i = 0; i < tree->num; i++) {
+        Factor* next = tree->next[i];
+        if(next->num > 1 || (next->num > 0 && next->end != 0))
+            count++;
+        count += factor_shared_prefixes(next);
+    }
+
+    return count;
+}
+
+/*
+ * Order the branches of every node by the number of times that the lines
+ * below them matched in a profile, most first. The parser takes the first
+ * branch without trying the others when the line that it matched stops at a
+ * token that the rule can end at, and otherwise every branch is tried and
+ * the longest line wins. Returns the matches of the lines in the tree.
+ */
+uint64_t sort_factor_tree(Factor* tree, const uint64_t* hits) {
+
+    uint64_t total = (tree->end != 0) ? hits[tree->end - 1] : 0;
+    uint64_t* weight = _ALLOC_ARRAY(uint64_t, tree->num + 1);
+
+    for(int i = 0; i < tree->num; i++) {
+        uint64_t value = sort_factor_tree(tree->next[i], hits);
+        Factor* next = tree->next[i];
+        int j = i;
+        for(; j > 0 && weight[j - 1] < value; j--) {
+            weight[j] = weight[j - 1];
+            tree->next[j] = tree->next[j - 1];
+        }
+        weight[j] = value;
+        tree->next[j] = next;
+        total += value;
+    }
+
+    _FREE(weight);
+    return total;
+}
+
+/*
+ * Public Interface
+ */
+void left_factor(Parser* pstate) {
+
+    LOG(FLEVEL, "ENTER: left factor");
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        nterm->tree = create_factor_tree(nterm->list, 0);
+        nterm->tail_tree = create_factor_tree(nterm->tails, 1);
+        LOG(FLEVEL, "factored %s: %d shared prefixes", raw_string(nterm->name),
+            factor_shared_prefixes(nterm->tree) + factor_shared_prefixes(nterm->tail_tree));
+    }
+
+    LOG(FLEVEL, "LEAVE: left factor");
+}
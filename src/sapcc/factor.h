@@ -0,0 +1,27 @@
+/*
+ * Left factoring. The rule lines of a non-terminal are merged into a prefix
+ * tree, so that lines that start with the same symbols share one path until
+ * the point where they differ. The generated parser walks the tree and only
+ * backtracks to the last branch point instead of the start of the rule.
+ */
+#ifndef _FACTOR_H
+#define _FACTOR_H
+
+#include "parser.h"
+
+typedef struct _factor_ {
+    int sym;                // symbol ID matched at this node, -1 for the root
+    int end;                // rule line that ends at this node plus 1, or 0
+    int num;                // number of branches
+    int cap;
+    struct _factor_** next; // the branches, in the order of the rule lines
+} Factor;
+
+Factor* create_factor_tree(RuleList* list, int skip);
+void destroy_factor_tree(Factor* tree);
+int factor_tree_size(Factor* tree);
+int factor_shared_prefixes(Factor* tree);
+uint64_t sort_factor_tree(Factor* tree, const uint64_t* hits);
+void left_factor(Parser* pstate);
+
+#endif /* _FACTOR_H */
@@ -23,8 +23,6 @@
 #include "keywords.h"
 #include "scanner.h"
 
-static Token token;
-
 /**
  * @brief Comments are not retuned by the scanner. This reads from the ';' and 
  * discards the data.
@@ -47,14 +45,14 @@ static void eat_comment() {
  * character is a '0' then it must be followed by a '.' or a non-digit. Leading
  * '0' in a number is a syntax error.
  */
-static void scan_number() {
+static void scan_number(Token* token) {
 
 }
 
 /**
  * @brief Single and multi-character operators as defined in the grammar.
  */
-static void scan_operator() {
+static void scan_operator(Token* token) {
 
     int ch = get_char();
 
@@ -62,178 +60,178 @@ static void scan_operator() {
     switch(ch) {
         // single character operators
         case '^':   
-            token.type = TOK_POW;       
-            add_string_char(token.str, ch);
+            token->type = TOK_POW;       
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case '(':   
-            token.type = TOK_OPAREN;    
-            add_string_char(token.str, ch);
+            token->type = TOK_OPAREN;    
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case ')':   
-            token.type = TOK_CPAREN;    
-            add_string_char(token.str, ch);
+            token->type = TOK_CPAREN;    
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case '{':   
-            token.type = TOK_OCBRACE;    
-            add_string_char(token.str, ch);
+            token->type = TOK_OCBRACE;    
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case '}':   
-            token.type = TOK_CCBRACE;    
-            add_string_char(token.str, ch);
+            token->type = TOK_CCBRACE;    
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case '[':   
-            token.type = TOK_OSBRACE;  
-            add_string_char(token.str, ch);
+            token->type = TOK_OSBRACE;  
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case ']':   
-            token.type = TOK_CSBRACE;
-            add_string_char(token.str, ch);
+            token->type = TOK_CSBRACE;
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case '.':
-            token.type = TOK_DOT;
-            add_string_char(token.str, ch);
+            token->type = TOK_DOT;
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case ',':
-            token.type = TOK_COMMA;
-            add_string_char(token.str, ch);
+            token->type = TOK_COMMA;
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case '@':
-            token.type = TOK_AMPER;
-            add_string_char(token.str, ch);
+            token->type = TOK_AMPER;
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case ':':
-            token.type = TOK_COLON;
-            add_string_char(token.str, ch);
+            token->type = TOK_COLON;
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case '&':
-            token.type = TOK_AND;
-            add_string_char(token.str, ch);
+            token->type = TOK_AND;
+            add_string_char(token->str, ch);
             consume_char();
             return;
         case '|':
-            token.type = TOK_OR;
-            add_string_char(token.str, ch);
+            token->type = TOK_OR;
+            add_string_char(token->str, ch);
             consume_char();
             return;
 
         // multi-character operators
         case '<': {
-                add_string_char(token.str, ch);
+                add_string_char(token->str, ch);
                 ch = consume_char();
                 if(ch == '=') {
-                    add_string_char(token.str, ch);
+                    add_string_char(token->str, ch);
                     consume_char();
-                    token.type = TOK_LTOE;
+                    token->type = TOK_LTOE;
                 }
                 else 
-                    token.type = TOK_LT;
+                    token->type = TOK_LT;
             }
             return;
         case '>': {
-                add_string_char(token.str, ch);
+                add_string_char(token->str, ch);
                 ch = consume_char();
                 if(ch == '=') {
-                    add_string_char(token.str, ch);
+                    add_string_char(token->str, ch);
                     consume_char();
-                    token.type = TOK_GTOE;
+                    token->type = TOK_GTOE;
                 }
                 else 
-                    token.type = TOK_GT;
+                    token->type = TOK_GT;
             }
             return;
         case '=': {
-                add_string_char(token.str, ch);
+                add_string_char(token->str, ch);
                 ch = consume_char();
                 if(ch == '=') {
-                    add_string_char(token.str, ch);
+                    add_string_char(token->str, ch);
                     consume_char();
-                    token.type = TOK_EQU;
+                    token->type = TOK_EQU;
                 }
                 else 
-                    token.type = TOK_ASSIGN;
+                    token->type = TOK_ASSIGN;
             }
             return;
         case '+': {
-                add_string_char(token.str, ch);
+                add_string_char(token->str, ch);
                 ch = consume_char();
                 if(ch == '=') {
-                    add_string_char(token.str, ch);
+                    add_string_char(token->str, ch);
                     consume_char();
-                    token.type = TOK_ADD_ASSIGN;
+                    token->type = TOK_ADD_ASSIGN;
                 }
                 else 
-                    token.type = TOK_ADD;
+                    token->type = TOK_ADD;
             }
             return;
         case '-': {
-                add_string_char(token.str, ch);
+                add_string_char(token->str, ch);
                 ch = consume_char();
                 if(ch == '=') {
-                    add_string_char(token.str, ch);
+                    add_string_char(token->str, ch);
                     consume_char();
-                    token.type = TOK_SUB_ASSIGN;
+                    token->type = TOK_SUB_ASSIGN;
                 }
                 else 
-                    token.type = TOK_SUB;
+                    token->type = TOK_SUB;
             }
             return;
         case '*': {
-                add_string_char(token.str, ch);
+                add_string_char(token->str, ch);
                 ch = consume_char();
                 if(ch == '=') {
-                    add_string_char(token.str, ch);
+                    add_string_char(token->str, ch);
                     consume_char();
-                    token.type = TOK_MUL_ASSIGN;
+                    token->type = TOK_MUL_ASSIGN;
                 }
                 else 
-                    token.type = TOK_MUL;
+                    token->type = TOK_MUL;
             }
             return;
         case '/': {
-                add_string_char(token.str, ch);
+                add_string_char(token->str, ch);
                 ch = consume_char();
                 if(ch == '=') {
-                    add_string_char(token.str, ch);
+                    add_string_char(token->str, ch);
                     consume_char();
-                    token.type = TOK_DIV_ASSIGN;
+                    token->type = TOK_DIV_ASSIGN;
                 }
                 else 
-                    token.type = TOK_DIV;
+                    token->type = TOK_DIV;
             }
             return;
         case '%': {
-                add_string_char(token.str, ch);
+                add_string_char(token->str, ch);
                 ch = consume_char();
                 if(ch == '=') {
-                    add_string_char(token.str, ch);
+                    add_string_char(token->str, ch);
                     consume_char();
-                    token.type = TOK_MOD_ASSIGN;
+                    token->type = TOK_MOD_ASSIGN;
                 }
                 else 
-                    token.type = TOK_MOD;
+                    token->type = TOK_MOD;
             }
             return;
         case '!': {
-                add_string_char(token.str, ch);
+                add_string_char(token->str, ch);
                 ch = consume_char();
                 if(ch == '=') {
-                    add_string_char(token.str, ch);
+                    add_string_char(token->str, ch);
                     consume_char();
-                    token.type = TOK_NEQU;
+                    token->type = TOK_NEQU;
                 }
                 else 
-                    token.type = TOK_NOT;
+                    token->type = TOK_NOT;
             }
             return;
     }
@@ -244,7 +242,7 @@ static void scan_operator() {
  * and then it is checked to see if it is a keyword. Keywords and not case-
  * sensitive.
  */
-static void scan_word() {
+static void scan_word(Token* token) {
 
     int ch;
 
@@ -252,7 +250,7 @@ static void scan_word() {
     while(true) {
         ch = get_char();
         if(isalnum(ch) || ch == '_') {
-            add_string_char(token.str, ch);
+            add_string_char(token->str, ch);
             consume_char();
         }
         else 
@@ -263,48 +261,36 @@ static void scan_word() {
 /**
  * @brief Mark the token with the file name and the line number.
  */
-static void finish_token() {
+static void finish_token(Token* token) {
 
-    token.line_no = get_line_no();
-    token.col_no = get_col_no();
-    token.fname = get_fname(); // simple const char*
+    token->line_no = get_line_no();
+    token->col_no = get_col_no();
+    token->fname = get_fname(); // simple const char*
 }
 
 /**
- * @brief Allocate the data structures that the scanner uses. This function
- * must be called before any characters are scanned.
+ * @brief This function reads a token from the input stream and writes it 
+ * into the slot that the token queue passes in. The slot is reused after the
+ * queue has consumed it, so if it already has a string then that string is 
+ * cleared and used again. Nothing is copied.
  * 
+ * @param token 
  * 
  * @author Charles Tilbury (chucktilbury@gmail.com)
  * @date 01-10-2024
  * @version 0.0
  * @copyright Copyright (c) 2024
  */
-void init_scanner() {
-
-    memset(&token, 0, sizeof(Token));
-    token.str = create_string(NULL);
-}
-
-/**
- * @brief This function reads a token from the input stream and returns in in 
- * a pointer to a global static Token data structure. When the token is read, 
- * a deep copy is performed to preserve the value. This keeps us from having 
- * to recompose the data structhre every time a token is read.
- * 
- * @return Token* 
- * 
- * @author Charles Tilbury (chucktilbury@gmail.com)
- * @date 01-10-2024
- * @version 0.0
- * @copyright Copyright (c) 2024
- */
-Token* scan_token() {
+void scan_token(Token* token) {
 
     bool finished = false;
     int ch;
 
-    clear_string(token.str);    
+    if(token->str == NULL)
+        token->str = create_string(NULL);
+    else
+        clear_string(token->str);
+
     while(!finished) {
         ch = get_char();
 
@@ -318,26 +304,26 @@ Token* scan_token() {
         }
         // scan a number and return it
         else if(isdigit(ch)) {
-            scan_number();
+            scan_number(token);
             finished = true;
         }
         // scan an operator and return it
         else if(ispunct(ch)) {
-            scan_operator();
+            scan_operator(token);
             finished = true;
         }
         // symbols and keywords start with a letter
         else if(isalpha(ch)) {
-            scan_word();
+            scan_word(token);
             finished = true;
         }
         // end of input has been reached
         else {
-            token.type = END_OF_INPUT;
-            return &token;  // do not update the line, etc.
+            token->type = END_OF_INPUT;
+            return;  // do not update the line, etc.
         }
     }
 
-    finish_token();
+    finish_token(token);
 }
 
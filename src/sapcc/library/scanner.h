@@ -5,18 +5,19 @@
  * the scanner. Note that the library has support routines for common 
  * operations that the scanner needs to perform. The scanner must implement a
  * stream of tokens. This stream is used to implement the look-ahead capability 
- * of the parser. The default scanner implements it as a linked list. When 
- * advance_token() is called, and the current token is at the end of the list, 
- * then another token is added to the end of the list and made the current 
- * token. When a rule fails to match, then the current token is rolled back to 
- * the head of the list and that is made the current token so that the next 
- * alternative rule can be attempted to match. Tokens are drawn from the list 
- * instead of the input file as long as the end of the list is not reached. If 
- * no rule can match the stream of tokens in the list, then there is an error 
- * created and the error handler manipulates the list to implement error 
- * recovery. If the rule is a match, then the tokens that are in the list up 
- * to the current token are discarded from the list. Tokens that are important 
- * to the match should have been copied to preserve their value.
+ * of the parser. The default scanner implements it as a growable ring of 
+ * token records. When advance_token() is called, and the current token is at
+ * the end of the ring, then the scanner writes the next token into the next
+ * slot and that is made the current token. When a rule fails to match, then 
+ * the current token is rolled back to the head of the ring, or to the last 
+ * mark_token(), so that the next alternative rule can be attempted to match. 
+ * Tokens are drawn from the ring instead of the input file as long as the end 
+ * of the ring is not reached. If no rule can match the stream of tokens in the
+ * ring, then there is an error created and the error handler manipulates the 
+ * ring to implement error recovery. If the rule is a match, then the tokens 
+ * that are in the ring up to the current token are discarded and their slots
+ * are reused. Tokens that are important to the match should have been copied 
+ * to preserve their value.
  * 
  * Error handlers need to have direct access to the token stream in order to 
  * recover things like line number information. 
@@ -46,23 +47,55 @@ typedef struct {
     const char* fname;  // File name where the token was taken 
 } Token;
 
+/**
+ * @brief The state of one parse. The token queue is kept in the context, so
+ * that each thread can parse with its own. Every call that reads the token
+ * stream takes it.
+ */
+typedef struct _parser_context_ ParserContext;
+
+/**
+ * @brief Create the context for a parse. It is used by one thread at a time.
+ * 
+ * @return ParserContext* 
+ */
+ParserContext* create_parser_context();
+
+/**
+ * @brief Free the context. The tokens in its queue are gone.
+ * 
+ * @param ctx 
+ */
+void destroy_parser_context(ParserContext* ctx);
+
+/**
+ * @brief Scan the next token from the input into the given slot. This is 
+ * implemented by the scanner and called by the token queue. If the slot
+ * already has a string, then the scanner reuses it.
+ * 
+ * @param tok 
+ */
+void scan_token(Token* tok);
+
 /**
  * @brief Open a file for the scanner to read from. Files are expected to be
  * opened in a stack so that when a file is opened the input stream is 
  * switched. Files are automatically closed when the last character is read.
  * 
+ * @param ctx 
  * @param fname 
  */
-void open_file(const char* fname);
+void open_file(ParserContext* ctx, const char* fname);
 
 /**
  * @brief Get the token object. This returns the current token, which is a 
- * global in the scanner. If the value of this token needs to be preserved, 
+ * slot in the token queue. If the value of this token needs to be preserved, 
  * then the token should be copied.
  * 
+ * @param ctx 
  * @return Token* 
  */
-Token* get_token();
+Token* get_token(ParserContext* ctx);
 
 /**
  * @brief Do a deep copy of the given token pointer. All memory is duplicated.
@@ -78,9 +111,10 @@ Token* copy_token(const Token* tok);
  * returned token is the end of input token. Returns the current token after
  * the advance happens.
  * 
+ * @param ctx 
  * @return Token* 
  */
-Token* advance_token();
+Token* advance_token(ParserContext* ctx);
 
 /**
  * @brief Consume the token queue from the beginning to the current token,
@@ -88,31 +122,62 @@ Token* advance_token();
  * and there is no need to keep that section of the token stream. This 
  * advances the token stream and returns the new current token.
  * 
+ * @param ctx 
  * @return Token* 
  */
-Token* consume_token();
+Token* consume_token(ParserContext* ctx);
 
 /**
  * @brief Reset the token stream to the beginning. This is used when a rule
  * could not be matched and the token stream needs to be rewound to test the
  * next rule in a list of alternatives.
  * 
+ * @param ctx 
+ * @return Token* 
+ */
+Token* reset_token(ParserContext* ctx);
+
+/**
+ * @brief Save the position of the current token. Marks nest, the matching 
+ * rewind_token() or commit_token() closes the last one that was opened. 
+ * Returns the index of the current token.
+ * 
+ * @param ctx 
+ * @return int 
+ */
+int mark_token(ParserContext* ctx);
+
+/**
+ * @brief Close the last mark and make the token that it saved the current 
+ * token. This is used when an alternative fails to match.
+ * 
+ * @param ctx 
+ * @return Token* 
+ */
+Token* rewind_token(ParserContext* ctx);
+
+/**
+ * @brief Close the last mark and keep the current token where it is. This is
+ * used when an alternative has matched.
+ * 
+ * @param ctx 
  * @return Token* 
  */
-Token* reset_token();
+Token* commit_token(ParserContext* ctx);
 
 /**
  * @brief Iterate the token queue. This is used by consumers that require raw
  * access to the token queue. That includes things like error reporting and
  * recovery. The first time that the iterator is called, the parameter needs
- * to be NULL. The current pointer in the queue is store there in order to 
- * track the location in the queue. When there are no more elements in the 
- * queue, then the return value is NULL.
+ * to be NULL. The location in the queue is stored there in order to track
+ * it. When there are no more elements in the queue, then the return value is
+ * NULL.
  * 
+ * @param ctx 
  * @param mark 
  * @return Token*
  */
-Token* iterate_tokens(void** mark);
+Token* iterate_tokens(ParserContext* ctx, void** mark);
 
 #endif
 
@@ -15,49 +15,110 @@
 #include "util.h"
 #include "scanner.h"
 
-extern Token* scan_token();
-
-typedef struct _tok_queue_item_ {
-    Token* tok;
-    struct _tok_queue_item_* next;
-} TokQueueItem;
-
+/*
+ * The queue is a ring of token records. The indexes in the queue only ever 
+ * count up and the slot for an index is the index masked by the size of the
+ * ring, which is always a power of 2. The tokens between the head and the 
+ * tail are kept. When the ring is full it is doubled. The slots are reused 
+ * after they are consumed, so a token is scanned directly into its slot and
+ * the string that it has is reused for the next token.
+ */
 typedef struct {
-    TokQueueItem* head;
-    TokQueueItem* crnt;
-    TokQueueItem* tail;
+    Token* ring;    // the token records
+    int size;       // number of slots, a power of 2
+    int head;       // the first token that is kept
+    int crnt;       // the current token
+    int tail;       // one past the last token that was scanned
+    int* marks;     // stack of checkpoints for mark_token()
+    int num_marks;
+    int cap_marks;
 } TokQueue;
 
-static TokQueue* tqueue = NULL;
+#define SLOT(idx) (&tqueue->ring[(idx) & (tqueue->size - 1)])
+
+/*
+ * Everything that a parse keeps between calls. The functions that read the
+ * token stream take the context, so each thread that parses has its own.
+ */
+struct _parser_context_ {
+    TokQueue* tqueue;
+};
+
+/*
+ * Double the size of the ring. The indexes of the tokens do not change, but
+ * the slots that they live in do.
+ */
+static void grow_queue(TokQueue* tqueue) {
+
+    int size = tqueue->size * 2;
+    Token* ring = _ALLOC_ARRAY(Token, size);
+
+    memset(ring, 0, sizeof(Token) * size);
+    for(int idx = tqueue->head; idx < tqueue->tail; idx++)
+        ring[idx & (size - 1)] = *SLOT(idx);
+
+    _FREE(tqueue->ring);
+    tqueue->ring = ring;
+    tqueue->size = size;
+}
 
 /*
- * Append a token to the end of the queue. It could be that advance_token()
- * has found the end of the queue, but it could be something else. 
+ * Scan a token into the slot at the end of the queue. It could be that
+ * advance_token() has found the end of the queue, but it could be something
+ * else. 
  */
-static void append_token(Token* tok) {
+static void append_token(TokQueue* tqueue) {
 
     assert(tqueue != NULL);
-    assert(tok != NULL);
+
+    if(tqueue->tail - tqueue->head == tqueue->size)
+        grow_queue(tqueue);
+
+    scan_token(SLOT(tqueue->tail));
+    tqueue->tail++;
+}
+
+/**
+ * @brief Create the context for a parse. The queue is primed when the first
+ * file is opened.
+ * 
+ * @return ParserContext* 
+ */
+ParserContext* create_parser_context() {
+
+    ParserContext* ctx = NULL;
 
     TRY {
-        TokQueueItem* item = _ALLOC_T(TokQueueItem);
-        item->tok = copy_token(tok);
+        ctx = _ALLOC_T(ParserContext);
+        ctx->tqueue = _ALLOC_T(TokQueue);
+        memset(ctx->tqueue, 0, sizeof(TokQueue));
+        ctx->tqueue->size = 64;
+        ctx->tqueue->ring = _ALLOC_ARRAY(Token, ctx->tqueue->size);
+        memset(ctx->tqueue->ring, 0, sizeof(Token) * ctx->tqueue->size);
     }
-    ANY_EXCEPT() {
+    EXCEPT(MEMORY_ERROR) {
         fprintf(stderr, "Fatal ");
         fprintf(stderr, "%s\n", EXCEPTION_MSG);
         exit(1);
     }
 
-    if(tqueue->tail != NULL) {
-        tqueue->tail->next = item;
-        tqueue->tail = item;
-    }
-    else {
-        tqueue->head = item;
-        tqueue->crnt = item;
-        tqueue->tail = item;
-    }
+    return ctx;
+}
+
+/**
+ * @brief Free the context and the tokens in its queue.
+ * 
+ * @param ctx 
+ */
+void destroy_parser_context(ParserContext* ctx) {
+
+    assert(ctx != NULL);
+
+    _FREE(ctx->tqueue->ring);
+    if(ctx->tqueue->marks != NULL)
+        _FREE(ctx->tqueue->marks);
+    _FREE(ctx->tqueue);
+    _FREE(ctx);
 }
 
 /**
@@ -65,15 +126,17 @@ static void append_token(Token* tok) {
  * opened in a stack so that when a file is opened the input stream is 
  * switched. Files are automatically closed when the last character is read.
  * 
+ * @param ctx 
  * @param fname 
  */
-void open_file(const char* fname) {
+void open_file(ParserContext* ctx, const char* fname) {
+
+    TokQueue* tqueue = ctx->tqueue;
 
-    if(tqueue == NULL) {
+    if(tqueue->tail == 0) {
         TRY {
             // prime the token pipeline
-            tqueue = _ALLOC_T(TokQueue);
-            append_token(scan_token());
+            append_token(tqueue);
         }
         EXCEPT(MEMORY_ERROR) {
             fprintf(stderr, "Fatal ");
@@ -95,21 +158,19 @@ void open_file(const char* fname) {
 
 /**
  * @brief Get the token object. This returns the current token, which is a 
- * global in the scanner. If the value of this token needs to be preserved, 
+ * slot in the token queue. The slot is reused when the queue grows or after
+ * the token is consumed. If the value of this token needs to be preserved, 
  * then the token should be copied.
  * 
+ * @param ctx 
  * @return Token* 
  */
-Token* get_token() {
+Token* get_token(ParserContext* ctx) {
 
+    TokQueue* tqueue = ctx->tqueue;
     assert(tqueue != NULL);
 
-    if(tqueue->crnt != NULL) {
-        return tqueue->crnt->tok;
-    }
-
-    // Should never happen. Will probably cause a segfault.
-    return NULL;
+    return SLOT(tqueue->crnt);
 }
 
 /**
@@ -146,40 +207,46 @@ Token* copy_token(const Token* tok) {
  * returned token is the end of input token. Returns the current token after
  * the advance happens.
  * 
+ * @param ctx 
  * @return Token* 
  */
-Token* advance_token() {
+Token* advance_token(ParserContext* ctx) {
+
+    TokQueue* tqueue = ctx->tqueue;
 
     // avoid stupid programmer tricks
     assert(tqueue != NULL);
-    assert(tqueue->crnt != NULL);
 
-    if(tqueue->crnt->tok->type != END_OF_INPUT) {
-        if(tqueue->crnt->next == NULL)
-            append_token(scan_token());
+    if(SLOT(tqueue->crnt)->type != END_OF_INPUT) {
+        if(tqueue->crnt + 1 == tqueue->tail)
+            append_token(tqueue);
 
-        tqueue->crnt = tqueue->crnt->next;
+        tqueue->crnt++;
     }
 
-    return tqueue->crnt->tok;
+    return SLOT(tqueue->crnt);
 }
 
 /**
  * @brief Consume the token queue from the beginning to the current token.
  * This is called when a rule has been matched and there is no need to keep 
- * that section of the token stream. Returns the current token. NOTE: this
- * library routine expects to use garbage collections.
+ * that section of the token stream. Returns the current token. Tokens that
+ * an open mark_token() can still rewind to are kept.
  * 
+ * @param ctx 
  * @return Token* 
  */
-Token* consume_token() {
+Token* consume_token(ParserContext* ctx) {
 
+    TokQueue* tqueue = ctx->tqueue;
     assert(tqueue != NULL);
-    assert(tqueue->crnt != NULL);
 
-    tqueue->head = tqueue->crnt;
+    if(tqueue->num_marks > 0 && tqueue->marks[0] < tqueue->crnt)
+        tqueue->head = tqueue->marks[0];
+    else
+        tqueue->head = tqueue->crnt;
 
-    return tqueue->crnt->tok;
+    return SLOT(tqueue->crnt);
 }
 
 /**
@@ -187,49 +254,113 @@ Token* consume_token() {
  * could not be matched and the token stream needs to be rewound to test the
  * next rule in a list of alternatives.
  * 
+ * @param ctx 
  * @return Token* 
  */
-Token* reset_token() {
+Token* reset_token(ParserContext* ctx) {
 
+    TokQueue* tqueue = ctx->tqueue;
     assert(tqueue != NULL);
-    assert(tqueue->crnt != NULL);
 
     tqueue->crnt = tqueue->head;
 
-    return tqueue->crnt->tok;
+    return SLOT(tqueue->crnt);
+}
+
+/**
+ * @brief Save the position of the current token. Marks nest, the matching 
+ * rewind_token() or commit_token() closes the last one that was opened. The
+ * tokens from the oldest open mark on are kept until it is closed. Returns 
+ * the index of the current token.
+ * 
+ * @param ctx 
+ * @return int 
+ */
+int mark_token(ParserContext* ctx) {
+
+    TokQueue* tqueue = ctx->tqueue;
+    assert(tqueue != NULL);
+
+    if(tqueue->num_marks + 1 > tqueue->cap_marks) {
+        tqueue->cap_marks = (tqueue->cap_marks == 0)? 8: tqueue->cap_marks * 2;
+        tqueue->marks = (tqueue->marks == NULL)? 
+                _ALLOC_ARRAY(int, tqueue->cap_marks):
+                _REALLOC_ARRAY(tqueue->marks, int, tqueue->cap_marks);
+    }
+    tqueue->marks[tqueue->num_marks++] = tqueue->crnt;
+
+    return tqueue->crnt;
+}
+
+/**
+ * @brief Close the last mark and make the token that it saved the current 
+ * token. This is used when an alternative fails to match. Returns the 
+ * current token.
+ * 
+ * @param ctx 
+ * @return Token* 
+ */
+Token* rewind_token(ParserContext* ctx) {
+
+    TokQueue* tqueue = ctx->tqueue;
+    assert(tqueue != NULL);
+    assert(tqueue->num_marks > 0);
+
+    tqueue->crnt = tqueue->marks[--tqueue->num_marks];
+
+    return SLOT(tqueue->crnt);
+}
+
+/**
+ * @brief Close the last mark and keep the current token where it is. This is
+ * used when an alternative has matched. Returns the current token.
+ * 
+ * @param ctx 
+ * @return Token* 
+ */
+Token* commit_token(ParserContext* ctx) {
+
+    TokQueue* tqueue = ctx->tqueue;
+    assert(tqueue != NULL);
+    assert(tqueue->num_marks > 0);
+
+    tqueue->num_marks--;
+
+    return SLOT(tqueue->crnt);
 }
 
 /**
  * @brief Iterate the token queue. This is used by consumers that require raw
  * access to the token queue. That includes things like error reporting and
  * recovery. The first time that the iterator is called, the parameter needs
- * to be NULL. The current pointer in the queue is store there in order to 
- * track the location in the queue. When there are no more elements in the 
+ * to be NULL. The index of the last token plus one is stored there in order
+ * to track the location in the queue. When there are no more elements in the 
  * queue, then the return value is NULL.
  * 
  * Example:
  * void* mark = NULL;
- * for(Token* tok = iterate_tokens(&mark); 
+ * for(Token* tok = iterate_tokens(ctx, &mark); 
  *            tok != NULL; 
- *            tok = iterate_tokens(&mark)) {
+ *            tok = iterate_tokens(ctx, &mark)) {
  *     // do stuff with tok
  * }
  *  
+ * @param ctx 
  * @param mark 
  * @return Token*
  */
-Token* iterate_tokens(void** mark) {
+Token* iterate_tokens(ParserContext* ctx, void** mark) {
 
+    TokQueue* tqueue = ctx->tqueue;
     assert(tqueue != NULL);
-    assert(tqueue->head != NULL);
 
-    if(*mark == NULL) 
-        *mark = tqueue->head;
-    else if(((TokQueueItem*)(*mark))->next != NULL)
-        *mark = ((TokQueueItem*)(*mark))->next;
-    else
+    intptr_t idx = (*mark == NULL)? tqueue->head: (intptr_t)(*mark);
+
+    if(idx >= tqueue->tail)
         return NULL;
 
-    return ((TokQueueItem*)(*mark))->tok;
+    *mark = (void*)(idx + 1);
+
+    return SLOT(idx);
 }
 
@@ -5,9 +5,30 @@
 #include "util.h"
 #include "paths.h"
 #include "emitters.h"
+#include "report.h"
+#include "profile.h"
 
 CmdLine cmd;
 
+/*
+ * The file name of an option that has no default, or NULL when it was not
+ * given.
+ */
+static const char* get_file_option(const char* name) {
+
+    const char* fname;
+
+    TRY {
+        fname = get_cmd_raw(cmd, name);
+    }
+    EXCEPT(LIST_ERROR) {
+        fname = NULL;
+    }
+    FINAL
+
+    return fname;
+}
+
 int main(int argc, char** argv) {
 
     cmd = create_cmd_line(
@@ -17,10 +38,32 @@ int main(int argc, char** argv) {
     add_cmd(cmd, "-o", "ofile", "Set the base name of the output files.", NULL, CMD_STR);
     // leaving this at 0 prints only warnings and errors.
     add_cmd(cmd, "-v", "verbo", "Set the verbosity level.", "0", CMD_INT);
+    // Emit the LL(1) predict table. Setting it to 0 always backtracks.
+    add_cmd(cmd, "-p", "predict", "Emit a predictive parse table.", "1", CMD_INT);
+    // Pack the tables of the table backend, which a large grammar needs.
+    add_cmd(cmd, "-z", "compress", "Compress the parse tables.", "0", CMD_INT);
+    // Memoize every non-terminal, not only the ones in %memo blocks.
+    add_cmd(cmd, "-m", "memo", "Memoize all non-terminals.", "0", CMD_INT);
+    // Select how the parser is written, "table" or "direct".
+    add_cmd(cmd, "-b", "backend", "Select the parser backend.", "table", CMD_STR);
+    // Define USE_PROFILE in the parser header, see dump_profile().
+    add_cmd(cmd, "-P", "profile", "Count the work of every rule.", "0", CMD_INT);
+    // Print the cost of the grammar instead of emitting the parser.
+    add_cmd(cmd, "-a", "analyze", "Report the grammar shapes that are slow to parse.", "0", CMD_INT);
+    // Write the rule graph in DOT notation to this file.
+    add_cmd(cmd, "-g", "graph", "Write the rule graph to a DOT file.", NULL, CMD_STR);
+    // Read the CSV that dump_profile() writes to order the rule lines.
+    add_cmd(cmd, "-u", "use", "Lay out the parser by a profile.", NULL, CMD_STR);
     // Set the highest pass level. Setting it to 0 tests the scanner only.
     add_cmd(cmd, "", "file", "File name of the grammar to generate.", NULL, CMD_REQD | CMD_STR);
     parse_cmd_line(cmd, argc, argv);
 
+    const char* backend = get_cmd_raw(cmd, "backend");
+    if(strcmp(backend, "table") && strcmp(backend, "direct")) {
+        fatal("unknown backend \"%s\", expected table or direct", backend);
+        return 1;
+    }
+
     init_parser();
 
     Parser* pstate = parser();
@@ -31,8 +74,18 @@ int main(int argc, char** argv) {
     }
 #endif
 
-    if(!get_errors())
-        emit_all(pstate);
+    const char* fname = get_file_option("use");
+    if(!get_errors() && fname != NULL)
+        read_profile(pstate, fname);
+
+    if(!get_errors()) {
+        if(get_cmd_int(cmd, "analyze"))
+            report_grammar(pstate, stdout);
+        else
+            emit_all(pstate);
+        if(NULL != (fname = get_file_option("graph")))
+            write_rule_graph(pstate, fname);
+    }
 
     if(1 <= VERBOSITY())
         printf("%s\n", get_errors() ? "failed" : "success");
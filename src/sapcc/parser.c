@@ -1,6 +1,10 @@
 
 #include "parser.h"
+#include "analysis.h"
 #include "errors.h"
+#include "factor.h"
+#include "precedence.h"
+#include "dfa.h"
 #include "logger.h"
 
 #define PLEVEL 20
@@ -9,7 +13,10 @@ static Parser* parser_state;
 static Rule* create_rule() {
 
     Rule* ptr = _ALLOC_T(Rule);
-    ptr->list = create_string_list();
+    ptr->cap = 8;
+    ptr->len = 0;
+    ptr->list = _ALLOC_ARRAY(int, ptr->cap);
+    ptr->hits = 0;
 
     return ptr;
 }
@@ -17,11 +24,20 @@ static Rule* create_rule() {
 static void destroy_rule(Rule* ptr) {
 
     if(ptr != NULL) {
-        destroy_string_list(ptr->list);
+        _FREE(ptr->list);
         _FREE(ptr);
     }
 }
 
+static void add_rule_symbol(Rule* ptr, int id) {
+
+    if(ptr->len + 1 > ptr->cap) {
+        ptr->cap <<= 1;
+        ptr->list = _REALLOC_ARRAY(ptr->list, int, ptr->cap);
+    }
+    ptr->list[ptr->len++] = id;
+}
+
 /*
  * Rule list functions simplify casting.
  */
@@ -65,8 +81,21 @@ static NonTerminal* create_nonterminal() {
 
     ptr->name = create_string(NULL);
     ptr->list = create_rule_list();
+    ptr->tails = create_rule_list();
+    ptr->lr_head = false;
+    ptr->memo = false;
+    ptr->tries = 0;
+    ptr->profiled = false;
+    ptr->cold = false;
+    ptr->prec_set = false;
+    ptr->assoc = ASSOC_NONE;
+    ptr->tree = NULL;
+    ptr->tail_tree = NULL;
+    ptr->oper = NULL;
     ptr->ref = 0;
     ptr->val = 0;
+    ptr->id = 0;
+    ptr->line_no = 0;
 
     return ptr;
 }
@@ -76,6 +105,10 @@ static void destroy_nonterminal(NonTerminal* ptr) {
     if(ptr != NULL) {
         destroy_string(ptr->name);
         destroy_rule_list(ptr->list);
+        destroy_rule_list(ptr->tails);
+        destroy_factor_tree(ptr->tree);
+        destroy_factor_tree(ptr->tail_tree);
+        destroy_oper_level(ptr->oper);
         _FREE(ptr);
     }
 }
@@ -122,8 +155,10 @@ static Terminal* create_terminal() {
     Terminal* ptr = _ALLOC_T(Terminal);
     ptr->name = create_string(NULL);
     ptr->keep = false;
+    ptr->sync = false;
     ptr->ref = 0;
     ptr->val = 0;
+    ptr->id = 0;
 
     return ptr;
 }
@@ -169,6 +204,44 @@ static void destroy_term_list(TermList* ptr) {
     destroy_ptr_list((PtrList*)ptr);
 }
 
+/*
+ * Scanner rule functions.
+ */
+static ScanRule* create_scan_rule() {
+
+    ScanRule* ptr = _ALLOC_T(ScanRule);
+    ptr->name = NULL;
+    ptr->pattern = NULL;
+    ptr->literal = false;
+    ptr->code = NULL;
+    ptr->term = -1;
+
+    return ptr;
+}
+
+static void destroy_scan_rule(ScanRule* ptr) {
+
+    if(ptr != NULL) {
+        if(ptr->name != NULL)
+            destroy_string(ptr->name);
+        if(ptr->pattern != NULL)
+            destroy_string(ptr->pattern);
+        if(ptr->code != NULL)
+            destroy_string(ptr->code);
+        _FREE(ptr);
+    }
+}
+
+static void destroy_scan_rule_list(ScanRuleList* ptr) {
+
+    ScanRule* tmp;
+    ScanRuleListIter* srli = init_ptr_list_iterator((PtrList*)ptr);
+    while(NULL != (tmp = (ScanRule*)iterate_ptr_list(srli)))
+        destroy_scan_rule(tmp);
+
+    destroy_ptr_list((PtrList*)ptr);
+}
+
 static int parse_header() {
 
     int retv = 0;
@@ -205,7 +278,6 @@ static int parse_source() {
 static int parse_tokens() {
 
     Token* tok = get_token();
-    int value = BASE_TERM;
 
     if(tok->type != OBRACE) {
         syntax_error("expected a '{' but got a %s", tok_type_to_str(tok->type));
@@ -224,7 +296,17 @@ static int parse_tokens() {
             }
             term->name = copy_string(tok->str);
             term->ref = 0;
-            term->val = value++;
+
+            Symbol* sym = intern_symbol(parser_state->symbols, tok->str);
+            if(sym->term != NULL) {
+                syntax_error("terminal %s is defined more than once",
+                             raw_string(sym->name));
+                consume_token();
+                return 1;
+            }
+            sym->term = term;
+            term->id = sym->id;
+
             add_term_list(parser_state->terminals, term);
             consume_token();
         }
@@ -243,6 +325,195 @@ static int parse_tokens() {
     return 0;
 }
 
+/*
+ * When this is entered, the "%stream" token has already been read. It is
+ * followed by a '{', the name of the non-terminal that the input is a list
+ * of, and a '}'. The generated parser hands each one to a callback as soon
+ * as it is matched.
+ */
+static int parse_stream() {
+
+    Token* tok = get_token();
+
+    if(tok->type != OBRACE) {
+        syntax_error("expected a '{' but got a %s", tok_type_to_str(tok->type));
+        return 1;
+    }
+    else
+        consume_token();
+
+    tok = get_token();
+    if(tok->type != SYMBOL) {
+        syntax_error("expected a non-terminal SYMBOL but got a %s", tok_type_to_str(tok->type));
+        consume_token();
+        return 1;
+    }
+    else if(parser_state->stream_name != NULL) {
+        syntax_error("only one non-terminal can be streamed, %s is already",
+                     raw_string(parser_state->stream_name));
+        consume_token();
+        return 1;
+    }
+    else {
+        parser_state->stream_name = copy_string(tok->str);
+        consume_token();
+    }
+
+    tok = get_token();
+    if(tok->type != CBRACE) {
+        syntax_error("expected a '}' but got a %s", tok_type_to_str(tok->type));
+        consume_token();
+        return 1;
+    }
+    else
+        consume_token();
+
+    return 0;
+}
+
+/*
+ * When this is entered, the "%memo" token has already been read. It is
+ * followed by a '{' and the names of the non-terminals that the generated
+ * parser memoizes, and a '}'. The names are checked after the grammar is
+ * read because they can come before the non-terminals are defined.
+ */
+static int parse_memo() {
+
+    Token* tok = get_token();
+
+    if(tok->type != OBRACE) {
+        syntax_error("expected a '{' but got a %s", tok_type_to_str(tok->type));
+        return 1;
+    }
+    else
+        consume_token();
+
+    while(true) {
+        tok = get_token();
+        if(tok->type == SYMBOL) {
+            add_string_list(parser_state->memos, copy_string(tok->str));
+            consume_token();
+        }
+        else if(tok->type == CBRACE) {
+            consume_token();
+            return 0;
+        }
+        else {
+            syntax_error("expected a non-terminal SYMBOL or a '}', but got a %s",
+                         tok_type_to_str(tok->type));
+            consume_token();
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * When this is entered, the "%sync" token has already been read. It is
+ * followed by a '{' and the names of the terminals that the generated parser
+ * skips to after a syntax error, and a '}'. The names are checked after the
+ * grammar is read, like the %memo names.
+ */
+static int parse_sync() {
+
+    Token* tok = get_token();
+
+    if(tok->type != OBRACE) {
+        syntax_error("expected a '{' but got a %s", tok_type_to_str(tok->type));
+        return 1;
+    }
+    else
+        consume_token();
+
+    while(true) {
+        tok = get_token();
+        if(tok->type == SYMBOL) {
+            add_string_list(parser_state->syncs, copy_string(tok->str));
+            consume_token();
+        }
+        else if(tok->type == CBRACE) {
+            consume_token();
+            return 0;
+        }
+        else {
+            syntax_error("expected a terminal SYMBOL or a '}', but got a %s",
+                         tok_type_to_str(tok->type));
+            consume_token();
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * When this is entered, the "%scanner" token has already been read. It is
+ * followed by a '{' and the scanner rules, and a '}'. A rule is an optional
+ * terminal name, a ':', a "literal" or a (regular expression) pattern, and an
+ * optional code block. A rule without a name matches text that is skipped.
+ */
+static int parse_scanner() {
+
+    Token* tok = get_token();
+
+    if(tok->type != OBRACE) {
+        syntax_error("expected a '{' but got a %s", tok_type_to_str(tok->type));
+        return 1;
+    }
+    else
+        consume_token();
+
+    while(true) {
+        tok = get_token();
+        if(tok->type == CBRACE) {
+            consume_token();
+            return 0;
+        }
+
+        ScanRule* rule = create_scan_rule();
+        if(tok->type == SYMBOL) {
+            rule->name = copy_string(tok->str);
+            consume_token();
+            tok = get_token();
+        }
+
+        if(tok->type != COLON) {
+            syntax_error("expected a ':' but got a %s", tok_type_to_str(tok->type));
+            destroy_scan_rule(rule);
+            consume_token();
+            return 1;
+        }
+        consume_token();
+
+        tok = get_token();
+        if(tok->type != LITERAL && tok->type != REGEX) {
+            syntax_error("expected a \"literal\" or a (regular expression) but got a %s",
+                         tok_type_to_str(tok->type));
+            destroy_scan_rule(rule);
+            consume_token();
+            return 1;
+        }
+        rule->pattern = copy_string(tok->str);
+        rule->literal = (tok->type == LITERAL);
+        consume_token();
+
+        tok = get_token();
+        if(tok->type == OBRACE) {
+            if(scan_block() == 0) {
+                destroy_scan_rule(rule);
+                return 1;
+            }
+            rule->code = copy_string(tok->str);
+            consume_token();
+        }
+
+        add_ptr_list((PtrList*)parser_state->scan_rules, (void*)rule);
+    }
+
+    return 0;
+}
+
 /*
  * When this is entered, a ':' has been read for a rule line.
  */
@@ -254,7 +525,7 @@ static int parse_rule(NonTerminal* nterm) {
     while(true) {
         Token* tok = get_token();
         if(tok->type == SYMBOL) {
-            add_string_list(rule->list, copy_string(tok->str));
+            add_rule_symbol(rule, intern_symbol(parser_state->symbols, tok->str)->id);
             consume_token();
         }
         else if(tok->type == COLON || tok->type == CBRACE)
@@ -266,6 +537,18 @@ static int parse_rule(NonTerminal* nterm) {
             return 1;
         }
     }
+
+    if(rule->len == 0) {
+        syntax_error("blank rules are not allowed in %s", raw_string(nterm->name));
+        destroy_rule(rule);
+        return 1;
+    }
+    else if(rule->len > MAX_RULE_LEN) {
+        syntax_error("a rule in %s has more than %d symbols", raw_string(nterm->name), MAX_RULE_LEN);
+        destroy_rule(rule);
+        return 1;
+    }
+    rule->alt = length_list(nterm->list) + 1;
     add_rule_list(nterm->list, rule);
 
     return 0;
@@ -324,7 +607,6 @@ static int parse_rules(NonTerminal* nterm) {
 static int parse_grammar() {
 
     Token* tok = get_token();
-    int value = BASE_NTERM;
 
     if(tok->type != OBRACE) {
         syntax_error("expected a '{' but got a %s", tok_type_to_str(tok->type));
@@ -338,6 +620,17 @@ static int parse_grammar() {
         if(tok->type == SYMBOL) {
             NonTerminal* ptr = create_nonterminal();
             ptr->name = copy_string(tok->str);
+            ptr->line_no = get_line_no();
+
+            Symbol* sym = intern_symbol(parser_state->symbols, tok->str);
+            if(sym->nterm != NULL) {
+                syntax_error("non-terminal %s is defined more than once",
+                             raw_string(sym->name));
+                consume_token();
+                return 1;
+            }
+            sym->nterm = ptr;
+            ptr->id = sym->id;
             consume_token();
 
             // optional precedence number
@@ -346,7 +639,23 @@ static int parse_grammar() {
                 tok = get_token();
                 if(tok->type == NUMBER) {
                     ptr->prec = strtol(raw_string(tok->str), NULL, 10);
+                    ptr->prec_set = true;
                     consume_token();
+
+                    // optional associativity of an operator level
+                    tok = get_token();
+                    if(tok->type == SYMBOL) {
+                        if(!strcmp(raw_string(tok->str), "left"))
+                            ptr->assoc = ASSOC_LEFT;
+                        else if(!strcmp(raw_string(tok->str), "right"))
+                            ptr->assoc = ASSOC_RIGHT;
+                        else {
+                            syntax_error("expected left or right but got %s",
+                                         raw_string(tok->str));
+                            return 1;
+                        }
+                        consume_token();
+                    }
                 }
                 else {
                     syntax_error("expected a number but got a %s",
@@ -363,7 +672,6 @@ static int parse_grammar() {
             }
 
             ptr->ref = 0;
-            ptr->val = value++;
 
             // add it to the list
             add_nterm_list(parser_state->non_terminals, ptr);
@@ -387,22 +695,20 @@ static void dump_terminal(Terminal* term) {
 
     printf("\t%-20s", raw_string(term->name));
     printf("keep:%-7s", term->keep ? "true " : "false");
+    printf("sync:%-7s", term->sync ? "true " : "false");
     printf("value:%-6d", term->val);
     printf("references:%d\n", term->ref);
 }
 
-static void dump_rules(NonTerminal* nterm) {
+static void dump_rules(RuleList* list, const char* note) {
 
     Rule* rule;
-    RuleListIter* rli = init_rule_list_iter(nterm->list);
+    RuleListIter* rli = init_rule_list_iter(list);
     while(NULL != (rule = iterate_rule_list(rli))) {
         printf("\t: ");
-        Str* s;
-        StrListIter* sli = init_string_list_iterator(rule->list);
-        while(NULL != (s = iterate_string_list(sli))) {
-            printf("%s ", raw_string(s));
-        }
-        printf("\n");
+        for(int i = 0; i < rule->len; i++)
+            printf("%s ", raw_string(get_symbol_by_id(parser_state->symbols, rule->list[i])->name));
+        printf("%s\n", note);
     }
 }
 
@@ -410,8 +716,13 @@ static void dump_nonterminal(NonTerminal* nterm) {
 
     printf("%s\t", raw_string(nterm->name));
     printf("value:%d\t", nterm->val);
-    printf("references:%d\n", nterm->ref);
-    dump_rules(nterm);
+    printf("references:%d", nterm->ref);
+    printf("%s", nterm->lr_head ? "\tleft recursive head" : "");
+    printf("%s", nterm->memo ? "\tmemoized" : "");
+    printf("%s", (nterm == parser_state->stream) ? "\tstreamed" : "");
+    printf("%s\n", (nterm->oper != NULL) ? "\toperator level" : "");
+    dump_rules(nterm->list, "");
+    dump_rules(nterm->tails, "(loop)");
     printf("\n");
 }
 
@@ -443,61 +754,76 @@ void dump_parser() {
     printf("\nNON-TERMINALS:\n");
     while(NULL != (nterm = iterate_nterm_list(ntli)))
         dump_nonterminal(nterm);
+
+    ScanRule* rule;
+    ScanRuleListIter* srli = init_ptr_list_iterator((PtrList*)parser_state->scan_rules);
+    printf("\nSCANNER:\n");
+    while(NULL != (rule = (ScanRule*)iterate_ptr_list(srli)))
+        printf("\t%s: %s%s%s\n", (rule->name != NULL) ? raw_string(rule->name) : "(skip)",
+               rule->literal ? "\"" : "(", raw_string(rule->pattern), rule->literal ? "\"" : ")");
+}
+
+/*
+ * Number the symbols densely once they are all known, the terminals from
+ * BASE_TERM, then the end of the input, then the non-terminals from
+ * BASE_NTERM. A symbol is then an index, and the generated parser keeps the
+ * token and the node types in 16 bits.
+ */
+static void number_symbols() {
+
+    LOG(PLEVEL, "ENTER: number symbols");
+
+    int value = BASE_TERM;
+    Terminal* term;
+    TermListIter* tli = init_list_iterator(parser_state->terminals);
+    while(iterate_list(tli, &term))
+        term->val = value++;
+
+    value = BASE_NTERM;
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(parser_state->non_terminals);
+    while(iterate_list(ntli, &nterm))
+        nterm->val = value++;
+
+    if(value > MAX_SYMBOLS)
+        syntax_error("the grammar has %d symbols, but no more than %d fit in a token type",
+                     value, MAX_SYMBOLS);
+
+    LOG(PLEVEL, "LEAVE: number symbols");
 }
 
 /*
  * Verify that there are no terminals and non-terminals with the same name.
+ * Both definitions land on the same interned symbol, so this is one pass over
+ * the symbol table.
  */
 static void check_duplicates() {
 
     LOG(PLEVEL, "ENTER: check duplicates");
 
-    Terminal* term;
-    TermListIter* tli = init_term_list_iter(parser_state->terminals);
-    while(NULL != (term = iterate_term_list(tli))) {
-        NonTerminal* nterm;
-        NonTermListIter* ntli = init_nterm_list_iter(parser_state->non_terminals);
-        while(NULL != (nterm = iterate_nterm_list(ntli))) {
-            if(!comp_string(term->name, nterm->name)) {
-                syntax_error("terminal and non-terminal have the same name: %s",
-                             raw_string(term->name));
-                return;
-            }
-        }
+    SymbolTable* tab = parser_state->symbols;
+    for(int i = 0; i < num_symbols(tab); i++) {
+        Symbol* sym = get_symbol_by_id(tab, i);
+        if(sym->term != NULL && sym->nterm != NULL)
+            syntax_error("terminal and non-terminal have the same name: %s",
+                         raw_string(sym->name));
     }
 
     LOG(PLEVEL, "LEAVE: check duplicates");
 }
 
-static void increment_reference(Str* str) {
+static void increment_reference(int id) {
 
-    LOG(PLEVEL, "ENTER: increment references: %s", raw_string(str));
+    Symbol* sym = get_symbol_by_id(parser_state->symbols, id);
 
-    // Iterate the terminals and the non-terminals and publish a warning if
-    // they are not referenced.
+    LOG(PLEVEL, "ENTER: increment references: %s", raw_string(sym->name));
 
-    Terminal* term;
-    TermListIter* tli = init_term_list_iter(parser_state->terminals);
-    while(NULL != (term = iterate_term_list(tli))) {
-        if(!comp_string(term->name, str)) {
-            term->ref++;
-            LOG(PLEVEL, "LEAVE: increment term references: %s", raw_string(term->name));
-            return;
-        }
-    }
-
-    NonTerminal* nterm;
-    NonTermListIter* ntli = init_nterm_list_iter(parser_state->non_terminals);
-    while(NULL != (nterm = iterate_nterm_list(ntli))) {
-        if(!comp_string(nterm->name, str)) {
-            nterm->ref++;
-            LOG(PLEVEL, "LEAVE: increment nterm references: %s",
-                raw_string(nterm->name));
-            return;
-        }
-    }
-
-    syntax_error("symbol %s is used but has no definition", raw_string(str));
+    if(sym->term != NULL)
+        sym->term->ref++;
+    else if(sym->nterm != NULL)
+        sym->nterm->ref++;
+    else
+        syntax_error("symbol %s is used but has no definition", raw_string(sym->name));
 
     LOG(PLEVEL, "LEAVE: increment references");
 }
@@ -516,16 +842,207 @@ static void update_references() {
         Rule* rule;
         RuleListIter* rli = init_rule_list_iter(nterm->list);
         while(NULL != (rule = iterate_rule_list(rli))) {
-            Str* str;
-            StrListIter* sli = init_string_list_iterator(rule->list);
-            while(NULL != (str = iterate_string_list(sli))) {
-                increment_reference(str);
-            }
+            for(int i = 0; i < rule->len; i++)
+                increment_reference(rule->list[i]);
         }
     }
     LOG(PLEVEL, "ENTER: update references");
 }
 
+/*
+ * A rule that starts with its own non-terminal is directly left recursive.
+ * Such rules are moved to the tails list, where they keep the leading
+ * symbol so the grammar analysis still sees the original rule. The emitter
+ * drops the leading symbol and the generated parser matches the tails in a
+ * loop after one of the other rules has matched, wrapping the tree it has so
+ * far as the first child of each new node. That builds the same left
+ * associative tree as the original rule without recursing.
+ */
+static void remove_direct_recursion(NonTerminal* nterm) {
+
+    RuleList* seeds = create_rule_list();
+    Rule* rule;
+    RuleListIter* rli = init_rule_list_iter(nterm->list);
+    while(NULL != (rule = iterate_rule_list(rli))) {
+        if(rule->list[0] != nterm->id)
+            add_rule_list(seeds, rule);
+        else if(rule->len == 1)
+            syntax_error("rule for %s only refers to itself", raw_string(nterm->name));
+        else
+            add_rule_list(nterm->tails, rule);
+    }
+
+    if(length_list(nterm->tails) > 0) {
+        LOG(PLEVEL, "direct left recursion: %s", raw_string(nterm->name));
+        if(length_list(seeds) == 0)
+            syntax_error("left recursive non-terminal %s has no rule that does "
+                         "not start with itself",
+                         raw_string(nterm->name));
+    }
+
+    destroy_ptr_list((PtrList*)nterm->list);
+    nterm->list = seeds;
+}
+
+/*
+ * Find the strongly connected components of the graph where A -> B when a
+ * rule of A starts with B. After the direct recursion is removed, every
+ * component that has more than one member is a cycle of indirect left
+ * recursion. All of the members are marked, and the generated parser grows
+ * their result iteratively from a seed, which keeps the tree shape of the
+ * original rules.
+ */
+typedef struct {
+    int* index;
+    int* low;
+    bool* on_stack;
+    int* stack;
+    int sp;
+    int counter;
+} Tarjan;
+
+static void find_left_cycles(Tarjan* tj, NonTerminal* nterm) {
+
+    SymbolTable* tab = parser_state->symbols;
+    int id = nterm->id;
+
+    tj->index[id] = tj->low[id] = tj->counter++;
+    tj->stack[tj->sp++] = id;
+    tj->on_stack[id] = true;
+
+    Rule* rule;
+    RuleListIter* rli = init_rule_list_iter(nterm->list);
+    while(NULL != (rule = iterate_rule_list(rli))) {
+        NonTerminal* next = get_symbol_by_id(tab, rule->list[0])->nterm;
+        if(next == NULL)
+            continue;
+        if(tj->index[next->id] < 0) {
+            find_left_cycles(tj, next);
+            if(tj->low[next->id] < tj->low[id])
+                tj->low[id] = tj->low[next->id];
+        }
+        else if(tj->on_stack[next->id] && tj->index[next->id] < tj->low[id])
+            tj->low[id] = tj->index[next->id];
+    }
+
+    if(tj->low[id] == tj->index[id]) {
+        int top = tj->sp;
+        do
+            tj->on_stack[tj->stack[--tj->sp]] = false;
+        while(tj->stack[tj->sp] != id);
+
+        if(top - tj->sp > 1) {
+            for(int i = tj->sp; i < top; i++) {
+                NonTerminal* member = get_symbol_by_id(tab, tj->stack[i])->nterm;
+                member->lr_head = true;
+                LOG(PLEVEL, "indirect left recursion: %s", raw_string(member->name));
+            }
+        }
+    }
+}
+
+static void eliminate_left_recursion() {
+
+    LOG(PLEVEL, "ENTER: eliminate left recursion");
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_nterm_list_iter(parser_state->non_terminals);
+    while(NULL != (nterm = iterate_nterm_list(ntli)))
+        remove_direct_recursion(nterm);
+
+    int size = num_symbols(parser_state->symbols);
+    Tarjan tj;
+    tj.index = _ALLOC_ARRAY(int, size);
+    tj.low = _ALLOC_ARRAY(int, size);
+    tj.on_stack = _ALLOC_ARRAY(bool, size);
+    tj.stack = _ALLOC_ARRAY(int, size);
+    tj.sp = 0;
+    tj.counter = 0;
+    for(int i = 0; i < size; i++) {
+        tj.index[i] = -1;
+        tj.on_stack[i] = false;
+    }
+
+    ntli = init_nterm_list_iter(parser_state->non_terminals);
+    while(NULL != (nterm = iterate_nterm_list(ntli)))
+        if(tj.index[nterm->id] < 0)
+            find_left_cycles(&tj, nterm);
+
+    _FREE(tj.index);
+    _FREE(tj.low);
+    _FREE(tj.on_stack);
+    _FREE(tj.stack);
+
+    LOG(PLEVEL, "LEAVE: eliminate left recursion");
+}
+
+/*
+ * Mark the non-terminals that the generated parser memoizes. The results of
+ * a non-terminal that is grown from a seed depend on the seed, so those are
+ * never memoized.
+ */
+static void check_memos() {
+
+    LOG(PLEVEL, "ENTER: check memos");
+
+    NonTerminal* nterm;
+    if(get_cmd_int(cmd, "memo")) {
+        NonTermListIter* ntli = init_nterm_list_iter(parser_state->non_terminals);
+        while(NULL != (nterm = iterate_nterm_list(ntli)))
+            nterm->memo = !nterm->lr_head;
+    }
+
+    Str* name;
+    StrListIter* sli = init_string_list_iterator(parser_state->memos);
+    while(NULL != (name = iterate_string_list(sli))) {
+        Symbol* sym = find_symbol(parser_state->symbols, raw_string(name));
+        if(sym == NULL || sym->nterm == NULL)
+            syntax_error("%s in %%memo is not a non-terminal", raw_string(name));
+        else if(sym->nterm->lr_head)
+            warning("non-terminal \"%s\" is left recursive and cannot be memoized",
+                    raw_string(name));
+        else
+            sym->nterm->memo = true;
+    }
+
+    LOG(PLEVEL, "LEAVE: check memos");
+}
+
+/*
+ * The streamed element is matched over and over instead of the start
+ * symbol, so it cannot be the start symbol itself.
+ */
+static void check_stream() {
+
+    if(parser_state->stream_name == NULL)
+        return;
+
+    const char* name = raw_string(parser_state->stream_name);
+    Symbol* sym = find_symbol(parser_state->symbols, name);
+    if(sym == NULL || sym->nterm == NULL)
+        syntax_error("%s in %%stream is not a non-terminal", name);
+    else if(sym->nterm->val == BASE_NTERM)
+        syntax_error("the start symbol \"%s\" cannot be streamed", name);
+    else
+        parser_state->stream = sym->nterm;
+}
+
+/*
+ * Mark the terminals that are named in %sync blocks.
+ */
+static void check_syncs() {
+
+    Str* name;
+    StrListIter* sli = init_string_list_iterator(parser_state->syncs);
+    while(NULL != (name = iterate_string_list(sli))) {
+        Symbol* sym = find_symbol(parser_state->symbols, raw_string(name));
+        if(sym == NULL || sym->term == NULL)
+            syntax_error("%s in %%sync is not a terminal", raw_string(name));
+        else
+            sym->term->sync = true;
+    }
+}
+
 /*
  * Verify that all of the terminals and non-terminals are referenced in the
  * grammar.
@@ -565,18 +1082,32 @@ void init_parser() {
 
     init_scanner(get_cmd_raw(cmd, "file"));
 
+    parser_state->symbols = create_symbol_table();
     parser_state->terminals = create_term_list();
     parser_state->non_terminals = create_nterm_list();
     parser_state->headers = create_string_list();
     parser_state->sources = create_string_list();
+    parser_state->memos = create_string_list();
+    parser_state->syncs = create_string_list();
+    parser_state->stream_name = NULL;
+    parser_state->stream = NULL;
+    parser_state->scan_rules = (ScanRuleList*)create_ptr_list();
+    parser_state->dfa = NULL;
 }
 
 void destroy_parser() {
 
+    destroy_symbol_table(parser_state->symbols);
     destroy_term_list(parser_state->terminals);
     destroy_nterm_list(parser_state->non_terminals);
     destroy_string_list(parser_state->headers);
     destroy_string_list(parser_state->sources);
+    destroy_string_list(parser_state->memos);
+    destroy_string_list(parser_state->syncs);
+    if(parser_state->stream_name != NULL)
+        destroy_string(parser_state->stream_name);
+    destroy_scan_rule_list(parser_state->scan_rules);
+    destroy_dfa(parser_state->dfa);
     _FREE(parser_state);
 }
 
@@ -606,6 +1137,22 @@ Parser* parser() {
                 errors += parse_header();
                 consume_token();
                 break;
+            case MEMO:
+                consume_token();
+                errors += parse_memo();
+                break;
+            case SCANNER:
+                consume_token();
+                errors += parse_scanner();
+                break;
+            case STREAM_DIR:
+                consume_token();
+                errors += parse_stream();
+                break;
+            case SYNC_DIR:
+                consume_token();
+                errors += parse_sync();
+                break;
             case END_OF_INPUT:
                 // do nothing...
                 break;
@@ -622,9 +1169,31 @@ Parser* parser() {
         tok = get_token();
     }
 
+    number_symbols();
     check_duplicates();
     update_references();
     check_references();
+
+    if(!get_errors())
+        eliminate_left_recursion();
+
+    if(!get_errors()) {
+        check_memos();
+        check_stream();
+        check_syncs();
+    }
+
+    if(!get_errors() && length_list(parser_state->scan_rules) > 0)
+        parser_state->dfa = create_dfa(parser_state);
+
+    if(!get_errors()) {
+        left_factor(parser_state);
+        analyze_grammar(parser_state);
+        find_operator_levels(parser_state);
+        if(get_cmd_int(cmd, "predict"))
+            report_conflicts(parser_state);
+    }
+
     return parser_state;
 }
 
@@ -1,8 +1,10 @@
 #ifndef _PARSER_H
 #define _PARSER_H
 
+#include "bitset.h"
 #include "logger.h"
 #include "scanner.h"
+#include "symbols.h"
 #include "util.h"
 
 typedef PtrList NonTermList;
@@ -14,31 +16,86 @@ typedef PtrListIter TermListIter;
 typedef PtrList RuleList;
 typedef PtrListIter RuleListIter;
 
-typedef struct {
+typedef PtrList ScanRuleList;
+typedef PtrListIter ScanRuleListIter;
+
+struct _terminal_ {
     Str* name;
     bool keep;
+    bool sync;       // named in a %sync block
     int ref;
     int val;
-} Terminal;
+    int id;
+};
 
-// Rules to match the non-terminal.
+// Rules to match the non-terminal. The body is a list of symbol IDs.
 typedef struct {
-    StrList* list;
+    int* list;
+    int len;
+    int cap;
+    int alt;         // the line number in the non-terminal, from 1
+    bool nullable;
+    BitSet* predict; // FIRST of the body, plus FOLLOW if it is nullable
+    uint64_t hits;   // matches of the line in the profile that was read
 } Rule;
 
-typedef struct {
+// The associativity of an operator level, when it is given in the grammar.
+typedef enum {
+    ASSOC_NONE,
+    ASSOC_LEFT,
+    ASSOC_RIGHT,
+} Assoc;
+
+struct _nonterminal_ {
     Str* name;
     RuleList* list;
+    RuleList* tails; // left recursive rules, matched in a loop
+    bool lr_head;    // member of an indirect left recursive cycle
     int prec;
+    bool prec_set;   // the precedence was given in the grammar
+    Assoc assoc;     // the associativity that was given after it
     int ref;
     int val;
-} NonTerminal;
+    int id;
+    int line_no;     // where it is defined in the grammar
+    bool memo;       // memoize the result at each token position
+    uint64_t tries;  // attempts in the profile that was read
+    bool profiled;   // it has a row in the profile, its lines go hot first
+    bool cold;       // seldom tried, so its code is placed out of line
+    bool nullable;
+    bool ll1;
+    BitSet* first;
+    BitSet* follow;
+    BitSet* sync;     // the input is skipped to one of these after an error
+    BitSet* more;     // tokens that cannot come after it
+    uint8_t* predict; // one cell per terminal, plus end of input
+    struct _factor_* tree;      // the rule lines, left factored
+    struct _factor_* tail_tree; // the tails, left factored
+    struct _oper_level_* oper;  // set when matched by an operator loop
+};
 
+// A rule of the %scanner section. The pattern is without the '"' quotes
+// or the parentheses.
 typedef struct {
+    Str* name;       // the terminal, or NULL if the match is skipped
+    Str* pattern;
+    bool literal;    // the pattern is a literal string
+    Str* code;       // the action block, or NULL
+    int term;        // symbol ID of the terminal, or -1
+} ScanRule;
+
+typedef struct {
+    SymbolTable* symbols;
     TermList* terminals;
     NonTermList* non_terminals;
     StrList* headers;
     StrList* sources;
+    StrList* memos;  // non-terminals named in %memo blocks
+    StrList* syncs;  // terminals named in %sync blocks
+    Str* stream_name;    // the non-terminal named in %stream, or NULL
+    NonTerminal* stream; // the element that the parser streams, or NULL
+    ScanRuleList* scan_rules;
+    struct _dfa_* dfa; // the scanner, when there are scan rules
 } Parser;
 
 void init_parser();
@@ -53,7 +110,14 @@ NonTermList* get_nterm_list();
 
 extern CmdLine cmd;
 
-#define BASE_NTERM 1000
-#define BASE_TERM  500
+// The terminals are numbered from BASE_TERM, and the end of the input and
+// then the non-terminals follow them, so every symbol is a small index.
+#define BASE_TERM  0
+#define BASE_NTERM (get_num_term() + 1)
+// the token and the node types are 16 bits
+#define MAX_SYMBOLS 0x10000
+
+// a node of the syntax tree has a bit for each symbol of its rule line
+#define MAX_RULE_LEN 64
 
 #endif /* _PARSER_H */
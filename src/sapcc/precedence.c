@@ -0,0 +1,251 @@
+
+#include "precedence.h"
+#include "errors.h"
+#include "logger.h"
+
+#define OLEVEL 20
+
+static Parser* parser_state;
+static int num_chains = 0;
+
+static bool is_terminal(int id) {
+
+    return get_symbol_by_id(parser_state->symbols, id)->term != NULL;
+}
+
+static void add_operator(OperLevel* level, int id, int alt) {
+
+    for(int i = 0; i < level->num; i++)
+        if(level->ops[i] == id)
+            return;
+
+    level->alts[level->num] = alt;
+    level->ops[level->num++] = id;
+}
+
+/*
+ * Check that the rules have the form of an operator level and return the
+ * level, or NULL if they do not.
+ */
+static OperLevel* get_oper_level(NonTerminal* nterm) {
+
+    int num = length_list(nterm->list) + length_list(nterm->tails);
+    OperLevel* level = _ALLOC_T(OperLevel);
+    level->operand = -1;
+    level->right = false;
+    level->num = 0;
+    level->ops = _ALLOC_ARRAY(int, num);
+    level->alts = _ALLOC_ARRAY(int, num);
+    level->base_alt = 0;
+    level->chain = NULL;
+    level->index = 0;
+
+    bool base = false;
+    bool left = false;
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(nterm->list);
+    while(iterate_list(rli, &rule)) {
+        int operand = rule->list[0];
+        if(level->operand >= 0 && operand != level->operand)
+            goto not_level;
+        level->operand = operand;
+
+        if(rule->len == 1) {
+            base = true;
+            level->base_alt = rule->alt;
+        }
+        else if(rule->len == 3 && is_terminal(rule->list[1]) && rule->list[2] == nterm->id) {
+            add_operator(level, rule->list[1], rule->alt);
+            level->right = true;
+        }
+        else
+            goto not_level;
+    }
+
+    // the tails still have the leading recursive symbol
+    rli = init_list_iterator(nterm->tails);
+    while(iterate_list(rli, &rule)) {
+        if(rule->len != 3 || !is_terminal(rule->list[1]) || rule->list[2] != level->operand)
+            goto not_level;
+        add_operator(level, rule->list[1], rule->alt);
+        left = true;
+    }
+
+    if(base && level->num > 0 && level->right != left) {
+        if(nterm->assoc == ASSOC_NONE || (nterm->assoc == ASSOC_RIGHT) == level->right)
+            return level;
+    }
+
+not_level:
+    if(nterm->assoc != ASSOC_NONE)
+        syntax_error_at(nterm->line_no, "\"%s\" is %s associative, but its rules are not \"%s\" "
+                        "for every operator and \"%s : Y\"", raw_string(nterm->name),
+                        (nterm->assoc == ASSOC_RIGHT) ? "right" : "left",
+                        (nterm->assoc == ASSOC_RIGHT) ? "X : Y OP X" : "X : X OP Y",
+                        raw_string(nterm->name));
+    destroy_oper_level(level);
+    return NULL;
+}
+
+static bool followed_by(RuleList* list, int op, int next) {
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(list);
+    while(iterate_list(rli, &rule))
+        for(int i = 0; i < rule->len; i++)
+            if(rule->list[i] == op && (i + 1 == rule->len || rule->list[i + 1] != next))
+                return false;
+
+    return true;
+}
+
+/*
+ * An operator that is followed by the operand of the level everywhere in
+ * the grammar cannot end the level when the operand fails after it, since
+ * the operand would fail after it wherever it is. It goes in the more set
+ * of the level, so the parser keeps it and finds the error in the operand.
+ */
+static void add_more(NonTerminal* nterm) {
+
+    OperLevel* level = nterm->oper;
+    int next = level->right ? nterm->id : level->operand;
+
+    for(int i = 0; i < level->num; i++) {
+        bool more = true;
+
+        NonTerminal* ptr;
+        NonTermListIter* ntli = init_list_iterator(parser_state->non_terminals);
+        while(more && iterate_list(ntli, &ptr))
+            more = followed_by(ptr->list, level->ops[i], next) && followed_by(ptr->tails, level->ops[i], next);
+
+        if(more)
+            set_bit(nterm->more, get_symbol_by_id(parser_state->symbols, level->ops[i])->term->id);
+    }
+}
+
+/*
+ * The operator level that is the operand of the level and comes next in its
+ * chain, or NULL. The precedence numbers have to go up along the chain, and
+ * an operator is only in one level of it, so that its level can be looked up.
+ */
+static NonTerminal* next_level(NonTerminal* nterm, NonTerminal** levels, int num) {
+
+    Symbol* sym = get_symbol_by_id(parser_state->symbols, nterm->oper->operand);
+    NonTerminal* next = sym->nterm;
+    if(next == NULL || next->oper == NULL || next->prec <= nterm->prec)
+        return NULL;
+
+    for(int i = 0; i < num; i++)
+        for(int j = 0; j < levels[i]->oper->num; j++)
+            for(int k = 0; k < next->oper->num; k++)
+                if(levels[i]->oper->ops[j] == next->oper->ops[k])
+                    return NULL;
+
+    return next;
+}
+
+/*
+ * Make the chain that starts at the level. The levels that are not in a
+ * chain yet are matched in this one.
+ */
+static void make_chain(NonTerminal* top) {
+
+    OperChain* chain = _ALLOC_T(OperChain);
+    chain->id = num_chains++;
+    chain->num = 0;
+    chain->levels = _ALLOC_ARRAY(NonTerminal*, length_list(parser_state->non_terminals));
+
+    for(NonTerminal* nterm = top; nterm != NULL; nterm = next_level(nterm, chain->levels, chain->num)) {
+        if(nterm->oper->chain == NULL) {
+            nterm->oper->chain = chain;
+            nterm->oper->index = chain->num;
+        }
+        chain->levels[chain->num++] = nterm;
+    }
+    chain->operand = chain->levels[chain->num - 1]->oper->operand;
+
+    LOG(OLEVEL, "operator chain %d: %s, %d levels", chain->id, raw_string(top->name), chain->num);
+}
+
+/*
+ * Public Interface
+ */
+void find_operator_levels(Parser* pstate) {
+
+    LOG(OLEVEL, "ENTER: find operator levels");
+
+    parser_state = pstate;
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        if(nterm->prec_set && !nterm->lr_head) {
+            nterm->oper = get_oper_level(nterm);
+            if(nterm->oper != NULL) {
+                LOG(OLEVEL, "operator level: %s, %s associative, %d operators",
+                    raw_string(nterm->name), nterm->oper->right ? "right" : "left",
+                    nterm->oper->num);
+                add_more(nterm);
+            }
+        }
+        else if(nterm->assoc != ASSOC_NONE)
+            syntax_error_at(nterm->line_no, "\"%s\" is in a left recursive cycle and cannot be an operator level",
+                            raw_string(nterm->name));
+    }
+
+    // The rules decide the precedence. Point out annotations that say
+    // something else, the two levels are then not in one chain.
+    bool* operand = _ALLOC_ARRAY(bool, length_list(pstate->non_terminals));
+    memset(operand, 0, sizeof(bool) * length_list(pstate->non_terminals));
+    ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        if(nterm->oper == NULL)
+            continue;
+
+        Symbol* sym = get_symbol_by_id(pstate->symbols, nterm->oper->operand);
+        if(sym->nterm == NULL || sym->nterm->oper == NULL)
+            continue;
+        if(sym->nterm->prec <= nterm->prec)
+            warning_at(nterm->line_no, "operator level \"%s\" has precedence %d but its operand \"%s\" "
+                       "has %d, the rules decide the precedence and the two are matched apart",
+                       raw_string(nterm->name), nterm->prec,
+                       raw_string(sym->name), sym->nterm->prec);
+        else
+            operand[sym->nterm->val - BASE_NTERM] = true;
+    }
+
+    // A chain starts at every level that is not the operand of another. A
+    // level that shares an operator with a level above it is left out of
+    // that chain, and starts one of its own.
+    ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm))
+        if(nterm->oper != NULL && !operand[nterm->val - BASE_NTERM])
+            make_chain(nterm);
+    ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm))
+        if(nterm->oper != NULL && nterm->oper->chain == NULL)
+            make_chain(nterm);
+    _FREE(operand);
+
+    LOG(OLEVEL, "LEAVE: find operator levels");
+}
+
+int get_num_chains() {
+
+    return num_chains;
+}
+
+void destroy_oper_level(OperLevel* level) {
+
+    if(level != NULL) {
+        // the chain belongs to the level that it starts at
+        if(level->chain != NULL && level->index == 0) {
+            _FREE(level->chain->levels);
+            _FREE(level->chain);
+        }
+        _FREE(level->ops);
+        _FREE(level->alts);
+        _FREE(level);
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * Operator precedence levels. A non-terminal that has a precedence number
+ * and whose rules all have the form of a binary operator level,
+ *
+ *     X : Y OP X ... : Y        right associative
+ *     X : X OP Y ... : Y        left associative
+ *
+ * is an operator level. A precedence number can be followed by left or
+ * right, and then the rules must have that form. Levels where the operand
+ * of one is the next, with a higher precedence, are a chain, and the chain
+ * is matched by one precedence climbing loop. The loop looks up the level
+ * of each operator and only calls the operand of the last level. The tree
+ * is the same as the rule lines give.
+ */
+#ifndef _PRECEDENCE_H
+#define _PRECEDENCE_H
+
+#include "parser.h"
+
+typedef struct _oper_level_ {
+    int operand;    // symbol ID of Y
+    bool right;     // right associative
+    int num;        // number of operators
+    int* ops;       // symbol IDs of the operator terminals
+    int* alts;      // the rule line of each operator
+    int base_alt;   // the rule line of X : Y
+    struct _oper_chain_* chain; // the chain that it is matched in
+    int index;      // its place in the chain, 0 is the lowest precedence
+} OperLevel;
+
+// A chain starts at a level that is not the operand of another one. A level
+// can be in more than one chain, but it is matched in the first one.
+typedef struct _oper_chain_ {
+    int id;                 // chains are counted from 0
+    int num;                // number of levels
+    NonTerminal** levels;   // from the lowest precedence
+    int operand;            // symbol ID of the operand of the last level
+} OperChain;
+
+void find_operator_levels(Parser* pstate);
+void destroy_oper_level(OperLevel* level);
+int get_num_chains();
+
+#endif /* _PRECEDENCE_H */
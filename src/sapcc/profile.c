@@ -0,0 +1,139 @@
+#include "profile.h"
+#include "errors.h"
+#include "factor.h"
+#include "logger.h"
+
+#define ULEVEL 20
+
+// a non-terminal that is tried less than once for every this many tries of
+// the busiest one is cold
+#define COLD_RATIO 1000
+
+// the columns of a row that are used
+#define NUM_FIELDS 4
+
+static Parser* parser_state;
+
+static Rule* find_line(RuleList* list, int alt) {
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(list);
+    while(iterate_list(rli, &rule))
+        if(rule->alt == alt)
+            return rule;
+
+    return NULL;
+}
+
+/*
+ * Split the row at the commas, keeping the empty fields. Returns the number
+ * of fields, up to max.
+ */
+static int split_fields(char* line, char** fields, int max) {
+
+    int num = 0;
+    char* p = line;
+
+    while(num < max) {
+        fields[num++] = p;
+        if(NULL == (p = strchr(p, ',')))
+            break;
+        *p++ = '\0';
+    }
+
+    return num;
+}
+
+/*
+ * A row of a non-terminal has no alt and gives its attempts. A row of a
+ * rule line gives the matches that returned a node of the line.
+ */
+static void read_counts(FILE* fp, const char* fname) {
+
+    char buffer[1024];
+    char* fields[NUM_FIELDS];
+    int line_no = 0;
+
+    while(fgets(buffer, sizeof(buffer), fp) != NULL) {
+        line_no++;
+        if(split_fields(buffer, fields, NUM_FIELDS) < NUM_FIELDS || !strcmp(fields[0], "rule"))
+            continue;
+
+        Symbol* sym = find_symbol(parser_state->symbols, fields[0]);
+        NonTerminal* nterm = (sym != NULL) ? sym->nterm : NULL;
+        bool line = fields[1][0] != '\0';
+
+        if(nterm == NULL) {
+            if(!line)
+                warning("%s:%d: \"%s\" is not a non-terminal of the grammar", fname, line_no, fields[0]);
+            continue;
+        }
+
+        if(!line) {
+            nterm->tries = strtoull(fields[2], NULL, 10);
+            nterm->profiled = true;
+            continue;
+        }
+
+        int alt = atoi(fields[1]);
+        Rule* rule = find_line(nterm->list, alt);
+        if(rule == NULL)
+            rule = find_line(nterm->tails, alt);
+        if(rule != NULL)
+            rule->hits = strtoull(fields[3], NULL, 10);
+    }
+}
+
+static void sort_lines(Factor* tree, RuleList* list) {
+
+    uint64_t* hits = _ALLOC_ARRAY(uint64_t, length_list(list) + 1);
+    int num = 0;
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(list);
+    while(iterate_list(rli, &rule))
+        hits[num++] = rule->hits;
+
+    sort_factor_tree(tree, hits);
+    _FREE(hits);
+}
+
+/*
+ * Public Interface
+ */
+void read_profile(Parser* pstate, const char* fname) {
+
+    LOG(ULEVEL, "ENTER: read profile");
+
+    parser_state = pstate;
+
+    FILE* fp = fopen(fname, "r");
+    if(fp == NULL) {
+        fatal("cannot open the profile \"%s\"", fname);
+        return;
+    }
+    read_counts(fp, fname);
+    fclose(fp);
+
+    uint64_t max = 0;
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm))
+        if(nterm->tries > max)
+            max = nterm->tries;
+
+    ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        // one that is not in the profile, such as a rule that is newer
+        // than it, was not measured and is not marked or sorted
+        nterm->cold = nterm->profiled && nterm->tries * COLD_RATIO < max;
+        if(nterm->profiled) {
+            sort_lines(nterm->tree, nterm->list);
+            sort_lines(nterm->tail_tree, nterm->tails);
+        }
+        LOG(ULEVEL, "%s: %llu tries%s", raw_string(nterm->name),
+            (unsigned long long)nterm->tries, nterm->cold ? ", cold" : "");
+    }
+
+    LOG(ULEVEL, "LEAVE: read profile");
+}
@@ -0,0 +1,15 @@
+/*
+ * Profile guided layout. A parser that is built with USE_PROFILE writes the
+ * counts of a run as CSV with dump_profile(). Read back, they order the
+ * factored rule lines so that the line that matches most often is tried
+ * where it does not have to be matched again, and they mark the rules that
+ * are seldom tried, whose code the direct backend places out of line.
+ */
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include "parser.h"
+
+void read_profile(Parser* pstate, const char* fname);
+
+#endif /* _PROFILE_H */
@@ -0,0 +1,488 @@
+
+#include "report.h"
+#include "analysis.h"
+#include "emitters.h"
+#include "errors.h"
+#include "factor.h"
+#include "precedence.h"
+#include "logger.h"
+
+#define RLEVEL 20
+
+// an estimate above this is shown as the limit
+#define COST_LIMIT 1000000000
+
+// What the report finds out about a non-terminal.
+typedef struct {
+    int branch;        // the most lines that one lookahead token chooses
+    int conflicts;     // lookahead tokens that choose more than one line
+    int chain;         // unit rules in the longest chain from it, -1 not known
+    NonTerminal* next; // the next non-terminal of that chain
+    int64_t cost;      // estimated parses of the input under it at one position
+    int state;         // 0 not visited, 1 being visited, 2 done
+} Cost;
+
+static Parser* parser_state;
+static Cost* costs;
+
+static inline Cost* get_cost(NonTerminal* nterm) {
+
+    return &costs[nterm->val - BASE_NTERM];
+}
+
+static inline NonTerminal* get_nterm(int id) {
+
+    return get_symbol_by_id(parser_state->symbols, id)->nterm;
+}
+
+static const char* symbol_name(int id) {
+
+    if(id == get_end_bit())
+        return "END OF INPUT";
+
+    return raw_string(get_symbol_by_id(parser_state->symbols, id)->name);
+}
+
+/*
+ * The lookahead tokens that choose each line of the list. A tail is chosen
+ * by what comes after its leading recursive symbol, so skip is 1 for them.
+ */
+static BitSet** predict_sets(NonTerminal* nterm, RuleList* list, int skip) {
+
+    BitSet** sets = _ALLOC_ARRAY(BitSet*, length_list(list));
+    int num = 0;
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(list);
+    while(iterate_list(rli, &rule)) {
+        BitSet* set = create_bitset(get_end_bit() + 1);
+        if(first_of_string(set, rule->list + skip, rule->len - skip))
+            union_bitset(set, nterm->follow);
+        sets[num++] = set;
+    }
+
+    return sets;
+}
+
+/*
+ * Count the lookahead tokens that choose more than one line of the list,
+ * and keep the most lines that one token chooses. With fp, every one of
+ * those tokens is reported with the lines that it chooses.
+ */
+static void count_conflicts(FILE* fp, NonTerminal* nterm, RuleList* list, int skip) {
+
+    Cost* cost = get_cost(nterm);
+    int num = length_list(list);
+    BitSet** sets = predict_sets(nterm, list, skip);
+
+    Rule** rules = _ALLOC_ARRAY(Rule*, num);
+    RuleListIter* rli = init_list_iterator(list);
+    for(int i = 0; i < num; i++)
+        iterate_list(rli, &rules[i]);
+
+    for(int b = 0; b <= get_end_bit(); b++) {
+        int count = 0;
+        for(int i = 0; i < num; i++)
+            if(test_bit(sets[i], b))
+                count++;
+
+        if(count > cost->branch)
+            cost->branch = count;
+        if(count < 2)
+            continue;
+
+        cost->conflicts++;
+        if(fp != NULL) {
+            fprintf(fp, "  %s on %s, lines", skip ? "tail conflict" : "conflict", symbol_name(b));
+            for(int i = 0; i < num; i++)
+                if(test_bit(sets[i], b))
+                    fprintf(fp, " %d", rules[i]->alt);
+            fprintf(fp, "\n");
+        }
+    }
+
+    for(int i = 0; i < num; i++)
+        destroy_bitset(sets[i]);
+    _FREE(sets);
+    _FREE(rules);
+}
+
+/*
+ * The number of times that the input under the non-terminal can be parsed
+ * from one position, at most. Every line that the lookahead token chooses
+ * is tried, and each of them parses the non-terminals in it again, so the
+ * choices multiply down the rules. A memoized non-terminal is only parsed
+ * once at a position. Recursion is counted once, so the estimate is for
+ * one level of nesting.
+ */
+static int64_t rule_cost(NonTerminal* nterm) {
+
+    Cost* cost = get_cost(nterm);
+    if(cost->state == 2)
+        return cost->cost;
+    if(cost->state == 1)
+        return 1;
+
+    cost->state = 1;
+    int64_t inner = 1;
+    int64_t memo = 1;
+
+    RuleList* lists[] = { nterm->list, nterm->tails };
+    for(int l = 0; l < 2; l++) {
+        Rule* rule;
+        RuleListIter* rli = init_list_iterator(lists[l]);
+        while(iterate_list(rli, &rule)) {
+            for(int i = 0; i < rule->len; i++) {
+                NonTerminal* next = get_nterm(rule->list[i]);
+                if(next == NULL || next == nterm)
+                    continue;
+
+                int64_t value = rule_cost(next);
+                if(next->memo && value > memo)
+                    memo = value;
+                else if(!next->memo && value > inner)
+                    inner = value;
+            }
+        }
+    }
+
+    cost->cost = inner * cost->branch;
+    if(cost->cost < memo)
+        cost->cost = memo;
+    if(cost->cost > COST_LIMIT)
+        cost->cost = COST_LIMIT;
+    cost->state = 2;
+
+    return cost->cost;
+}
+
+/*
+ * The longest chain of unit rules, X : Y, that starts at the non-terminal.
+ * Every one of them is a call that does nothing but call the next one.
+ */
+static int unit_chain(NonTerminal* nterm) {
+
+    Cost* cost = get_cost(nterm);
+    if(cost->chain >= 0)
+        return cost->chain;
+
+    // a cycle of unit rules stops here
+    cost->chain = 0;
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(nterm->list);
+    while(iterate_list(rli, &rule)) {
+        NonTerminal* next = (rule->len == 1) ? get_nterm(rule->list[0]) : NULL;
+        if(next == NULL)
+            continue;
+
+        int len = unit_chain(next) + 1;
+        if(len > cost->chain) {
+            cost->chain = len;
+            cost->next = next;
+        }
+    }
+
+    return cost->chain;
+}
+
+static void analyze_costs(Parser* pstate) {
+
+    parser_state = pstate;
+    costs = _ALLOC_ARRAY(Cost, get_num_nterm());
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        Cost* cost = get_cost(nterm);
+        cost->branch = 1;
+        cost->conflicts = 0;
+        cost->chain = -1;
+        cost->next = NULL;
+        cost->cost = 0;
+        cost->state = 0;
+
+        // an operator level does not backtrack over its lines
+        if(nterm->oper == NULL) {
+            count_conflicts(NULL, nterm, nterm->list, 0);
+            count_conflicts(NULL, nterm, nterm->tails, 1);
+        }
+    }
+
+    ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        rule_cost(nterm);
+        unit_chain(nterm);
+    }
+}
+
+/*
+ * True when a line of from starts with to, or with a non-terminal that
+ * gets to it that way.
+ */
+static bool left_reaches(NonTerminal* from, NonTerminal* to, bool* seen) {
+
+    if(seen[from->val - BASE_NTERM])
+        return false;
+    seen[from->val - BASE_NTERM] = true;
+
+    Rule* rule;
+    RuleListIter* rli = init_list_iterator(from->list);
+    while(iterate_list(rli, &rule)) {
+        NonTerminal* next = get_nterm(rule->list[0]);
+        if(next != NULL && (next == to || left_reaches(next, to, seen)))
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * The members of every indirect left recursive cycle, which are grown from
+ * a seed, and the non-terminals with left recursive tails.
+ */
+static void report_recursion(FILE* fp) {
+
+    int num = get_num_nterm();
+    bool* done = _ALLOC_ARRAY(bool, num);
+    bool* seen = _ALLOC_ARRAY(bool, num);
+    memset(done, 0, sizeof(bool) * num);
+
+    fprintf(fp, "left recursion:\n");
+
+    NonTerminal *nterm, *other;
+    NonTermListIter* ntli = init_list_iterator(parser_state->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        if(length_list(nterm->tails) > 0)
+            fprintf(fp, "  %s: %d tail line%s, matched in a loop\n", raw_string(nterm->name),
+                    length_list(nterm->tails), (length_list(nterm->tails) > 1) ? "s" : "");
+
+        if(!nterm->lr_head || done[nterm->val - BASE_NTERM])
+            continue;
+
+        fprintf(fp, "  cycle, grown from a seed: %s", raw_string(nterm->name));
+        NonTermListIter* inner = init_list_iterator(parser_state->non_terminals);
+        while(iterate_list(inner, &other)) {
+            if(other == nterm || !other->lr_head || done[other->val - BASE_NTERM])
+                continue;
+
+            memset(seen, 0, sizeof(bool) * num);
+            if(!left_reaches(nterm, other, seen))
+                continue;
+            memset(seen, 0, sizeof(bool) * num);
+            if(!left_reaches(other, nterm, seen))
+                continue;
+
+            fprintf(fp, ", %s", raw_string(other->name));
+            done[other->val - BASE_NTERM] = true;
+        }
+        fprintf(fp, "\n");
+    }
+
+    _FREE(done);
+    _FREE(seen);
+}
+
+static int count_lines(Factor* node) {
+
+    int count = (node->end != 0) ? 1 : 0;
+    for(int i = 0; i < node->num; i++)
+        count += count_lines(node->next[i]);
+
+    return count;
+}
+
+/*
+ * Every node of the factored tree where more than one line goes on is a
+ * prefix that is matched once for all of them, and the point where the
+ * lines are tried one after the other.
+ */
+static void report_prefixes(FILE* fp, NonTerminal* nterm, Factor* node, int* path, int depth, bool tails) {
+
+    for(int i = 0; i < node->num; i++) {
+        Factor* next = node->next[i];
+        path[depth] = next->sym;
+
+        if(next->num > 1 || (next->num > 0 && next->end != 0)) {
+            fprintf(fp, "  shared prefix \"%s", tails ? raw_string(nterm->name) : "");
+            for(int j = 0; j <= depth; j++)
+                fprintf(fp, (j > 0 || tails) ? " %s" : "%s", symbol_name(path[j]));
+            fprintf(fp, "\", %d lines\n", count_lines(next));
+        }
+
+        report_prefixes(fp, nterm, next, path, depth + 1, tails);
+    }
+}
+
+static void report_nterm(FILE* fp, NonTerminal* nterm) {
+
+    Cost* cost = get_cost(nterm);
+    int path[MAX_RULE_LEN];
+
+    bool prefixes = factor_shared_prefixes(nterm->tree) + factor_shared_prefixes(nterm->tail_tree) > 0;
+    if(cost->conflicts == 0 && cost->chain < 2 && !prefixes)
+        return;
+
+    fprintf(fp, "\n%s:\n", raw_string(nterm->name));
+
+    if(cost->conflicts > 0) {
+        cost->conflicts = 0;
+        count_conflicts(fp, nterm, nterm->list, 0);
+        count_conflicts(fp, nterm, nterm->tails, 1);
+    }
+
+    report_prefixes(fp, nterm, nterm->tree, path, 0, false);
+    report_prefixes(fp, nterm, nterm->tail_tree, path, 0, true);
+
+    if(cost->chain >= 2) {
+        fprintf(fp, "  unit chain of %d: %s", cost->chain, raw_string(nterm->name));
+        NonTerminal* next = cost->next;
+        for(int i = 0; i < cost->chain; i++) {
+            fprintf(fp, " -> %s", raw_string(next->name));
+            next = get_cost(next)->next;
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+/*
+ * The size of the tables that the parser is emitted with, in bytes, with
+ * the entry type, the packing of -z1, and -p as the emitter picks them. The
+ * parser and predict tables are only in the table backend, and the predict
+ * table is left out with -p0.
+ */
+static void report_tables(FILE* fp) {
+
+    TableSize size = { 0, 0, 0 };
+    if(strcmp(get_cmd_raw(cmd, "backend"), "direct"))
+        get_table_size(parser_state, &size);
+
+    int sets = 3 * get_num_nterm() * ((get_num_term() + 1 + 31) / 32) * 4;
+
+    fprintf(fp, "\ntables:\n");
+    if(size.entries > 0)
+        fprintf(fp, "  parser_table: %d entries, %d bytes\n", size.entries, size.entries * size.entry_size);
+    if(size.predict > 0)
+        fprintf(fp, "  predict_table: %d bytes%s\n", size.predict,
+                get_cmd_int(cmd, "compress") ? ", packed" : "");
+    fprintf(fp, "  recovery sets: %d bytes\n", sets);
+    fprintf(fp, "  total: %d bytes\n", size.entries * size.entry_size + size.predict + sets);
+}
+
+/*
+ * Public Interface
+ */
+void report_grammar(Parser* pstate, FILE* fp) {
+
+    LOG(RLEVEL, "ENTER: report grammar");
+
+    analyze_costs(pstate);
+
+    fprintf(fp, "grammar: %s\n", get_cmd_raw(cmd, "file"));
+    fprintf(fp, "terminals: %d, non-terminals: %d\n\n", get_num_term(), get_num_nterm());
+
+    report_recursion(fp);
+
+    // branch is the most lines that one token tries, and cost multiplies
+    // them down the rules
+    fprintf(fp, "\n%-24s %6s %6s %10s %7s %6s %11s %8s\n", "rule", "lines", "tails",
+            "conflicts", "branch", "chain", "cost", "entries");
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        Cost* cost = get_cost(nterm);
+        fprintf(fp, "%-24s %6d %6d %10d %7d %6d %11lld%s %7d\n", raw_string(nterm->name),
+                length_list(nterm->list), length_list(nterm->tails), cost->conflicts,
+                cost->branch, cost->chain, (long long)cost->cost,
+                (cost->cost >= COST_LIMIT) ? "+" : " ", get_rule_size(nterm));
+    }
+
+    ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm))
+        report_nterm(fp, nterm);
+
+    report_tables(fp);
+
+    LOG(RLEVEL, "LEAVE: report grammar");
+}
+
+static const char* cost_color(Cost* cost) {
+
+    if(cost->cost >= 100)
+        return "red";
+    else if(cost->cost >= 10)
+        return "orange";
+    else if(cost->cost > 1 || cost->conflicts > 0)
+        return "yellow";
+    else
+        return "palegreen";
+}
+
+/*
+ * Write the graph of the non-terminals, where A -> B when a line of A has B
+ * in it. The edge is bold when B starts the line, and a node is colored by
+ * its estimated cost.
+ */
+void write_rule_graph(Parser* pstate, const char* fname) {
+
+    LOG(RLEVEL, "ENTER: write rule graph");
+
+    FILE* fp = fopen(fname, "w");
+    if(fp == NULL) {
+        fatal("cannot open the graph file \"%s\"", fname);
+        return;
+    }
+
+    analyze_costs(pstate);
+
+    int num = get_num_nterm();
+    int* edges = _ALLOC_ARRAY(int, num);
+
+    fprintf(fp, "digraph grammar {\n");
+    fprintf(fp, "    node [shape=box, style=filled];\n\n");
+
+    NonTerminal* nterm;
+    NonTermListIter* ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        Cost* cost = get_cost(nterm);
+        fprintf(fp, "    \"%s\" [label=\"%s\\ncost %lld\", fillcolor=%s];\n",
+                raw_string(nterm->name), raw_string(nterm->name), (long long)cost->cost,
+                cost_color(cost));
+    }
+    fprintf(fp, "\n");
+
+    ntli = init_list_iterator(pstate->non_terminals);
+    while(iterate_list(ntli, &nterm)) {
+        // 1 when it is in a line, 2 when it starts one
+        memset(edges, 0, sizeof(int) * num);
+
+        RuleList* lists[] = { nterm->list, nterm->tails };
+        for(int l = 0; l < 2; l++) {
+            Rule* rule;
+            RuleListIter* rli = init_list_iterator(lists[l]);
+            while(iterate_list(rli, &rule)) {
+                for(int i = 0; i < rule->len; i++) {
+                    NonTerminal* next = get_nterm(rule->list[i]);
+                    if(next != NULL && edges[next->val - BASE_NTERM] < ((i == 0) ? 2 : 1))
+                        edges[next->val - BASE_NTERM] = (i == 0) ? 2 : 1;
+                }
+            }
+        }
+
+        NonTerminal* next;
+        NonTermListIter* inner = init_list_iterator(pstate->non_terminals);
+        while(iterate_list(inner, &next)) {
+            int edge = edges[next->val - BASE_NTERM];
+            if(edge != 0)
+                fprintf(fp, "    \"%s\" -> \"%s\"%s;\n", raw_string(nterm->name),
+                        raw_string(next->name), (edge == 2) ? " [style=bold]" : "");
+        }
+    }
+
+    fprintf(fp, "}\n");
+    fclose(fp);
+    _FREE(edges);
+
+    LOG(RLEVEL, "LEAVE: write rule graph");
+}
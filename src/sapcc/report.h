@@ -0,0 +1,16 @@
+/*
+ * Grammar cost report. This looks at the grammar after it is analyzed and
+ * reports the shapes that make the generated parser slow, which are left
+ * recursion, rules that the lookahead token does not decide, lines that
+ * share a prefix, and long chains of unit rules. It can also write the rule
+ * graph in DOT notation, colored by the estimated cost of every rule.
+ */
+#ifndef _REPORT_H
+#define _REPORT_H
+
+#include "parser.h"
+
+void report_grammar(Parser* pstate, FILE* fp);
+void write_rule_graph(Parser* pstate, const char* fname);
+
+#endif /* _REPORT_H */
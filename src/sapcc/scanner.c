@@ -114,12 +114,91 @@ static void get_keyword() {
         scanner_state->token->type = SOURCE;
     else if(!comp_string_const(scanner_state->token->str, "%header"))
         scanner_state->token->type = HEADER;
+    else if(!comp_string_const(scanner_state->token->str, "%memo"))
+        scanner_state->token->type = MEMO;
+    else if(!comp_string_const(scanner_state->token->str, "%scanner"))
+        scanner_state->token->type = SCANNER;
+    else if(!comp_string_const(scanner_state->token->str, "%stream"))
+        scanner_state->token->type = STREAM_DIR;
+    else if(!comp_string_const(scanner_state->token->str, "%sync"))
+        scanner_state->token->type = SYNC_DIR;
     else {
         scanner_error("unknown directive: %s", raw_string(scanner_state->token->str));
         scanner_state->token->type = ERROR;
     }
 }
 
+/*
+ * A literal pattern is everything up to the closing '"'. Escapes are kept
+ * as they are, the scanner generator reads them.
+ */
+static void get_literal() {
+
+    // consume the '"'
+    consume_scanner_char();
+
+    while(true) {
+        int ch = get_scanner_char();
+        if(ch == EOF || ch == '\n') {
+            scanner_error("unterminated literal pattern");
+            scanner_state->token->type = ERROR;
+            return;
+        }
+        consume_scanner_char();
+        if(ch == '"')
+            break;
+
+        add_string_char(scanner_state->token->str, ch);
+        if(ch == '\\') {
+            add_string_char(scanner_state->token->str, get_scanner_char());
+            consume_scanner_char();
+        }
+    }
+
+    scanner_state->token->type = LITERAL;
+}
+
+/*
+ * A regular expression pattern is everything up to the matching ')'. A ')'
+ * in a character class or after a '\' does not close it.
+ */
+static void get_regex() {
+
+    int level = 1;
+    bool in_class = false;
+
+    // consume the '('
+    consume_scanner_char();
+
+    while(true) {
+        int ch = get_scanner_char();
+        if(ch == EOF) {
+            scanner_error("unterminated regular expression pattern");
+            scanner_state->token->type = ERROR;
+            return;
+        }
+        consume_scanner_char();
+
+        if(ch == '\\') {
+            add_string_char(scanner_state->token->str, ch);
+            ch = get_scanner_char();
+            consume_scanner_char();
+        }
+        else if(in_class)
+            in_class = (ch != ']');
+        else if(ch == '[')
+            in_class = true;
+        else if(ch == '(')
+            level++;
+        else if(ch == ')' && --level == 0)
+            break;
+
+        add_string_char(scanner_state->token->str, ch);
+    }
+
+    scanner_state->token->type = REGEX;
+}
+
 static void get_symbol() {
 
     get_word();
@@ -201,6 +280,14 @@ void consume_token() {
                 consume_scanner_char();
                 finished++;
                 break;
+            case '"':
+                get_literal();
+                finished++;
+                break;
+            case '(':
+                get_regex();
+                finished++;
+                break;
             case '#': eat_comment(); break;
             default:
                 if(isspace(ch))
@@ -281,6 +368,12 @@ const char* tok_type_to_str(TokenType type) {
     (type == GRAMMAR)       ? "GRAMMAR" :
     (type == SOURCE)        ? "SOURCE" :
     (type == HEADER)        ? "HEADER" :
+    (type == MEMO)          ? "MEMO" :
+    (type == SCANNER)       ? "SCANNER" :
+    (type == STREAM_DIR)    ? "STREAM" :
+    (type == SYNC_DIR)      ? "SYNC" :
+    (type == LITERAL)       ? "LITERAL" :
+    (type == REGEX)         ? "REGEX" :
     (type == BLOCK)         ? "BLOCK" :
     (type == SYMBOL)        ? "SYMBOL" :
     (type == COLON)         ? ":" :
@@ -12,9 +12,15 @@ typedef enum {
     GRAMMAR,      // the %grammar keyword
     SOURCE,       // the %source keyword
     HEADER,       // the %header keyword
+    MEMO,         // the %memo keyword
+    SCANNER,      // the %scanner keyword
+    STREAM_DIR,   // the %stream keyword
+    SYNC_DIR,     // the %sync keyword
     BLOCK,        // a generic '{'.*'}' block
     SYMBOL,       // a generic name: [a-zA-Z][a-zA-Z0-9]*
     NUMBER,       // a generic number: [0-9]*
+    LITERAL,      // a scanner pattern in '"' quotes
+    REGEX,        // a scanner pattern in '(' and ')'
     COLON,        // a ':' character
     SEMI,         // a ';' character
     OBRACE,       // a '{'
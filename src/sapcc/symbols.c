@@ -0,0 +1,140 @@
+
+#include "symbols.h"
+#include "logger.h"
+
+#define SYLEVEL 20
+
+/*
+ * FNV-1a. The names are short and this spreads them well enough.
+ */
+static uint32_t hash_name(const char* name) {
+
+    uint32_t hash = 2166136261u;
+
+    for(const unsigned char* p = (const unsigned char*)name; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+ * Return the bucket that holds the name, or the empty bucket where it would
+ * be inserted.
+ */
+static int find_bucket(SymbolTable* tab, const char* name) {
+
+    int mask = tab->nbuckets - 1;
+    int slot = (int)(hash_name(name) & (uint32_t)mask);
+
+    while(tab->buckets[slot] != 0) {
+        Symbol* sym = tab->list[tab->buckets[slot] - 1];
+        if(!strcmp(raw_string(sym->name), name))
+            break;
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+/*
+ * Double the number of buckets and re-insert all of the symbols. The ids do
+ * not change.
+ */
+static void grow_buckets(SymbolTable* tab) {
+
+    _FREE(tab->buckets);
+    tab->nbuckets <<= 1;
+    tab->buckets = _ALLOC_ARRAY(int, tab->nbuckets);
+    memset(tab->buckets, 0, sizeof(int) * tab->nbuckets);
+
+    for(int i = 0; i < tab->len; i++) {
+        int slot = find_bucket(tab, raw_string(tab->list[i]->name));
+        tab->buckets[slot] = i + 1;
+    }
+}
+
+/*
+ * Public Interface
+ */
+SymbolTable* create_symbol_table() {
+
+    SymbolTable* tab = _ALLOC_T(SymbolTable);
+
+    tab->cap = 64;
+    tab->len = 0;
+    tab->list = _ALLOC_ARRAY(Symbol*, tab->cap);
+    tab->nbuckets = 128;
+    tab->buckets = _ALLOC_ARRAY(int, tab->nbuckets);
+    memset(tab->buckets, 0, sizeof(int) * tab->nbuckets);
+
+    return tab;
+}
+
+void destroy_symbol_table(SymbolTable* tab) {
+
+    if(tab != NULL) {
+        for(int i = 0; i < tab->len; i++) {
+            destroy_string(tab->list[i]->name);
+            _FREE(tab->list[i]);
+        }
+        _FREE(tab->list);
+        _FREE(tab->buckets);
+        _FREE(tab);
+    }
+}
+
+/*
+ * Return the symbol with the given name, creating it if it does not exist.
+ * The name is copied.
+ */
+Symbol* intern_symbol(SymbolTable* tab, Str* name) {
+
+    int slot = find_bucket(tab, raw_string(name));
+    if(tab->buckets[slot] != 0)
+        return tab->list[tab->buckets[slot] - 1];
+
+    if(tab->len + 1 > tab->cap) {
+        tab->cap <<= 1;
+        tab->list = _REALLOC_ARRAY(tab->list, Symbol*, tab->cap);
+    }
+
+    Symbol* sym = _ALLOC_T(Symbol);
+    sym->name = copy_string(name);
+    sym->id = tab->len;
+    sym->term = NULL;
+    sym->nterm = NULL;
+
+    tab->list[tab->len++] = sym;
+    tab->buckets[slot] = sym->id + 1;
+
+    // keep the load factor under one half
+    if(tab->len * 2 > tab->nbuckets)
+        grow_buckets(tab);
+
+    LOG(SYLEVEL, "intern symbol: %s = %d", raw_string(sym->name), sym->id);
+    return sym;
+}
+
+/*
+ * Return the symbol with the given name or NULL if it has not been seen.
+ */
+Symbol* find_symbol(SymbolTable* tab, const char* name) {
+
+    int slot = find_bucket(tab, name);
+
+    return (tab->buckets[slot] != 0) ? tab->list[tab->buckets[slot] - 1] : NULL;
+}
+
+Symbol* get_symbol_by_id(SymbolTable* tab, int id) {
+
+    assert(id >= 0 && id < tab->len);
+
+    return tab->list[id];
+}
+
+int num_symbols(SymbolTable* tab) {
+
+    return tab->len;
+}
@@ -0,0 +1,38 @@
+/*
+ * Interned symbol table. Every name that appears in the grammar, whether it
+ * is defined as a terminal, a non-terminal, or only referenced from a rule,
+ * gets exactly one entry. Entries are numbered densely from zero in the order
+ * that they are first seen so that the rest of the generator can refer to a
+ * symbol by a small integer and index arrays with it.
+ */
+#ifndef _SYMBOLS_H
+#define _SYMBOLS_H
+
+#include "util.h"
+
+typedef struct _terminal_ Terminal;
+typedef struct _nonterminal_ NonTerminal;
+
+typedef struct {
+    Str* name;
+    int id;             // dense index into the symbol table
+    Terminal* term;     // set when defined in a %tokens block
+    NonTerminal* nterm; // set when defined in a %grammar block
+} Symbol;
+
+typedef struct {
+    Symbol** list; // symbols indexed by id
+    int len;
+    int cap;
+    int* buckets;  // open addressed hash of id+1, zero marks an empty slot
+    int nbuckets;
+} SymbolTable;
+
+SymbolTable* create_symbol_table();
+void destroy_symbol_table(SymbolTable* tab);
+Symbol* intern_symbol(SymbolTable* tab, Str* name);
+Symbol* find_symbol(SymbolTable* tab, const char* name);
+Symbol* get_symbol_by_id(SymbolTable* tab, int id);
+int num_symbols(SymbolTable* tab);
+
+#endif /* _SYMBOLS_H */
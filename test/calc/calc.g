@@ -18,16 +18,19 @@
     expr_term:1 {
         : expr_pow ADD expr_term
         : expr_pow SUB expr_term
+        : expr_pow
     }
 
-    expr_pow:3 {
+    expr_pow:2 {
         : expr_fact POW expr_pow
+        : expr_fact
     }
 
-    expr_fact:2 {
+    expr_fact:3 {
         : expr_unary MUL expr_fact
         : expr_unary DIV expr_fact
         : expr_unary MOD expr_fact
+        : expr_unary
     }
 
     expr_unary:4 {
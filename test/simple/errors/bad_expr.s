@@ -0,0 +1,4 @@
+entry {
+    integer x = 1 + * 2
+    integer y = 3
+}
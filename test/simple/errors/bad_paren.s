@@ -0,0 +1,5 @@
+namespace n {
+    integer foo: g() {
+        y = (1 + 2
+    }
+}
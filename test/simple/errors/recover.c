@@ -0,0 +1,26 @@
+/*
+ * Parse a file that has syntax errors and print the number of errors after
+ * the messages, to check where the parser finds them and that it recovers
+ * without reporting more.
+ */
+#include "util.h"
+#include "simple_scanner.h"
+#include "simple_ast.h"
+#include "simple_parser.h"
+
+int main(int argc, char** argv) {
+
+    if(argc < 2) {
+        fprintf(stderr, "use: %s file\n", argv[0]);
+        return 1;
+    }
+
+    ParserContext* ctx = create_parser_context();
+    open_file(ctx, argv[1]);
+    parse(ctx);
+    fflush(stderr);
+    printf("errors: %d\n", get_errors(ctx));
+    destroy_parser_context(ctx);
+
+    return 0;
+}
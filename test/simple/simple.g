@@ -82,6 +82,92 @@
     MOD_ASSIGN@
 }
 
+%scanner {
+    # keywords come before SYMBOL so that they win a tie
+    NAMESPACE      : "namespace"
+    CLASS          : "class"
+    CREATE         : "create"
+    DESTROY        : "destroy"
+    IF             : "if"
+    ELSE           : "else"
+    WHILE          : "while"
+    DO             : "do"
+    FOR            : "for"
+    IN             : "in"
+    TO             : "to"
+    TRY            : "try"
+    EXCEPT         : "except"
+    RAISE          : "raise"
+    RETURN         : "return"
+    EXIT           : "exit"
+    SWITCH         : "switch"
+    CASE           : "case"
+    YIELD          : "yield"
+    TRACE          : "trace"
+    PRINT          : "print"
+    IMPORT         : "import"
+    TRUE           : "true"
+    FALSE          : "false"
+    BREAK          : "break"
+    CONTINUE       : "continue"
+    INLINE         : "inline"
+    ENTRY          : "entry"
+    DEFAULT        : "default"
+    AS             : "as"
+    PUBLIC         : "public"
+    PRIVATE        : "private"
+    PROTECTED      : "protected"
+    INTEGER        : "integer"
+    UNSIGNED       : "unsigned"
+    FLOAT          : "float"
+    STRING         : "string"
+    DICT           : "dict"
+    LIST           : "list"
+    BOOLEAN        : "boolean"
+    NOTHING        : "nothing"
+
+    DOT            : "."
+    COMMA          : ","
+    COLON          : ":"
+    OPAREN         : "("
+    CPAREN         : ")"
+    OBLOCK         : "{"
+    CBLOCK         : "}"
+    OBRACE         : "["
+    CBRACE         : "]"
+    ASSIGN         : "="
+    ADD            : "+"
+    SUB            : "-"
+    MUL            : "*"
+    DIV            : "/"
+    MOD            : "%"
+    POW            : "^"
+    NOT            : "!"
+    OR             : "|"
+    AND            : "&"
+    EQU            : "=="
+    NEQU           : "!="
+    LORE           : "<="
+    GORE           : ">="
+    OPOINT         : "<"
+    CPOINT         : ">"
+    ADD_ASSIGN     : "+="
+    SUB_ASSIGN     : "-="
+    MUL_ASSIGN     : "*="
+    DIV_ASSIGN     : "/="
+    MOD_ASSIGN     : "%="
+
+    SYMBOL         : ([a-zA-Z_][a-zA-Z_0-9]*)
+    UNSIGNED_CONST : (0[xX][0-9a-fA-F]+)
+    INT_CONST      : ([0-9]+)
+    FLOAT_CONST    : ([0-9]+\.[0-9]+([eE][+-]?[0-9]+)?)
+    STRG_CONST     : (\"([^\"\\\n]|\\.)*\")
+
+    # white space and comments
+                   : ([ \t\r\n]+)
+                   : (;[^\n]*)
+}
+
 %grammar {
 
     module {
@@ -254,39 +340,46 @@
         : expr_or
     }
 
-    expr_or {
+    expr_or:1 {
         : expr_and OR expr_or
+        : expr_and
     }
 
-    expr_and {
+    expr_and:2 {
         : expr_equ AND expr_and
+        : expr_equ
     }
 
-    expr_equ {
+    expr_equ:3 {
         : expr_comp EQU expr_equ
         : expr_comp NEQU expr_equ
+        : expr_comp
     }
 
-    expr_comp {
+    expr_comp:4 {
         : expr_term LORE expr_comp
         : expr_term GORE expr_comp
         : expr_term CPOINT expr_comp
         : expr_term OPOINT expr_comp
+        : expr_term
     }
 
-    expr_term {
+    expr_term:5 {
         : expr_pow ADD expr_term
         : expr_pow SUB expr_term
+        : expr_pow
     }
 
-    expr_pow {
+    expr_pow:6 {
         : expr_fact POW expr_pow
+        : expr_fact
     }
 
-    expr_fact {
+    expr_fact:7 {
         : expr_unary MUL expr_fact
         : expr_unary DIV expr_fact
         : expr_unary MOD expr_fact
+        : expr_unary
     }
 
     expr_unary {